@@ -0,0 +1,221 @@
+/*
+ * futex-hash-bench: measure futex hash bucket contention and collisions
+ *
+ * Every thread owns a number of futexes of its own. In the timed part
+ * each thread repeatedly issues FUTEX_WAKE on one of them, which finds
+ * no waiter, and FUTEX_WAIT with a value that does not match, which
+ * returns -EWOULDBLOCK at once. Both only take the hash bucket lock of
+ * the futex, so the rate shows how much unrelated futexes contend on
+ * shared buckets: in the global futex hash, or in the private hash of
+ * the process for PROCESS_PRIVATE futexes (the default, -s selects
+ * shared ones).
+ *
+ * Before that, one waiter per futex is parked on it and the table
+ * occupancy is read from the futex_hash file in debugfs, which lists for
+ * each bucket in use the number of waiters and of distinct futexes; every
+ * futex that shares a bucket with another one is a collision. Pass -v to
+ * print the per-bucket lines as well as the summaries.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o futex-hash-bench futex-hash-bench.c -lpthread
+ *
+ * Usage: futex-hash-bench [-t threads] [-f futexes per thread] [-s] [-v]
+ *                         [-d seconds] [-D debugfs mount]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/futex.h>
+
+#ifndef FUTEX_PRIVATE_FLAG
+#define FUTEX_PRIVATE_FLAG	128
+#endif
+
+static volatile int stop;
+static int nr_futexes = 4;
+static int futex_flags = FUTEX_PRIVATE_FLAG;
+static int *futexes;
+
+struct worker {
+	pthread_t thread;
+	int *futex;
+	volatile unsigned long long ops;
+};
+
+static int futex(int *uaddr, int op, int val)
+{
+	return syscall(SYS_futex, uaddr, op | futex_flags, val, NULL, NULL, 0);
+}
+
+static void *park_thread(void *arg)
+{
+	int *f = arg;
+
+	while (!stop)
+		futex(f, FUTEX_WAIT, 0);
+	return NULL;
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	int i = 0;
+
+	while (!stop) {
+		futex(&w->futex[i], FUTEX_WAKE, 1);
+		futex(&w->futex[i], FUTEX_WAIT, 1);
+		if (++i == nr_futexes)
+			i = 0;
+		w->ops += 2;
+	}
+	return NULL;
+}
+
+static void show_hash(const char *debugfs, int verbose)
+{
+	char path[4096], line[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/futex_hash", debugfs);
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return;
+	}
+	while (fgets(line, sizeof(line), f))
+		if (verbose || strstr(line, "buckets"))
+			fputs(line, stdout);
+	fclose(f);
+}
+
+/* park a waiter on every futex, show the hash table, then let them go */
+static void collisions(int nr_total, const char *debugfs, int verbose)
+{
+	pthread_t *parked;
+	int i;
+
+	parked = calloc(nr_total, sizeof(*parked));
+	if (!parked) {
+		perror("calloc");
+		exit(1);
+	}
+	for (i = 0; i < nr_total; i++) {
+		if (pthread_create(&parked[i], NULL, park_thread,
+				   &futexes[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	/* there is no telling when they are queued, give them time */
+	usleep(200000 + nr_total * 100);
+	show_hash(debugfs, verbose);
+
+	stop = 1;
+	for (i = 0; i < nr_total; i++) {
+		futexes[i] = 1;
+		futex(&futexes[i], FUTEX_WAKE, 1);
+	}
+	for (i = 0; i < nr_total; i++)
+		pthread_join(parked[i], NULL);
+	for (i = 0; i < nr_total; i++)
+		futexes[i] = 0;
+	stop = 0;
+	free(parked);
+}
+
+static void usage(void)
+{
+	printf("futex-hash-bench [-t threads] [-f futexes per thread] [-s] "
+	       "[-v] [-d seconds] [-D debugfs mount]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr = 8, seconds = 5, verbose = 0, i, c;
+	const char *debugfs = "/sys/kernel/debug";
+	unsigned long long total, last = 0;
+	struct timeval start, end;
+	struct worker *w;
+	double elapsed;
+
+	while ((c = getopt(argc, argv, "t:f:svd:D:")) != -1) {
+		switch (c) {
+		case 't':
+			nr = atoi(optarg);
+			break;
+		case 'f':
+			nr_futexes = atoi(optarg);
+			break;
+		case 's':
+			futex_flags = 0;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'D':
+			debugfs = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || nr < 1 || nr_futexes < 1 || seconds < 1)
+		usage();
+
+	futexes = calloc(nr * nr_futexes, sizeof(*futexes));
+	w = calloc(nr, sizeof(*w));
+	if (!futexes || !w) {
+		perror("calloc");
+		return 1;
+	}
+
+	collisions(nr * nr_futexes, debugfs, verbose);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		w[i].futex = &futexes[i * nr_futexes];
+		if (pthread_create(&w[i].thread, NULL, worker_thread, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (c = 0; c < seconds; c++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr; i++)
+			total += w[i].ops;
+		printf("%3d s: %10llu futex ops/s\n", c + 1, total - last);
+		fflush(stdout);
+		last = total;
+	}
+	stop = 1;
+
+	for (total = 0, i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].ops;
+	}
+	gettimeofday(&end, NULL);
+	elapsed = end.tv_sec - start.tv_sec +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("%d threads, %d %s futexes each: %.0f futex ops/s, "
+	       "%.0f per thread\n", nr, nr_futexes,
+	       futex_flags ? "private" : "shared", total / elapsed,
+	       total / elapsed / nr);
+
+	free(w);
+	free(futexes);
+	return 0;
+}
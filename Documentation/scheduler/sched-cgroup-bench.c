@@ -0,0 +1,240 @@
+/*
+ * sched-cgroup-bench: measure scheduler overhead with many task groups
+ *
+ * Creates a number of cpu controller cgroups below the given mount point
+ * and runs pairs of processes that bounce a byte over two pipes, so that
+ * every round trip is two wakeups and two context switches. Optionally a
+ * number of cpu bound processes keep all cpus busy so that the periodic
+ * load balancer is active. The processes are spread round robin over the
+ * groups; the remaining groups stay empty, which is the common case on a
+ * host with thousands of containers and the one where the scheduler should
+ * not spend any time on them.
+ *
+ * Every second the round trip rate is printed, at the end the totals and
+ * the share of cpu time spent in the kernel according to /proc/stat.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o sched-cgroup-bench sched-cgroup-bench.c
+ *
+ * Usage: mount -t cgroup -o cpu none /cgroup
+ *        sched-cgroup-bench [-g groups] [-p pairs] [-b busy] [-d seconds]
+ *                           /cgroup
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static const char *root;
+static int nr_groups = 1000;
+static volatile unsigned long long *counts;
+
+static void group_path(char *buf, size_t len, int group)
+{
+	snprintf(buf, len, "%s/bench.%d", root, group);
+}
+
+static void join_group(int group)
+{
+	char path[4096];
+	int fd;
+
+	group_path(path, sizeof(path), group);
+	strcat(path, "/tasks");
+	fd = open(path, O_WRONLY);
+	if (fd < 0 || write(fd, "0", 1) != 1) {
+		perror(path);
+		exit(1);
+	}
+	close(fd);
+}
+
+static void create_groups(void)
+{
+	char path[4096];
+	int i;
+
+	for (i = 0; i < nr_groups; i++) {
+		group_path(path, sizeof(path), i);
+		if (mkdir(path, 0755)) {
+			perror(path);
+			exit(1);
+		}
+	}
+}
+
+static void remove_groups(void)
+{
+	char path[4096];
+	int i;
+
+	for (i = 0; i < nr_groups; i++) {
+		group_path(path, sizeof(path), i);
+		rmdir(path);
+	}
+}
+
+static void pingpong(int group, int in, int out, int starter,
+		     volatile unsigned long long *count)
+{
+	char c = 0;
+
+	join_group(group);
+	if (starter && write(out, &c, 1) != 1)
+		exit(1);
+	for (;;) {
+		if (read(in, &c, 1) != 1)
+			exit(0);
+		if (write(out, &c, 1) != 1)
+			exit(0);
+		if (starter)
+			(*count)++;
+	}
+}
+
+static void busy(int group)
+{
+	join_group(group);
+	for (;;)
+		;
+}
+
+/* user + nice + system + idle + iowait + irq + softirq, and system */
+static void read_stat(unsigned long long *total, unsigned long long *sys)
+{
+	unsigned long long v[7];
+	FILE *f;
+	int i;
+
+	f = fopen("/proc/stat", "r");
+	if (!f || fscanf(f, "cpu %llu %llu %llu %llu %llu %llu %llu",
+			 &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) != 7) {
+		perror("/proc/stat");
+		exit(1);
+	}
+	fclose(f);
+
+	for (*total = 0, i = 0; i < 7; i++)
+		*total += v[i];
+	*sys = v[2] + v[5] + v[6];
+}
+
+static void usage(void)
+{
+	printf("sched-cgroup-bench [-g groups] [-p pairs] [-b busy] "
+	       "[-d seconds] cgroup-mount\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr_pairs = 16, nr_busy = 0, seconds = 10, nr_pids = 0, i, c;
+	unsigned long long total, last = 0;
+	unsigned long long stat_total[2], stat_sys[2];
+	struct timeval start, end;
+	double elapsed;
+	pid_t *pids;
+
+	while ((c = getopt(argc, argv, "g:p:b:d:")) != -1) {
+		switch (c) {
+		case 'g':
+			nr_groups = atoi(optarg);
+			break;
+		case 'p':
+			nr_pairs = atoi(optarg);
+			break;
+		case 'b':
+			nr_busy = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || nr_groups < 1 || nr_pairs < 1 ||
+	    nr_busy < 0 || seconds < 1)
+		usage();
+	root = argv[optind];
+
+	counts = mmap(NULL, nr_pairs * sizeof(*counts),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pids = calloc(2 * nr_pairs + nr_busy, sizeof(*pids));
+	if (counts == MAP_FAILED || !pids) {
+		perror("alloc");
+		return 1;
+	}
+
+	create_groups();
+
+	for (i = 0; i < nr_pairs; i++) {
+		int ab[2], ba[2];
+
+		if (pipe(ab) || pipe(ba)) {
+			perror("pipe");
+			goto out;
+		}
+		/* both ends of a pair sit in the same group */
+		pids[nr_pids] = fork();
+		if (!pids[nr_pids])
+			pingpong(i % nr_groups, ba[0], ab[1], 1, &counts[i]);
+		nr_pids++;
+		pids[nr_pids] = fork();
+		if (!pids[nr_pids])
+			pingpong(i % nr_groups, ab[0], ba[1], 0, NULL);
+		nr_pids++;
+		close(ab[0]);
+		close(ab[1]);
+		close(ba[0]);
+		close(ba[1]);
+	}
+	for (i = 0; i < nr_busy; i++) {
+		pids[nr_pids] = fork();
+		if (!pids[nr_pids])
+			busy((nr_pairs + i) % nr_groups);
+		nr_pids++;
+	}
+
+	read_stat(&stat_total[0], &stat_sys[0]);
+	gettimeofday(&start, NULL);
+
+	for (c = 0; c < seconds; c++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr_pairs; i++)
+			total += counts[i];
+		printf("%3d s: %10llu round trips/s\n", c + 1, total - last);
+		fflush(stdout);
+		last = total;
+	}
+
+	for (total = 0, i = 0; i < nr_pairs; i++)
+		total += counts[i];
+	gettimeofday(&end, NULL);
+	read_stat(&stat_total[1], &stat_sys[1]);
+	elapsed = end.tv_sec - start.tv_sec +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("%d groups, %d pairs, %d busy: %.0f round trips/s, "
+	       "%.1f%% system time\n", nr_groups, nr_pairs, nr_busy,
+	       total / elapsed, 100.0 * (stat_sys[1] - stat_sys[0]) /
+	       (double)(stat_total[1] - stat_total[0] ? : 1));
+
+out:
+	for (i = 0; i < nr_pids; i++)
+		kill(pids[i], SIGKILL);
+	while (wait(NULL) > 0)
+		;
+	remove_groups();
+	return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * dirty-throughput: measure buffered write throughput to several disks
+ *
+ * One thread per directory keeps writing a file with buffered write()s,
+ * starting over from the beginning once the file reaches its size limit.
+ * With the directories on different disks this shows whether writeback
+ * keeps all of them busy at once: the writers are throttled in
+ * balance_dirty_pages() to the rate at which their disk gets cleaned, so
+ * a single writeback thread that serialises the disks shows up as an
+ * aggregate rate well below the sum of what the disks do individually.
+ *
+ * Every second the aggregate rate and the Dirty and Writeback counts from
+ * /proc/meminfo are printed.  At the end the files are fsync()ed and the
+ * per-directory rates are printed, both for the timed run alone and
+ * including the final fsync.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o dirty-throughput dirty-throughput.c -lpthread
+ *
+ * Usage: dirty-throughput [-b block KB] [-s file MB] [-t seconds] dir...
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static volatile int stop;
+static size_t block_size = 64 << 10;
+static off_t file_size = (off_t)1024 << 20;
+
+struct writer {
+	pthread_t thread;
+	const char *dir;
+	char path[4096];
+	int fd;
+	volatile unsigned long long bytes;
+};
+
+static double now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	off_t pos = 0;
+	char *buf;
+
+	buf = malloc(block_size);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, block_size);
+
+	while (!stop) {
+		if (pos >= file_size) {
+			if (lseek(w->fd, 0, SEEK_SET) < 0) {
+				perror("lseek");
+				exit(1);
+			}
+			pos = 0;
+		}
+		if (write(w->fd, buf, block_size) != (ssize_t)block_size) {
+			perror(w->path);
+			exit(1);
+		}
+		pos += block_size;
+		w->bytes += block_size;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void meminfo(unsigned long *dirty, unsigned long *writeback)
+{
+	char line[128];
+	FILE *f;
+
+	*dirty = *writeback = 0;
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "Dirty: %lu", dirty);
+		sscanf(line, "Writeback: %lu", writeback);
+	}
+	fclose(f);
+}
+
+static void usage(void)
+{
+	printf("dirty-throughput [-b block KB] [-s file MB] [-t seconds] "
+	       "dir...\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long long total, last = 0;
+	unsigned long dirty, writeback;
+	double start, timed, synced;
+	int seconds = 30, nr, i, c;
+	struct writer *w;
+
+	while ((c = getopt(argc, argv, "b:s:t:")) != -1) {
+		switch (c) {
+		case 'b':
+			block_size = (size_t)atoi(optarg) << 10;
+			break;
+		case 's':
+			file_size = (off_t)atoi(optarg) << 20;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	nr = argc - optind;
+	if (nr < 1 || !block_size || file_size < (off_t)block_size ||
+	    seconds < 1)
+		usage();
+
+	w = calloc(nr, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		w[i].dir = argv[optind + i];
+		snprintf(w[i].path, sizeof(w[i].path), "%s/dirty-throughput.%d",
+			 w[i].dir, (int)getpid());
+		w[i].fd = open(w[i].path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (w[i].fd < 0) {
+			perror(w[i].path);
+			return 1;
+		}
+	}
+
+	start = now();
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&w[i].thread, NULL, writer_thread, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (c = 0; c < seconds; c++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr; i++)
+			total += w[i].bytes;
+		meminfo(&dirty, &writeback);
+		printf("%3d s: %8.1f MB/s  dirty %8lu kB  writeback %8lu kB\n",
+		       c + 1, (total - last) / 1048576.0, dirty, writeback);
+		fflush(stdout);
+		last = total;
+	}
+	stop = 1;
+
+	for (i = 0; i < nr; i++)
+		pthread_join(w[i].thread, NULL);
+	timed = now() - start;
+
+	for (i = 0; i < nr; i++)
+		fsync(w[i].fd);
+	synced = now() - start;
+
+	printf("\n%-32s %12s %12s\n", "directory", "MB/s", "MB/s+fsync");
+	for (total = 0, i = 0; i < nr; i++) {
+		printf("%-32s %12.1f %12.1f\n", w[i].dir,
+		       w[i].bytes / 1048576.0 / timed,
+		       w[i].bytes / 1048576.0 / synced);
+		total += w[i].bytes;
+		close(w[i].fd);
+		unlink(w[i].path);
+	}
+	printf("%-32s %12.1f %12.1f\n", "total",
+	       total / 1048576.0 / timed, total / 1048576.0 / synced);
+
+	free(w);
+	return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * fault-stress: measure page fault scalability against concurrent mmap()
+ *
+ * A number of threads keep faulting in a private anonymous region of their
+ * own, dropping it with MADV_DONTNEED after every pass, while other threads
+ * in the same process mmap(), touch and munmap() small regions in a loop.
+ * Without speculative faults every fault queues behind the writers on
+ * mmap_sem; with them only faults racing with an actual VMA change do.
+ *
+ * The run prints faults per second for the faulting threads, mmap cycles
+ * per second for the mapping threads, and the pgfault_speculative counters
+ * from /proc/vmstat when the kernel provides them.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o fault-stress fault-stress.c -lpthread
+ *
+ * Usage: fault-stress [-f fault threads] [-m mmap threads]
+ *                     [-s region MB per thread] [-t seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define MMAP_SIZE	(64 * 1024)
+
+static volatile int stop;
+static long page_size;
+static size_t region_size = 64 << 20;
+
+struct worker {
+	pthread_t thread;
+	unsigned long count;
+};
+
+static void *fault_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *region;
+	size_t off;
+
+	region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!stop) {
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			region[off] = 1;
+			w->count++;
+		}
+		madvise(region, region_size, MADV_DONTNEED);
+	}
+
+	munmap(region, region_size);
+	return NULL;
+}
+
+static void *mmap_thread(void *arg)
+{
+	struct worker *w = arg;
+	char *p;
+
+	while (!stop) {
+		p = mmap(NULL, MMAP_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		p[0] = 1;
+		munmap(p, MMAP_SIZE);
+		w->count++;
+	}
+	return NULL;
+}
+
+static int read_vmstat(const char *name, unsigned long *val)
+{
+	char key[64];
+	unsigned long v;
+	FILE *f;
+	int found = 0;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			*val = v;
+			found = 1;
+			break;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static void usage(void)
+{
+	printf("fault-stress [-f fault threads] [-m mmap threads] "
+	       "[-s region MB per thread] [-t seconds]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr_fault = 4, nr_mmap = 1, seconds = 10;
+	unsigned long spec[2], retry[2];
+	unsigned long faults = 0, maps = 0;
+	int have_stats, i, c;
+	struct worker *w;
+
+	while ((c = getopt(argc, argv, "f:m:s:t:")) != -1) {
+		switch (c) {
+		case 'f':
+			nr_fault = atoi(optarg);
+			break;
+		case 'm':
+			nr_mmap = atoi(optarg);
+			break;
+		case 's':
+			region_size = (size_t)atoi(optarg) << 20;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nr_fault < 1 || nr_mmap < 0 || !region_size || seconds < 1)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	w = calloc(nr_fault + nr_mmap, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+
+	have_stats = read_vmstat("pgfault_speculative", &spec[0]) &&
+		     read_vmstat("pgfault_speculative_retry", &retry[0]);
+
+	for (i = 0; i < nr_fault + nr_mmap; i++) {
+		if (pthread_create(&w[i].thread, NULL,
+				   i < nr_fault ? fault_thread : mmap_thread,
+				   &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_fault + nr_mmap; i++) {
+		pthread_join(w[i].thread, NULL);
+		if (i < nr_fault)
+			faults += w[i].count;
+		else
+			maps += w[i].count;
+	}
+
+	printf("%d fault threads: %lu faults/s (%lu per thread)\n",
+	       nr_fault, faults / seconds, faults / seconds / nr_fault);
+	if (nr_mmap)
+		printf("%d mmap threads: %lu mmap/munmap cycles/s\n",
+		       nr_mmap, maps / seconds);
+
+	if (have_stats && read_vmstat("pgfault_speculative", &spec[1]) &&
+	    read_vmstat("pgfault_speculative_retry", &retry[1]))
+		printf("speculative faults: %lu handled, %lu retried\n",
+		       spec[1] - spec[0], retry[1] - retry[0]);
+
+	free(w);
+	return 0;
+}
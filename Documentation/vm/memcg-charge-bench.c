@@ -0,0 +1,224 @@
+/*
+ * memcg-charge-bench: measure the cost of memory cgroup charging
+ *
+ * One thread per cpu (or -n of them) charges and uncharges pages as fast
+ * as it can. In the default anonymous mode each thread mmap()s a private
+ * region, touches every page of it, which charges the page when it is
+ * faulted in, and munmap()s it again, which uncharges it. With -c each
+ * thread instead writes a file of its own in the current directory a page
+ * at a time and truncates it again, which goes through the page cache
+ * charge and the batched uncharge on truncation.
+ *
+ * With -g the process first moves itself into the given memory cgroup by
+ * writing its pid to the tasks file there, and the usage and failcnt of
+ * the group are printed at the end. Compare the page rate against a
+ * kernel booted with cgroup_disable=memory to get the overhead of the
+ * controller, and with more threads to see how well it scales.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o memcg-charge-bench memcg-charge-bench.c -lpthread
+ *
+ * Usage: memcg-charge-bench [-n threads] [-s region KB] [-c] [-t seconds]
+ *                           [-g memory cgroup directory]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+static volatile int stop;
+static long page_size;
+static size_t region_size = 1 << 20;
+static int cache_mode;
+
+struct worker {
+	pthread_t thread;
+	int id;
+	volatile unsigned long pages;
+};
+
+static void anon_loop(struct worker *w)
+{
+	char *p;
+	size_t off;
+
+	while (!stop) {
+		p = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		for (off = 0; off < region_size; off += page_size)
+			p[off] = 1;
+		munmap(p, region_size);
+		w->pages += region_size / page_size;
+	}
+}
+
+static void cache_loop(struct worker *w)
+{
+	char name[64], *buf;
+	size_t off;
+	int fd;
+
+	snprintf(name, sizeof(name), "memcg-charge-bench.%d.%d",
+		 getpid(), w->id);
+	fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror(name);
+		exit(1);
+	}
+	unlink(name);
+
+	buf = calloc(1, page_size);
+	if (!buf) {
+		perror("calloc");
+		exit(1);
+	}
+
+	while (!stop) {
+		for (off = 0; off < region_size; off += page_size) {
+			if (pwrite(fd, buf, page_size, off) != page_size) {
+				perror("pwrite");
+				exit(1);
+			}
+		}
+		if (ftruncate(fd, 0)) {
+			perror("ftruncate");
+			exit(1);
+		}
+		w->pages += region_size / page_size;
+	}
+	free(buf);
+	close(fd);
+}
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+
+	if (cache_mode)
+		cache_loop(w);
+	else
+		anon_loop(w);
+	return NULL;
+}
+
+static void join_cgroup(const char *dir)
+{
+	char path[4096];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/tasks", dir);
+	f = fopen(path, "w");
+	if (!f || fprintf(f, "%d\n", getpid()) < 0 || fclose(f)) {
+		perror(path);
+		exit(1);
+	}
+}
+
+static void show_cgroup(const char *dir, const char *file)
+{
+	char path[4096];
+	unsigned long long val;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, file);
+	f = fopen(path, "r");
+	if (!f)
+		return;
+	if (fscanf(f, "%llu", &val) == 1)
+		printf("%s: %llu\n", file, val);
+	fclose(f);
+}
+
+static void usage(void)
+{
+	printf("memcg-charge-bench [-n threads] [-s region KB] [-c] "
+	       "[-t seconds] [-g memory cgroup directory]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr = sysconf(_SC_NPROCESSORS_ONLN), seconds = 10, i, c;
+	unsigned long long total, last = 0;
+	const char *cgroup = NULL;
+	struct worker *w;
+
+	while ((c = getopt(argc, argv, "n:s:ct:g:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr = atoi(optarg);
+			break;
+		case 's':
+			region_size = (size_t)atoi(optarg) << 10;
+			break;
+		case 'c':
+			cache_mode = 1;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'g':
+			cgroup = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || nr < 1 || seconds < 1)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (region_size < page_size)
+		usage();
+
+	if (cgroup)
+		join_cgroup(cgroup);
+
+	w = calloc(nr, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+	for (i = 0; i < nr; i++) {
+		w[i].id = i;
+		if (pthread_create(&w[i].thread, NULL, worker_thread, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	for (c = 0; c < seconds; c++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr; i++)
+			total += w[i].pages;
+		printf("%3d s: %10llu pages charged/s\n", c + 1, total - last);
+		fflush(stdout);
+		last = total;
+	}
+	stop = 1;
+
+	for (total = 0, i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].pages;
+	}
+	printf("%d threads, %s: %llu pages charged/s, %llu per thread\n",
+	       nr, cache_mode ? "page cache" : "anonymous",
+	       total / seconds, total / seconds / nr);
+
+	if (cgroup) {
+		show_cgroup(cgroup, "memory.usage_in_bytes");
+		show_cgroup(cgroup, "memory.failcnt");
+	}
+
+	free(w);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * shared-write: measure buffered writes from many threads to one file
+ *
+ * A number of threads pwrite() blocks at random offsets of one file, the
+ * way database writers update a large datafile, while a flusher thread
+ * calls fdatasync() at a fixed interval so that pages keep going clean
+ * and have to be dirtied, tagged and written back again. Every newly
+ * dirtied page updates the dirty tag in the file's page cache radix tree,
+ * so this shows whether the writers serialise on the mapping's tree_lock.
+ *
+ * The file is filled once before the run so that the writers overwrite
+ * allocated blocks rather than measure the filesystem's block allocator.
+ * Every second the aggregate write rate is printed, then the totals.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o shared-write shared-write.c -lpthread
+ *
+ * Usage: shared-write [-t threads] [-s file MB] [-b block KB]
+ *                     [-f fdatasync interval ms] [-d seconds] file
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static volatile int stop;
+static int fd;
+static size_t block_size = 4 << 10;
+static off_t file_size = (off_t)1024 << 20;
+static int sync_ms = 100;
+
+struct writer {
+	pthread_t thread;
+	unsigned int seed;
+	volatile unsigned long long bytes;
+};
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	unsigned long long nr_blocks = file_size / block_size;
+	unsigned long long block;
+	char *buf;
+
+	buf = malloc(block_size);
+	if (!buf) {
+		perror("malloc");
+		exit(1);
+	}
+	memset(buf, 0x5a, block_size);
+
+	while (!stop) {
+		block = ((unsigned long long)rand_r(&w->seed) << 31 |
+			 rand_r(&w->seed)) % nr_blocks;
+		if (pwrite(fd, buf, block_size, block * block_size) !=
+		    (ssize_t)block_size) {
+			perror("pwrite");
+			exit(1);
+		}
+		w->bytes += block_size;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static volatile unsigned long nr_syncs;
+
+static void *flusher_thread(void *arg)
+{
+	while (!stop) {
+		usleep(sync_ms * 1000);
+		if (fdatasync(fd)) {
+			perror("fdatasync");
+			exit(1);
+		}
+		nr_syncs++;
+	}
+	return NULL;
+}
+
+static void prefill(void)
+{
+	size_t chunk = 1 << 20;
+	off_t pos;
+	char *buf;
+
+	buf = calloc(1, chunk);
+	if (!buf) {
+		perror("calloc");
+		exit(1);
+	}
+	for (pos = 0; pos < file_size; pos += chunk) {
+		if (pwrite(fd, buf, chunk, pos) != (ssize_t)chunk) {
+			perror("pwrite");
+			exit(1);
+		}
+	}
+	fsync(fd);
+	free(buf);
+}
+
+static void usage(void)
+{
+	printf("shared-write [-t threads] [-s file MB] [-b block KB] "
+	       "[-f fdatasync interval ms] [-d seconds] file\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr = 8, seconds = 10, i, c;
+	unsigned long long total, last = 0;
+	pthread_t flusher;
+	struct writer *w;
+	struct timeval start, end;
+	double elapsed;
+
+	while ((c = getopt(argc, argv, "t:s:b:f:d:")) != -1) {
+		switch (c) {
+		case 't':
+			nr = atoi(optarg);
+			break;
+		case 's':
+			file_size = (off_t)atoi(optarg) << 20;
+			break;
+		case 'b':
+			block_size = (size_t)atoi(optarg) << 10;
+			break;
+		case 'f':
+			sync_ms = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1 || nr < 1 || !block_size ||
+	    file_size < (off_t)block_size || sync_ms < 0 || seconds < 1)
+		usage();
+
+	fd = open(argv[optind], O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	prefill();
+
+	w = calloc(nr, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nr; i++) {
+		w[i].seed = i + 1;
+		if (pthread_create(&w[i].thread, NULL, writer_thread, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	if (sync_ms && pthread_create(&flusher, NULL, flusher_thread, NULL)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	for (c = 0; c < seconds; c++) {
+		sleep(1);
+		for (total = 0, i = 0; i < nr; i++)
+			total += w[i].bytes;
+		printf("%3d s: %8.1f MB/s\n", c + 1,
+		       (total - last) / 1048576.0);
+		fflush(stdout);
+		last = total;
+	}
+	stop = 1;
+
+	for (total = 0, i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].bytes;
+	}
+	if (sync_ms)
+		pthread_join(flusher, NULL);
+	gettimeofday(&end, NULL);
+	elapsed = end.tv_sec - start.tv_sec +
+		  (end.tv_usec - start.tv_usec) / 1e6;
+
+	printf("%d threads, %zu KB blocks: %.1f MB/s, %.0f writes/s, "
+	       "%lu fdatasyncs\n", nr, block_size >> 10,
+	       total / 1048576.0 / elapsed,
+	       total / block_size / elapsed, nr_syncs);
+
+	close(fd);
+	unlink(argv[optind]);
+	free(w);
+	return 0;
+}
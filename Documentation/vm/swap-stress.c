@@ -0,0 +1,154 @@
+/*
+ * swap-stress: measure swap out/in throughput with reclaim on many cpus
+ *
+ * A number of threads each keep writing to every page of a private
+ * anonymous region of their own.  Size the regions so that together they
+ * do not fit in memory (or run the program in a memory cgroup with a
+ * limit below their total): every pass then pushes the other threads'
+ * pages out to swap and faults its own back in, so all threads are in
+ * direct reclaim and swap slot allocation at the same time, and any
+ * global lock on the way shows up as per-thread rates dropping as
+ * threads are added.
+ *
+ * The run prints pages touched per second for each thread and for all of
+ * them, and the pswpin/pswpout deltas from /proc/vmstat, i.e. the pages
+ * actually swapped in and out per second.
+ *
+ * Compile by:
+ *
+ * gcc -O2 -o swap-stress swap-stress.c -lpthread
+ *
+ * Usage: swap-stress [-n threads] [-s region MB per thread] [-t seconds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+static volatile int stop;
+static long page_size;
+static size_t region_size = 256 << 20;
+
+struct worker {
+	pthread_t thread;
+	unsigned long pages;
+};
+
+static void *swap_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long pass = 0;
+	char *region;
+	size_t off;
+
+	region = mmap(NULL, region_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (region == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	while (!stop) {
+		pass++;
+		for (off = 0; off < region_size && !stop; off += page_size) {
+			region[off] = (char)pass;
+			w->pages++;
+		}
+	}
+
+	munmap(region, region_size);
+	return NULL;
+}
+
+static int read_vmstat(const char *name, unsigned long *val)
+{
+	char key[64];
+	unsigned long v;
+	FILE *f;
+	int found = 0;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+	while (fscanf(f, "%63s %lu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			*val = v;
+			found = 1;
+			break;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static void usage(void)
+{
+	printf("swap-stress [-n threads] [-s region MB per thread] "
+	       "[-t seconds]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int nr = 4, seconds = 30, have_stats, i, c;
+	unsigned long swpin[2], swpout[2];
+	unsigned long total = 0;
+	struct worker *w;
+
+	while ((c = getopt(argc, argv, "n:s:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr = atoi(optarg);
+			break;
+		case 's':
+			region_size = (size_t)atoi(optarg) << 20;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nr < 1 || !region_size || seconds < 1)
+		usage();
+
+	page_size = sysconf(_SC_PAGESIZE);
+	w = calloc(nr, sizeof(*w));
+	if (!w) {
+		perror("calloc");
+		return 1;
+	}
+
+	have_stats = read_vmstat("pswpin", &swpin[0]) &&
+		     read_vmstat("pswpout", &swpout[0]);
+
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&w[i].thread, NULL, swap_thread, &w[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(w[i].thread, NULL);
+		printf("thread %3d: %10lu pages/s\n", i, w[i].pages / seconds);
+		total += w[i].pages;
+	}
+	printf("%d threads: %lu pages/s\n", nr, total / seconds);
+
+	if (have_stats && read_vmstat("pswpin", &swpin[1]) &&
+	    read_vmstat("pswpout", &swpout[1]))
+		printf("swapped in %lu pages/s, out %lu pages/s\n",
+		       (swpin[1] - swpin[0]) / seconds,
+		       (swpout[1] - swpout[0]) / seconds);
+
+	free(w);
+	return 0;
+}
@@ -315,6 +315,14 @@ static inline int pte_present(pte_t a)
 	return pte_flags(a) & (_PAGE_PRESENT | _PAGE_PROTNONE);
 }
 
+/* A pte that is present only in software: PROT_NONE hides it from the MMU */
+#define __HAVE_ARCH_PTE_PROTNONE
+static inline int pte_protnone(pte_t a)
+{
+	return (pte_flags(a) & (_PAGE_PRESENT | _PAGE_PROTNONE)) ==
+		_PAGE_PROTNONE;
+}
+
 static inline int pmd_present(pmd_t pmd)
 {
 	return pmd_flags(pmd) & _PAGE_PRESENT;
@@ -0,0 +1,64 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+/*
+ * Queued spinlocks
+ *
+ * With ticket locks all waiters spin on the lock word, so every release
+ * of a contended lock bounces its cache line to each of them. Queued
+ * locks put the waiters into an MCS queue of per-cpu nodes instead; each
+ * waiter spins on the node it owns and only the head of the queue looks
+ * at the lock word. The lock is still a single 32 bit word:
+ *
+ *  bits  0- 7: locked byte, set while the lock is held
+ *  bits  8-15: unused
+ *  bits 16-17: node index of the queue tail (the context nesting level)
+ *  bits 18-31: cpu number + 1 of the queue tail, 0 if nobody is queued
+ *
+ * The uncontended lock is a cmpxchg of the whole word from 0 and the
+ * unlock a store to the locked byte; the queueing is done out of line
+ * in arch/x86/kernel/qspinlock.c.
+ */
+
+#define _Q_LOCKED_VAL		1U
+#define _Q_LOCKED_MASK		0x000000ffU
+#define _Q_TAIL_MASK		0xffff0000U
+#define _Q_TAIL_IDX_OFFSET	16
+#define _Q_TAIL_IDX_MASK	0x3U
+#define _Q_TAIL_CPU_OFFSET	18
+
+extern void queue_spin_lock_slowpath(raw_spinlock_t *lock);
+
+static inline int __queue_spin_is_locked(raw_spinlock_t *lock)
+{
+	return ACCESS_ONCE(lock->slock) != 0;
+}
+
+static inline int __queue_spin_is_contended(raw_spinlock_t *lock)
+{
+	return (ACCESS_ONCE(lock->slock) & _Q_TAIL_MASK) != 0;
+}
+
+static __always_inline int __queue_spin_trylock(raw_spinlock_t *lock)
+{
+	return !ACCESS_ONCE(lock->slock) &&
+	       cmpxchg(&lock->slock, 0, _Q_LOCKED_VAL) == 0;
+}
+
+static __always_inline void __queue_spin_lock(raw_spinlock_t *lock)
+{
+	if (likely(cmpxchg(&lock->slock, 0, _Q_LOCKED_VAL) == 0))
+		return;
+	queue_spin_lock_slowpath(lock);
+}
+
+static __always_inline void __queue_spin_unlock(raw_spinlock_t *lock)
+{
+	/* only the locked byte is written, waiters may change the tail */
+	asm volatile(UNLOCK_LOCK_PREFIX "andb $0, %0"
+		     : "+m" (*(u8 *)&lock->slock)
+		     :
+		     : "memory", "cc");
+}
+
+#endif /* _ASM_X86_QSPINLOCK_H */
@@ -71,6 +71,9 @@ struct rw_semaphore {
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map dep_map;
 #endif
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	struct thread_info	*owner;		/* writer, for spinning */
+#endif
 };
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -172,32 +172,48 @@ static inline int __ticket_spin_is_contended(raw_spinlock_t *lock)
 	return (((tmp >> TICKET_SHIFT) - tmp) & ((1 << TICKET_SHIFT) - 1)) > 1;
 }
 
+#ifdef CONFIG_X86_QUEUED_SPINLOCKS
+#include <asm/qspinlock.h>
+
+#define __native_spin_is_locked		__queue_spin_is_locked
+#define __native_spin_is_contended	__queue_spin_is_contended
+#define __native_spin_lock		__queue_spin_lock
+#define __native_spin_trylock		__queue_spin_trylock
+#define __native_spin_unlock		__queue_spin_unlock
+#else
+#define __native_spin_is_locked		__ticket_spin_is_locked
+#define __native_spin_is_contended	__ticket_spin_is_contended
+#define __native_spin_lock		__ticket_spin_lock
+#define __native_spin_trylock		__ticket_spin_trylock
+#define __native_spin_unlock		__ticket_spin_unlock
+#endif
+
 #ifndef CONFIG_PARAVIRT
 
 static inline int __raw_spin_is_locked(raw_spinlock_t *lock)
 {
-	return __ticket_spin_is_locked(lock);
+	return __native_spin_is_locked(lock);
 }
 
 static inline int __raw_spin_is_contended(raw_spinlock_t *lock)
 {
-	return __ticket_spin_is_contended(lock);
+	return __native_spin_is_contended(lock);
 }
 #define __raw_spin_is_contended	__raw_spin_is_contended
 
 static __always_inline void __raw_spin_lock(raw_spinlock_t *lock)
 {
-	__ticket_spin_lock(lock);
+	__native_spin_lock(lock);
 }
 
 static __always_inline int __raw_spin_trylock(raw_spinlock_t *lock)
 {
-	return __ticket_spin_trylock(lock);
+	return __native_spin_trylock(lock);
 }
 
 static __always_inline void __raw_spin_unlock(raw_spinlock_t *lock)
 {
-	__ticket_spin_unlock(lock);
+	__native_spin_unlock(lock);
 }
 
 static __always_inline void __raw_spin_lock_flags(raw_spinlock_t *lock,
@@ -78,6 +78,8 @@ static inline void __flush_tlb_one(unsigned long addr)
  *  - flush_tlb_range(vma, start, end) flushes a range of pages
  *  - flush_tlb_kernel_range(start, end) flushes a range of kernel pages
  *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus
+ *  - flush_tlb_batched(cpumask) flushes TLBs on cpus in cpumask, whatever
+ *    mm they run (flush_tlb_others() with a NULL mm does the same)
  *
  * ..but the i386 has somewhat limited tlb flushing capabilities,
  * and page-granular flushes are available only on i486 and up.
@@ -119,6 +121,11 @@ static inline void native_flush_tlb_others(const struct cpumask *cpumask,
 {
 }
 
+static inline void flush_tlb_batched(const struct cpumask *cpumask)
+{
+	__flush_tlb();
+}
+
 static inline void reset_lazy_tlbstate(void)
 {
 }
@@ -133,6 +140,7 @@ extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
+extern void flush_tlb_batched(const struct cpumask *);
 
 #define flush_tlb()	flush_tlb_current_task()
 
@@ -0,0 +1,115 @@
+/*
+ * Queued spinlock slowpath
+ *
+ * A cpu that finds the lock taken appends a node of its own to the queue
+ * of waiters by swapping it into the tail of the lock word, links it to
+ * the previous tail and spins on its own node until that waiter hands the
+ * head of the queue on. The head then waits for the locked byte to clear
+ * and takes the lock; it clears the tail as well if nobody queued behind
+ * it, otherwise it passes the head on to the next node. So at any time
+ * one cpu at most spins on the lock word, the others each spin on a
+ * cache line of their own.
+ *
+ * Every cpu has one node per context it can be spinning in (task,
+ * softirq, hardirq and nmi), see the lock word layout in
+ * <asm/qspinlock.h>. Callers run with preemption disabled.
+ */
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/module.h>
+
+#define MAX_NODES	4
+
+struct qnode {
+	struct qnode *next;
+	int locked;		/* set when we become the head of the queue */
+	int count;		/* nesting level, used in the first node only */
+};
+
+struct qnodes {
+	struct qnode node[MAX_NODES];
+};
+
+static DEFINE_PER_CPU_SHARED_ALIGNED(struct qnodes, qnodes);
+
+static inline u32 encode_tail(int cpu, int idx)
+{
+	return ((cpu + 1) << _Q_TAIL_CPU_OFFSET) | (idx << _Q_TAIL_IDX_OFFSET);
+}
+
+static inline struct qnode *decode_tail(u32 tail)
+{
+	int cpu = (tail >> _Q_TAIL_CPU_OFFSET) - 1;
+	int idx = (tail >> _Q_TAIL_IDX_OFFSET) & _Q_TAIL_IDX_MASK;
+
+	return &per_cpu(qnodes, cpu).node[idx];
+}
+
+void queue_spin_lock_slowpath(raw_spinlock_t *lock)
+{
+	struct qnode *node, *prev, *next;
+	u32 tail, val, old;
+	int idx;
+
+	node = __raw_get_cpu_var(qnodes).node;
+	idx = node->count++;
+	if (unlikely(idx >= MAX_NODES)) {
+		/* nested deeper than we have nodes for, spin on the word */
+		while (!__queue_spin_trylock(lock))
+			cpu_relax();
+		goto release;
+	}
+	tail = encode_tail(raw_smp_processor_id(), idx);
+	node += idx;
+	node->next = NULL;
+	node->locked = 0;
+
+	/*
+	 * Make our node the tail of the queue. The locked byte is kept as
+	 * it is, and a lock that went free meanwhile is taken below.
+	 */
+	val = ACCESS_ONCE(lock->slock);
+	for (;;) {
+		old = cmpxchg(&lock->slock, val, (val & ~_Q_TAIL_MASK) | tail);
+		if (old == val)
+			break;
+		val = old;
+	}
+
+	if (old & _Q_TAIL_MASK) {
+		prev = decode_tail(old);
+		ACCESS_ONCE(prev->next) = node;
+
+		while (!ACCESS_ONCE(node->locked))
+			cpu_relax();
+	}
+
+	/* we are the head of the queue, wait for the owner to go away */
+	while ((val = ACCESS_ONCE(lock->slock)) & _Q_LOCKED_MASK)
+		cpu_relax();
+
+	/*
+	 * Take the lock. If we still are the tail, the queue becomes empty
+	 * and the tail is cleared in the same step. Otherwise setting the
+	 * locked byte is enough: nobody else takes a lock with a queue.
+	 */
+	for (;;) {
+		if ((val & _Q_TAIL_MASK) != tail) {
+			ACCESS_ONCE(*(u8 *)&lock->slock) = _Q_LOCKED_VAL;
+			break;
+		}
+		old = cmpxchg(&lock->slock, val, _Q_LOCKED_VAL);
+		if (old == val)
+			goto release;
+		val = old;
+	}
+
+	/* hand the head of the queue to the next waiter */
+	while (!(next = ACCESS_ONCE(node->next)))
+		cpu_relax();
+	ACCESS_ONCE(next->locked) = 1;
+
+release:
+	__raw_get_cpu_var(qnodes).node[0].count--;
+}
+EXPORT_SYMBOL(queue_spin_lock_slowpath);
@@ -1053,6 +1053,20 @@ do_page_fault(struct pt_regs *regs, unsigned long error_code)
 		return;
 	}
 
+	/*
+	 * Not-present user faults on anonymous memory can usually be
+	 * handled without mmap_sem, see handle_speculative_fault():
+	 */
+	if ((error_code & (PF_USER | PF_PROT)) == PF_USER) {
+		fault = handle_speculative_fault(mm, address,
+						 error_code & PF_WRITE);
+		if (!(fault & VM_FAULT_RETRY)) {
+			tsk->min_flt++;
+			check_v8086_mode(regs, address, tsk);
+			return;
+		}
+	}
+
 	/*
 	 * When running in the kernel we expect faults to occur only to
 	 * addresses in user space.  All other faults represent errors in
@@ -147,7 +147,9 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		 * BUG();
 		 */
 
-	if (f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
+	/* A NULL flush_mm asks for a flush whatever mm this cpu runs */
+	if (!f->flush_mm ||
+	    f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
 		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK) {
 			if (f->flush_va == TLB_FLUSH_ALL)
 				local_flush_tlb();
@@ -204,7 +206,7 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 void native_flush_tlb_others(const struct cpumask *cpumask,
 			     struct mm_struct *mm, unsigned long va)
 {
-	if (is_uv_system()) {
+	if (is_uv_system() && mm) {
 		unsigned int cpu;
 
 		cpu = get_cpu();
@@ -275,6 +277,27 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+/*
+ * Flush the TLBs of the cpus in @mask, whatever mm each of them is
+ * running: used to flush after try_to_unmap() has cleared ptes of many
+ * mms with TTU_BATCH_FLUSH, in one IPI round instead of one per page.
+ */
+void flush_tlb_batched(const struct cpumask *mask)
+{
+	int cpu = get_cpu();
+
+	if (cpumask_test_cpu(cpu, mask)) {
+		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK)
+			local_flush_tlb();
+		else
+			leave_mm(cpu);
+	}
+	if (cpumask_any_but(mask, cpu) < nr_cpu_ids)
+		flush_tlb_others(mask, NULL, TLB_FLUSH_ALL);
+
+	put_cpu();
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	unsigned long cpu = smp_processor_id();
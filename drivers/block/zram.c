@@ -0,0 +1,731 @@
+/*
+ * Compressed RAM backed block device driver.
+ *
+ * Derived from drivers/block/brd.c.  Each PAGE_SIZE block of the device is
+ * compressed with LZO and stored in one of a set of slab caches sized in
+ * steps of PAGE_SIZE/32, indexed by block number.  Blocks that are all
+ * zeroes take no memory at all, and blocks that do not compress well are
+ * stored as they are, in a page of their own.
+ *
+ * This makes a RAM disk that holds two to three times its memory footprint
+ * for typical data, which is useful as a swap device or for /tmp on hosts
+ * short on memory.  See Documentation/blockdev/zram.txt.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/genhd.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/swap.h>
+#include <linux/lzo.h>
+#include <linux/buffer_head.h> /* invalidate_bh_lrus() */
+
+#define SECTOR_SHIFT		9
+#define PAGE_SECTORS_SHIFT	(PAGE_SHIFT - SECTOR_SHIFT)
+#define PAGE_SECTORS		(1 << PAGE_SECTORS_SHIFT)
+
+/*
+ * Compressed blocks are stored in objects of ZRAM_NR_CLASSES sizes, in
+ * steps of ZRAM_CLASS_STEP.  Blocks that compress to more than that are
+ * stored uncompressed.
+ */
+#define ZRAM_CLASS_STEP		(PAGE_SIZE / 32)
+#define ZRAM_NR_CLASSES		24
+#define ZRAM_MAX_LENGTH		(ZRAM_NR_CLASSES * ZRAM_CLASS_STEP)
+
+/* zram_page flags */
+#define ZRAM_ZERO		0x01	/* all zeroes, nothing stored */
+#define ZRAM_UNCOMPRESSED	0x02	/* ->data is a struct page */
+
+struct zram_page {
+	void		*data;
+	unsigned short	length;		/* compressed length */
+	unsigned char	class;		/* index into zram_caches[] */
+	unsigned char	flags;
+};
+
+struct zram_stats {
+	atomic_long_t	pages_stored;	/* blocks holding data */
+	atomic_long_t	compr_size;	/* bytes of compressed data */
+	atomic_long_t	mem_used;	/* bytes of memory they take */
+	atomic_long_t	zero_pages;
+	atomic_long_t	uncompressed_pages;
+	atomic_long_t	num_reads;
+	atomic_long_t	num_writes;
+	atomic_long_t	discards;
+	atomic_long_t	failed_writes;
+};
+
+struct zram_device {
+	int		zram_number;
+	unsigned long	nr_pages;
+
+	struct request_queue	*zram_queue;
+	struct gendisk		*zram_disk;
+	struct list_head	zram_list;
+
+	/*
+	 * The table of blocks is the contents of the device.  Entries are
+	 * replaced under the write lock; readers hold the read lock while
+	 * decompressing, so the data cannot be freed under them.
+	 */
+	rwlock_t		zram_lock;
+	struct zram_page	*zram_table;
+
+	/* Serialises read-modify-write of partial blocks */
+	struct mutex		zram_rmw_lock;
+
+	struct zram_stats	stats;
+};
+
+static struct kmem_cache *zram_caches[ZRAM_NR_CLASSES];
+static char zram_cache_names[ZRAM_NR_CLASSES][16];
+
+/* Per-cpu LZO work memory and compression buffer */
+struct zram_pcpu {
+	void		*workmem;
+	unsigned char	*buf;
+};
+
+static DEFINE_PER_CPU(struct zram_pcpu, zram_pcpu);
+
+static int zram_major;
+
+static inline unsigned int zram_class_size(unsigned int class)
+{
+	return (class + 1) * ZRAM_CLASS_STEP;
+}
+
+static int page_zero_filled(void *ptr)
+{
+	unsigned long *p = ptr;
+	unsigned int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(*p); i++) {
+		if (p[i])
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Release the memory of an entry taken out of the table.  Its stats have
+ * already been accounted by zram_replace().
+ */
+static void zram_free_data(struct zram_page *zp)
+{
+	if (zp->flags & ZRAM_UNCOMPRESSED)
+		__free_page(zp->data);
+	else if (zp->data)
+		kmem_cache_free(zram_caches[zp->class], zp->data);
+}
+
+static void zram_stat_update(struct zram_device *zram, struct zram_page *zp,
+			     int sign)
+{
+	struct zram_stats *stats = &zram->stats;
+
+	if (zp->flags & ZRAM_ZERO) {
+		atomic_long_add(sign, &stats->zero_pages);
+		return;
+	}
+	if (!zp->data)
+		return;
+	atomic_long_add(sign, &stats->pages_stored);
+	if (zp->flags & ZRAM_UNCOMPRESSED) {
+		atomic_long_add(sign, &stats->uncompressed_pages);
+		atomic_long_add(sign * (long)PAGE_SIZE, &stats->compr_size);
+		atomic_long_add(sign * (long)PAGE_SIZE, &stats->mem_used);
+	} else {
+		atomic_long_add(sign * (long)zp->length, &stats->compr_size);
+		atomic_long_add(sign * (long)zram_class_size(zp->class),
+				&stats->mem_used);
+	}
+}
+
+/*
+ * Install new as the contents of block index, and free what was there.
+ */
+static void zram_replace(struct zram_device *zram, unsigned long index,
+			 struct zram_page *new)
+{
+	struct zram_page old;
+
+	write_lock(&zram->zram_lock);
+	old = zram->zram_table[index];
+	zram->zram_table[index] = *new;
+	zram_stat_update(zram, &old, -1);
+	zram_stat_update(zram, new, 1);
+	write_unlock(&zram->zram_lock);
+
+	zram_free_data(&old);
+}
+
+/*
+ * Free all stored blocks. This must only be called when there are no other
+ * users of the device.
+ */
+static void zram_free_pages(struct zram_device *zram)
+{
+	struct zram_page empty = { .data = NULL };
+	unsigned long index;
+
+	for (index = 0; index < zram->nr_pages; index++) {
+		zram_replace(zram, index, &empty);
+		cond_resched();
+	}
+}
+
+/*
+ * Decompress block index into dst. Does not sleep.
+ */
+static int zram_read_page(struct zram_device *zram, unsigned long index,
+			  void *dst)
+{
+	struct zram_page *zp;
+	size_t len = PAGE_SIZE;
+	void *src;
+	int ret = 0;
+
+	read_lock(&zram->zram_lock);
+	zp = &zram->zram_table[index];
+	if (!zp->data) {
+		/* Never written, or all zeroes */
+		memset(dst, 0, PAGE_SIZE);
+	} else if (zp->flags & ZRAM_UNCOMPRESSED) {
+		src = kmap_atomic(zp->data, KM_USER1);
+		memcpy(dst, src, PAGE_SIZE);
+		kunmap_atomic(src, KM_USER1);
+	} else {
+		ret = lzo1x_decompress_safe(zp->data, zp->length, dst, &len);
+		if (ret != LZO_E_OK || len != PAGE_SIZE) {
+			printk(KERN_ERR "zram%d: decompression failed for "
+			       "block %lu\n", zram->zram_number, index);
+			ret = -EIO;
+		}
+	}
+	read_unlock(&zram->zram_lock);
+
+	return ret;
+}
+
+/*
+ * Compress a page worth of data into block index.  The data is in buf if
+ * that is not NULL, else it is the whole of page.  May sleep.
+ */
+static int zram_write_page(struct zram_device *zram, unsigned long index,
+			   struct page *page, void *buf)
+{
+	struct zram_page new = { .data = NULL };
+	struct zram_pcpu *pcpu;
+	unsigned int class;
+	void *obj = NULL;
+	int obj_class = -1;
+	struct page *store;
+	size_t len;
+	void *src, *dst;
+	int ret;
+
+	/*
+	 * Compress into the per-cpu buffer, then copy into an object of the
+	 * right size.  If that cannot be allocated without sleeping, do so
+	 * outside the per-cpu section and compress again: the data may
+	 * have changed meanwhile, hence the loop.
+	 */
+	for (;;) {
+		pcpu = &get_cpu_var(zram_pcpu);
+		src = buf ? buf : kmap_atomic(page, KM_USER0);
+		if (page_zero_filled(src)) {
+			if (!buf)
+				kunmap_atomic(src, KM_USER0);
+			put_cpu_var(zram_pcpu);
+			if (obj)
+				kmem_cache_free(zram_caches[obj_class], obj);
+			new.flags = ZRAM_ZERO;
+			goto install;
+		}
+		ret = lzo1x_1_compress(src, PAGE_SIZE, pcpu->buf, &len,
+				       pcpu->workmem);
+		if (!buf)
+			kunmap_atomic(src, KM_USER0);
+		if (unlikely(ret != LZO_E_OK)) {
+			put_cpu_var(zram_pcpu);
+			ret = -EIO;
+			goto out_free;
+		}
+		if (len > ZRAM_MAX_LENGTH) {
+			put_cpu_var(zram_pcpu);
+			goto uncompressed;
+		}
+
+		class = (len - 1) / ZRAM_CLASS_STEP;
+		if (obj && obj_class != class) {
+			kmem_cache_free(zram_caches[obj_class], obj);
+			obj = NULL;
+		}
+		if (!obj) {
+			obj = kmem_cache_alloc(zram_caches[class],
+					       GFP_NOWAIT | __GFP_NOWARN);
+			obj_class = class;
+		}
+		if (obj)
+			break;
+		put_cpu_var(zram_pcpu);
+
+		obj = kmem_cache_alloc(zram_caches[class], GFP_NOIO);
+		if (!obj) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+	memcpy(obj, pcpu->buf, len);
+	put_cpu_var(zram_pcpu);
+
+	new.data = obj;
+	new.length = len;
+	new.class = obj_class;
+	goto install;
+
+uncompressed:
+	if (obj)
+		kmem_cache_free(zram_caches[obj_class], obj);
+	store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+	if (!store) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	dst = kmap_atomic(store, KM_USER1);
+	src = buf ? buf : kmap_atomic(page, KM_USER0);
+	memcpy(dst, src, PAGE_SIZE);
+	if (!buf)
+		kunmap_atomic(src, KM_USER0);
+	kunmap_atomic(dst, KM_USER1);
+	new.data = store;
+	new.flags = ZRAM_UNCOMPRESSED;
+
+install:
+	zram_replace(zram, index, &new);
+	return 0;
+
+out_free:
+	if (obj)
+		kmem_cache_free(zram_caches[obj_class], obj);
+out:
+	atomic_long_inc(&zram->stats.failed_writes);
+	return ret;
+}
+
+/*
+ * Process len bytes of a bvec, all within block index, starting off bytes
+ * into the block.
+ */
+static int zram_do_bvec(struct zram_device *zram, struct page *page,
+			unsigned int len, unsigned int off, int rw,
+			unsigned long index, unsigned int offset)
+{
+	void *mem, *buf;
+	int err;
+
+	if (len == PAGE_SIZE) {
+		/* Whole, page aligned block: no bounce buffer needed */
+		if (rw != READ) {
+			flush_dcache_page(page);
+			return zram_write_page(zram, index, page, NULL);
+		}
+		mem = kmap_atomic(page, KM_USER0);
+		err = zram_read_page(zram, index, mem);
+		kunmap_atomic(mem, KM_USER0);
+		flush_dcache_page(page);
+		return err;
+	}
+
+	buf = kmalloc(PAGE_SIZE, GFP_NOIO);
+	if (!buf)
+		return -ENOMEM;
+
+	if (rw != READ)
+		mutex_lock(&zram->zram_rmw_lock);
+	err = zram_read_page(zram, index, buf);
+	if (err)
+		goto out;
+
+	mem = kmap_atomic(page, KM_USER0);
+	if (rw == READ) {
+		memcpy(mem + off, buf + offset, len);
+		flush_dcache_page(page);
+	} else {
+		flush_dcache_page(page);
+		memcpy(buf + offset, mem + off, len);
+	}
+	kunmap_atomic(mem, KM_USER0);
+
+	if (rw != READ)
+		err = zram_write_page(zram, index, NULL, buf);
+out:
+	if (rw != READ)
+		mutex_unlock(&zram->zram_rmw_lock);
+	kfree(buf);
+	return err;
+}
+
+/*
+ * Free the blocks entirely covered by a discard.
+ */
+static void zram_discard(struct zram_device *zram, sector_t sector,
+			 unsigned int size)
+{
+	struct zram_page empty = { .data = NULL };
+	unsigned long index, end;
+
+	index = (sector + PAGE_SECTORS - 1) >> PAGE_SECTORS_SHIFT;
+	end = (sector + (size >> SECTOR_SHIFT)) >> PAGE_SECTORS_SHIFT;
+	for (; index < end; index++) {
+		zram_replace(zram, index, &empty);
+		atomic_long_inc(&zram->stats.discards);
+	}
+}
+
+static int zram_make_request(struct request_queue *q, struct bio *bio)
+{
+	struct block_device *bdev = bio->bi_bdev;
+	struct zram_device *zram = bdev->bd_disk->private_data;
+	int rw;
+	struct bio_vec *bvec;
+	sector_t sector;
+	unsigned long index;
+	unsigned int offset;
+	int i;
+	int err = -EIO;
+
+	sector = bio->bi_sector;
+	if (sector + (bio->bi_size >> SECTOR_SHIFT) >
+						get_capacity(bdev->bd_disk))
+		goto out;
+
+	if (unlikely(bio_discard(bio))) {
+		zram_discard(zram, sector, bio->bi_size);
+		err = 0;
+		goto out;
+	}
+
+	rw = bio_rw(bio);
+	if (rw == READA)
+		rw = READ;
+	if (rw == READ)
+		atomic_long_inc(&zram->stats.num_reads);
+	else
+		atomic_long_inc(&zram->stats.num_writes);
+
+	err = 0;
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int len = bvec->bv_len;
+		unsigned int off = bvec->bv_offset;
+
+		while (len) {
+			unsigned int copy;
+
+			index = sector >> PAGE_SECTORS_SHIFT;
+			offset = (sector & (PAGE_SECTORS-1)) << SECTOR_SHIFT;
+			copy = min_t(unsigned int, len, PAGE_SIZE - offset);
+			err = zram_do_bvec(zram, bvec->bv_page, copy, off, rw,
+					   index, offset);
+			if (err)
+				goto out;
+			sector += copy >> SECTOR_SHIFT;
+			off += copy;
+			len -= copy;
+		}
+	}
+
+out:
+	bio_endio(bio, err);
+
+	return 0;
+}
+
+/*
+ * Discard bios are handled in zram_make_request(); this only advertises
+ * discard support to the block layer and is never called.
+ */
+static int zram_prepare_discard(struct request_queue *q, struct request *rq)
+{
+	return 0;
+}
+
+static int zram_ioctl(struct block_device *bdev, fmode_t mode,
+			unsigned int cmd, unsigned long arg)
+{
+	int error;
+	struct zram_device *zram = bdev->bd_disk->private_data;
+
+	if (cmd != BLKFLSBUF)
+		return -ENOTTY;
+
+	/*
+	 * As for brd, BLKFLSBUF releases all the data of the device.
+	 */
+	mutex_lock(&bdev->bd_mutex);
+	error = -EBUSY;
+	if (bdev->bd_openers <= 1) {
+		invalidate_bh_lrus();
+		truncate_inode_pages(bdev->bd_inode->i_mapping, 0);
+		zram_free_pages(zram);
+		error = 0;
+	}
+	mutex_unlock(&bdev->bd_mutex);
+
+	return error;
+}
+
+static struct block_device_operations zram_fops = {
+	.owner =		THIS_MODULE,
+	.locked_ioctl =		zram_ioctl,
+};
+
+/*
+ * Statistics, in /sys/block/zram<N>/
+ */
+static inline struct zram_device *dev_to_zram(struct device *dev)
+{
+	return dev_to_disk(dev)->private_data;
+}
+
+#define ZRAM_STAT_ATTR(_name, _stat, _shift)				\
+static ssize_t _name##_show(struct device *dev,				\
+			    struct device_attribute *attr, char *buf)	\
+{									\
+	struct zram_device *zram = dev_to_zram(dev);			\
+	unsigned long val = atomic_long_read(&zram->stats._stat);	\
+									\
+	return sprintf(buf, "%llu\n", (unsigned long long)val << _shift);\
+}									\
+static DEVICE_ATTR(_name, S_IRUGO, _name##_show, NULL)
+
+ZRAM_STAT_ATTR(orig_data_size, pages_stored, PAGE_SHIFT);
+ZRAM_STAT_ATTR(compr_data_size, compr_size, 0);
+ZRAM_STAT_ATTR(mem_used_total, mem_used, 0);
+ZRAM_STAT_ATTR(zero_pages, zero_pages, 0);
+ZRAM_STAT_ATTR(uncompressed_pages, uncompressed_pages, 0);
+ZRAM_STAT_ATTR(num_reads, num_reads, 0);
+ZRAM_STAT_ATTR(num_writes, num_writes, 0);
+ZRAM_STAT_ATTR(discards, discards, 0);
+ZRAM_STAT_ATTR(failed_writes, failed_writes, 0);
+
+static struct attribute *zram_attrs[] = {
+	&dev_attr_orig_data_size.attr,
+	&dev_attr_compr_data_size.attr,
+	&dev_attr_mem_used_total.attr,
+	&dev_attr_zero_pages.attr,
+	&dev_attr_uncompressed_pages.attr,
+	&dev_attr_num_reads.attr,
+	&dev_attr_num_writes.attr,
+	&dev_attr_discards.attr,
+	&dev_attr_failed_writes.attr,
+	NULL,
+};
+
+static struct attribute_group zram_attr_group = {
+	.attrs = zram_attrs,
+};
+
+/*
+ * And now the modules code and kernel interface.
+ */
+static int zram_nr = 1;
+static unsigned long zram_size;
+module_param(zram_nr, int, 0);
+MODULE_PARM_DESC(zram_nr, "Number of zram devices");
+module_param(zram_size, ulong, 0);
+MODULE_PARM_DESC(zram_size,
+		 "Size of each zram device in kbytes (default: 1/4 of RAM)");
+MODULE_LICENSE("GPL");
+
+static LIST_HEAD(zram_devices);
+
+static struct zram_device *zram_alloc(int i)
+{
+	struct zram_device *zram;
+	struct gendisk *disk;
+
+	zram = kzalloc(sizeof(*zram), GFP_KERNEL);
+	if (!zram)
+		goto out;
+	zram->zram_number	= i;
+	rwlock_init(&zram->zram_lock);
+	mutex_init(&zram->zram_rmw_lock);
+
+	zram->nr_pages = (zram_size << 10) >> PAGE_SHIFT;
+	zram->zram_table = vmalloc(zram->nr_pages * sizeof(struct zram_page));
+	if (!zram->zram_table)
+		goto out_free_dev;
+	memset(zram->zram_table, 0, zram->nr_pages * sizeof(struct zram_page));
+
+	zram->zram_queue = blk_alloc_queue(GFP_KERNEL);
+	if (!zram->zram_queue)
+		goto out_free_table;
+	blk_queue_make_request(zram->zram_queue, zram_make_request);
+	blk_queue_ordered(zram->zram_queue, QUEUE_ORDERED_TAG, NULL);
+	blk_queue_max_sectors(zram->zram_queue, 1024);
+	blk_queue_bounce_limit(zram->zram_queue, BLK_BOUNCE_ANY);
+	blk_queue_set_discard(zram->zram_queue, zram_prepare_discard);
+	/* Partial blocks need a read-modify-write: avoid them if we can */
+	if (PAGE_SIZE <= 4096)
+		blk_queue_hardsect_size(zram->zram_queue, PAGE_SIZE);
+
+	disk = zram->zram_disk = alloc_disk(1);
+	if (!disk)
+		goto out_free_queue;
+	disk->major		= zram_major;
+	disk->first_minor	= i;
+	disk->fops		= &zram_fops;
+	disk->private_data	= zram;
+	disk->queue		= zram->zram_queue;
+	sprintf(disk->disk_name, "zram%d", i);
+	set_capacity(disk, zram->nr_pages << PAGE_SECTORS_SHIFT);
+
+	return zram;
+
+out_free_queue:
+	blk_cleanup_queue(zram->zram_queue);
+out_free_table:
+	vfree(zram->zram_table);
+out_free_dev:
+	kfree(zram);
+out:
+	return NULL;
+}
+
+static void zram_free(struct zram_device *zram)
+{
+	put_disk(zram->zram_disk);
+	blk_cleanup_queue(zram->zram_queue);
+	zram_free_pages(zram);
+	vfree(zram->zram_table);
+	kfree(zram);
+}
+
+static void zram_del_one(struct zram_device *zram)
+{
+	sysfs_remove_group(&disk_to_dev(zram->zram_disk)->kobj,
+			   &zram_attr_group);
+	list_del(&zram->zram_list);
+	del_gendisk(zram->zram_disk);
+	zram_free(zram);
+}
+
+static void zram_free_buffers(void)
+{
+	struct zram_pcpu *pcpu;
+	int i, cpu;
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(zram_pcpu, cpu);
+		kfree(pcpu->workmem);
+		kfree(pcpu->buf);
+		pcpu->workmem = pcpu->buf = NULL;
+	}
+	for (i = 0; i < ZRAM_NR_CLASSES; i++) {
+		if (zram_caches[i])
+			kmem_cache_destroy(zram_caches[i]);
+		zram_caches[i] = NULL;
+	}
+}
+
+static int __init zram_alloc_buffers(void)
+{
+	struct zram_pcpu *pcpu;
+	int i, cpu;
+
+	for (i = 0; i < ZRAM_NR_CLASSES; i++) {
+		snprintf(zram_cache_names[i], sizeof(zram_cache_names[i]),
+			 "zram-%u", zram_class_size(i));
+		zram_caches[i] = kmem_cache_create(zram_cache_names[i],
+					zram_class_size(i), 0, 0, NULL);
+		if (!zram_caches[i])
+			return -ENOMEM;
+	}
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(zram_pcpu, cpu);
+		pcpu->workmem = kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+		pcpu->buf = kmalloc(lzo1x_worst_compress(PAGE_SIZE),
+				    GFP_KERNEL);
+		if (!pcpu->workmem || !pcpu->buf)
+			return -ENOMEM;
+	}
+	return 0;
+}
+
+static int __init zram_init(void)
+{
+	struct zram_device *zram, *next;
+	int i, err;
+
+	if (zram_nr < 1 || zram_nr > 1UL << MINORBITS)
+		return -EINVAL;
+	if (!zram_size)
+		zram_size = (totalram_pages / 4) << (PAGE_SHIFT - 10);
+
+	err = zram_alloc_buffers();
+	if (err)
+		goto out_free_buffers;
+
+	zram_major = register_blkdev(0, "zram");
+	if (zram_major < 0) {
+		err = -EIO;
+		goto out_free_buffers;
+	}
+
+	err = -ENOMEM;
+	for (i = 0; i < zram_nr; i++) {
+		zram = zram_alloc(i);
+		if (!zram)
+			goto out_free;
+		list_add_tail(&zram->zram_list, &zram_devices);
+	}
+
+	/* point of no return */
+
+	list_for_each_entry(zram, &zram_devices, zram_list) {
+		add_disk(zram->zram_disk);
+		if (sysfs_create_group(&disk_to_dev(zram->zram_disk)->kobj,
+				       &zram_attr_group))
+			printk(KERN_WARNING "zram%d: failed to create sysfs "
+			       "attributes\n", zram->zram_number);
+	}
+
+	printk(KERN_INFO "zram: %d devices of %luk\n", zram_nr, zram_size);
+	return 0;
+
+out_free:
+	list_for_each_entry_safe(zram, next, &zram_devices, zram_list) {
+		list_del(&zram->zram_list);
+		zram_free(zram);
+	}
+	unregister_blkdev(zram_major, "zram");
+out_free_buffers:
+	zram_free_buffers();
+	return err;
+}
+
+static void __exit zram_exit(void)
+{
+	struct zram_device *zram, *next;
+
+	list_for_each_entry_safe(zram, next, &zram_devices, zram_list)
+		zram_del_one(zram);
+
+	unregister_blkdev(zram_major, "zram");
+	zram_free_buffers();
+}
+
+module_init(zram_init);
+module_exit(zram_exit);
@@ -19,49 +19,120 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/mm.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include <linux/writeback.h>
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/buffer_head.h>
 #include "internal.h"
 
+/*
+ * The maximum number of pages to writeout in a single flusher thread
+ * operation.  We do this so we don't hold I_SYNC against an inode for
+ * enormous amounts of time, which would block a userspace task which has
+ * been forced to throttle against that inode.  Also, the code reevaluates
+ * the dirty each time it has written this many pages.
+ */
+#define MAX_WRITEBACK_PAGES	1024
 
 /**
- * writeback_acquire - attempt to get exclusive writeback access to a device
- * @bdi: the device's backing_dev_info structure
+ * writeback_in_progress - determine whether there is writeback in progress
+ * @bdi: the device's backing_dev_info structure.
  *
- * It is a waste of resources to have more than one pdflush thread blocked on
- * a single request queue.  Exclusion at the request_queue level is obtained
- * via a flag in the request_queue's backing_dev_info.state.
+ * Determine whether there is writeback waiting to be handled against a
+ * backing device, or the flusher thread serving it is currently writing.
+ */
+int writeback_in_progress(struct backing_dev_info *bdi)
+{
+	if (!bdi->wb.task)
+		bdi = &default_backing_dev_info;
+	return test_bit(BDI_writeback_running, &bdi->state) ||
+		!list_empty(&bdi->work_list);
+}
+
+/*
+ * The writeback lists an inode of @bdi is kept on.  Devices which have no
+ * flusher thread of their own (not registered, or registered before the
+ * thread could be started) share the lists of default_backing_dev_info.
  *
- * Non-request_queue-backed address_spaces will share default_backing_dev_info,
- * unless they implement their own.  Which is somewhat inefficient, as this
- * may prevent concurrent writeback against multiple devices.
+ * Called under inode_lock.
  */
-static int writeback_acquire(struct backing_dev_info *bdi)
+static struct bdi_writeback *bdi_to_wb(struct backing_dev_info *bdi)
+{
+	if (bdi->wb.task)
+		return &bdi->wb;
+	return &default_backing_dev_info.wb;
+}
+
+static inline struct bdi_writeback *inode_to_wb(struct inode *inode)
 {
-	return !test_and_set_bit(BDI_pdflush, &bdi->state);
+	return bdi_to_wb(inode->i_mapping->backing_dev_info);
+}
+
+static void bdi_queue_work(struct backing_dev_info *bdi,
+			   struct wb_writeback_args *args)
+{
+	struct bdi_work *work;
+
+	/*
+	 * This is WB_SYNC_NONE writeback, so if allocation fails just
+	 * wakeup the thread for old dirty data writeback.  It will notice
+	 * if we are over the background threshold on its own.
+	 */
+	work = kmalloc(sizeof(*work), GFP_ATOMIC);
+
+	/*
+	 * ->wb.task is cleared under wb_lock before bdi_unregister() stops
+	 * the thread; work queued after that is freed by bdi_unregister().
+	 */
+	spin_lock_bh(&bdi->wb_lock);
+	if (work) {
+		work->args = *args;
+		list_add_tail(&work->list, &bdi->work_list);
+	}
+	if (bdi->wb.task)
+		wake_up_process(bdi->wb.task);
+	spin_unlock_bh(&bdi->wb_lock);
 }
 
 /**
- * writeback_in_progress - determine whether there is writeback in progress
- * @bdi: the device's backing_dev_info structure.
+ * bdi_start_writeback - start writeback
+ * @bdi: the backing device to write from
+ * @nr_pages: the number of pages to write
  *
- * Determine whether there is writeback in progress against a backing device.
+ * Queue writeback of @nr_pages pages to the flusher thread of @bdi, or to
+ * the default flusher thread if @bdi does not have one.  The writeback is
+ * asynchronous, the caller does not wait for it.
  */
-int writeback_in_progress(struct backing_dev_info *bdi)
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages)
 {
-	return test_bit(BDI_pdflush, &bdi->state);
+	struct wb_writeback_args args = {
+		.nr_pages	= nr_pages,
+	};
+
+	if (!bdi->wb.task)
+		bdi = &default_backing_dev_info;
+	bdi_queue_work(bdi, &args);
 }
 
 /**
- * writeback_release - relinquish exclusive writeback access against a device.
- * @bdi: the device's backing_dev_info structure
+ * bdi_start_background_writeback - start background writeback
+ * @bdi: the backing device to write from
+ *
+ * Have the flusher thread of @bdi write until the amount of dirty memory
+ * drops below the background threshold.
  */
-static void writeback_release(struct backing_dev_info *bdi)
+void bdi_start_background_writeback(struct backing_dev_info *bdi)
 {
-	BUG_ON(!writeback_in_progress(bdi));
-	clear_bit(BDI_pdflush, &bdi->state);
+	struct wb_writeback_args args = {
+		.nr_pages	= 0,
+		.for_background	= 1,
+	};
+
+	if (!bdi->wb.task)
+		bdi = &default_backing_dev_info;
+	bdi_queue_work(bdi, &args);
 }
 
 /**
@@ -71,7 +142,7 @@ static void writeback_release(struct backing_dev_info *bdi)
  *	Mark an inode as dirty. Callers should use mark_inode_dirty or
  *  	mark_inode_dirty_sync.
  *
- * Put the inode on the super block's dirty list.
+ * Put the inode on the dirty list of its backing device.
  *
  * CAREFUL! We mark it dirty unconditionally, but move it onto the
  * dirty list only if it is hashed or if it refers to a blockdev.
@@ -141,13 +212,13 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		/*
 		 * If the inode is being synced, just update its dirty state.
 		 * The unlocker will place the inode on the appropriate
-		 * superblock list, based upon its state.
+		 * writeback list, based upon its state.
 		 */
 		if (inode->i_state & I_SYNC)
 			goto out;
 
 		/*
-		 * Only add valid (hashed) inodes to the superblock's
+		 * Only add valid (hashed) inodes to the backing device's
 		 * dirty list.  Add blockdev inodes as well.
 		 */
 		if (!S_ISBLK(inode->i_mode)) {
@@ -158,12 +229,12 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 			goto out;
 
 		/*
-		 * If the inode was already on s_dirty/s_io/s_more_io, don't
-		 * reposition it (that would break s_dirty time-ordering).
+		 * If the inode was already on b_dirty/b_io/b_more_io, don't
+		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_list, &sb->s_dirty);
+			list_move(&inode->i_list, &inode_to_wb(inode)->b_dirty);
 		}
 	}
 out:
@@ -181,34 +252,34 @@ static int write_inode(struct inode *inode, int sync)
 
 /*
  * Redirty an inode: set its when-it-was dirtied timestamp and move it to the
- * furthest end of its superblock's dirty-inode list.
+ * furthest end of its backing device's dirty-inode list.
  *
  * Before stamping the inode's ->dirtied_when, we check to see whether it is
- * already the most-recently-dirtied inode on the s_dirty list.  If that is
+ * already the most-recently-dirtied inode on the b_dirty list.  If that is
  * the case then the inode must have been redirtied while it was being written
  * out and we don't reset its dirtied_when.
  */
 static void redirty_tail(struct inode *inode)
 {
-	struct super_block *sb = inode->i_sb;
+	struct bdi_writeback *wb = inode_to_wb(inode);
 
-	if (!list_empty(&sb->s_dirty)) {
+	if (!list_empty(&wb->b_dirty)) {
 		struct inode *tail_inode;
 
-		tail_inode = list_entry(sb->s_dirty.next, struct inode, i_list);
+		tail_inode = list_entry(wb->b_dirty.next, struct inode, i_list);
 		if (time_before(inode->dirtied_when,
 				tail_inode->dirtied_when))
 			inode->dirtied_when = jiffies;
 	}
-	list_move(&inode->i_list, &sb->s_dirty);
+	list_move(&inode->i_list, &wb->b_dirty);
 }
 
 /*
- * requeue inode for re-scanning after sb->s_io list is exhausted.
+ * requeue inode for re-scanning after bdi->b_io list is exhausted.
  */
 static void requeue_io(struct inode *inode)
 {
-	list_move(&inode->i_list, &inode->i_sb->s_more_io);
+	list_move(&inode->i_list, &inode_to_wb(inode)->b_more_io);
 }
 
 static void inode_sync_complete(struct inode *inode)
@@ -228,7 +299,7 @@ static bool inode_dirtied_after(struct inode *inode, unsigned long t)
 	 * For inodes being constantly redirtied, dirtied_when can get stuck.
 	 * It _appears_ to be in the future, but is actually in distant past.
 	 * This test is necessary to prevent such wrapped-around relative times
-	 * from permanently stopping the whole pdflush writeback.
+	 * from permanently stopping the whole bdi writeback.
 	 */
 	ret = ret && time_before_eq(inode->dirtied_when, jiffies);
 #endif
@@ -255,18 +326,31 @@ static void move_expired_inodes(struct list_head *delaying_queue,
 /*
  * Queue all expired dirty inodes for io, eldest first.
  */
-static void queue_io(struct super_block *sb,
-				unsigned long *older_than_this)
+static void queue_io(struct bdi_writeback *wb, unsigned long *older_than_this)
 {
-	list_splice_init(&sb->s_more_io, sb->s_io.prev);
-	move_expired_inodes(&sb->s_dirty, &sb->s_io, older_than_this);
+	list_splice_init(&wb->b_more_io, wb->b_io.prev);
+	move_expired_inodes(&wb->b_dirty, &wb->b_io, older_than_this);
 }
 
+/*
+ * The dirty inodes of a superblock are spread over the lists of the backing
+ * devices they live on, so look at the inodes themselves.
+ */
 int sb_has_dirty_inodes(struct super_block *sb)
 {
-	return !list_empty(&sb->s_dirty) ||
-	       !list_empty(&sb->s_io) ||
-	       !list_empty(&sb->s_more_io);
+	struct inode *inode;
+	int ret = 0;
+
+	spin_lock(&inode_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		if ((inode->i_state & I_DIRTY) &&
+		    !(inode->i_state & (I_FREEING|I_CLEAR))) {
+			ret = 1;
+			break;
+		}
+	}
+	spin_unlock(&inode_lock);
+	return ret;
 }
 EXPORT_SYMBOL(sb_has_dirty_inodes);
 
@@ -322,11 +406,11 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			/*
 			 * We didn't write back all the pages.  nfs_writepages()
 			 * sometimes bales out without doing anything. Redirty
-			 * the inode; Move it from s_io onto s_more_io/s_dirty.
+			 * the inode; Move it from b_io onto b_more_io/b_dirty.
 			 */
 			/*
 			 * akpm: if the caller was the kupdate function we put
-			 * this inode at the head of s_dirty so it gets first
+			 * this inode at the head of b_dirty so it gets first
 			 * consideration.  Otherwise, move it to the tail, for
 			 * the reasons described there.  I'm not really sure
 			 * how much sense this makes.  Presumably I had a good
@@ -336,7 +420,7 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			if (wbc->for_kupdate) {
 				/*
 				 * For the kupdate function we move the inode
-				 * to s_more_io so it will get more writeout as
+				 * to b_more_io so it will get more writeout as
 				 * soon as the queue becomes uncongested.
 				 */
 				inode->i_state |= I_DIRTY_PAGES;
@@ -354,7 +438,7 @@ __sync_single_inode(struct inode *inode, struct writeback_control *wbc)
 			} else {
 				/*
 				 * Otherwise fully redirty the inode so that
-				 * other inodes on this superblock will get some
+				 * other inodes on this device will get some
 				 * writeout.  Otherwise heavy writing to one
 				 * file would indefinitely suspend writeout of
 				 * all the other files.
@@ -402,10 +486,10 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 	if ((wbc->sync_mode != WB_SYNC_ALL) && (inode->i_state & I_SYNC)) {
 		/*
 		 * We're skipping this inode because it's locked, and we're not
-		 * doing writeback-for-data-integrity.  Move it to s_more_io so
-		 * that writeback can proceed with the other inodes on s_io.
+		 * doing writeback-for-data-integrity.  Move it to b_more_io so
+		 * that writeback can proceed with the other inodes on b_io.
 		 * We'll have another go at writing back this inode when we
-		 * completed a full scan of s_io.
+		 * completed a full scan of b_io.
 		 */
 		requeue_io(inode);
 		return 0;
@@ -429,62 +513,86 @@ __writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 }
 
 /*
- * Write out a superblock's list of dirty inodes.  A wait will be performed
- * upon no inodes, all inodes or the final one, depending upon sync_mode.
+ * Pin the superblock of an inode found on a writeback list for the duration
+ * of its writeout.  If we can't get the readlock, there's no sense in waiting
+ * around, most of the time the FS is going to be unmounted by the time it is
+ * released.
+ *
+ * Called under inode_lock.  The inode keeps the superblock around until the
+ * reference is taken.
+ */
+static int pin_sb_for_writeback(struct super_block *sb)
+{
+	spin_lock(&sb_lock);
+	sb->s_count++;
+	if (down_read_trylock(&sb->s_umount)) {
+		if (sb->s_root) {
+			spin_unlock(&sb_lock);
+			return 1;
+		}
+		/* umount in progress */
+		up_read(&sb->s_umount);
+	}
+	sb->s_count--;
+	spin_unlock(&sb_lock);
+	return 0;
+}
+
+/*
+ * Write out a backing device's list of dirty inodes.  A wait will be
+ * performed upon no inodes, all inodes or the final one, depending upon
+ * sync_mode.
  *
  * If older_than_this is non-NULL, then only write out inodes which
  * had their first dirtying at a time earlier than *older_than_this.
  *
- * If we're a pdflush thread, then implement pdflush collision avoidance
- * against the entire list.
- *
- * If `bdi' is non-zero then we're being asked to writeback a specific queue.
- * This function assumes that the blockdev superblock's inodes are backed by
- * a variety of queues, so all inodes are searched.  For other superblocks,
- * assume that all inodes are backed by the same queue.
+ * If `bdi' is non-zero then only inodes backed by that queue are written.
+ * This matters for the lists of default_backing_dev_info, which carry the
+ * inodes of every device that has no flusher thread of its own.
  *
- * FIXME: this linear search could get expensive with many fileystems.  But
- * how to fix?  We need to go from an address_space to all inodes which share
- * a queue with that address_space.  (Easy: have a global "dirty superblocks"
- * list).
+ * If `sb' is non-zero then only inodes of that superblock are written, and
+ * the caller guarantees that the superblock stays alive.  Otherwise the
+ * superblock of each inode is pinned while the inode is written.
  *
- * The inodes to be written are parked on sb->s_io.  They are moved back onto
- * sb->s_dirty as they are selected for writing.  This way, none can be missed
+ * The inodes to be written are parked on wb->b_io.  They are moved back onto
+ * wb->b_dirty as they are selected for writing.  This way, none can be missed
  * on the writer throttling path, and we get decent balancing between many
  * throttled threads: we don't want them all piling up on inode_sync_wait.
  */
-void generic_sync_sb_inodes(struct super_block *sb,
-				struct writeback_control *wbc)
+void writeback_inodes_wb(struct bdi_writeback *wb,
+			 struct writeback_control *wbc)
 {
 	const unsigned long start = jiffies;	/* livelock avoidance */
-	int sync = wbc->sync_mode == WB_SYNC_ALL;
 
 	spin_lock(&inode_lock);
-	if (!wbc->for_kupdate || list_empty(&sb->s_io))
-		queue_io(sb, wbc->older_than_this);
+	if (!wbc->for_kupdate || list_empty(&wb->b_io))
+		queue_io(wb, wbc->older_than_this);
 
-	while (!list_empty(&sb->s_io)) {
-		struct inode *inode = list_entry(sb->s_io.prev,
+	while (!list_empty(&wb->b_io)) {
+		struct inode *inode = list_entry(wb->b_io.prev,
 						struct inode, i_list);
 		struct address_space *mapping = inode->i_mapping;
 		struct backing_dev_info *bdi = mapping->backing_dev_info;
+		struct super_block *sb = inode->i_sb;
 		long pages_skipped;
 
+		if (wbc->sb && sb != wbc->sb) {
+			requeue_io(inode);
+			continue;		/* inode of another fs */
+		}
+
+		if (wbc->bdi && bdi != wbc->bdi) {
+			requeue_io(inode);
+			continue;		/* inode has the wrong queue */
+		}
+
 		if (!bdi_cap_writeback_dirty(bdi)) {
-			redirty_tail(inode);
-			if (sb_is_blkdev_sb(sb)) {
-				/*
-				 * Dirty memory-backed blockdev: the ramdisk
-				 * driver does this.  Skip just this inode
-				 */
-				continue;
-			}
 			/*
-			 * Dirty memory-backed inode against a filesystem other
-			 * than the kernel-internal bdev filesystem.  Skip the
-			 * entire superblock.
+			 * Dirty memory-backed inode, the ramdisk driver does
+			 * this.  Skip just this inode.
 			 */
-			break;
+			redirty_tail(inode);
+			continue;
 		}
 
 		if (inode->i_state & I_NEW) {
@@ -494,36 +602,28 @@ void generic_sync_sb_inodes(struct super_block *sb,
 
 		if (wbc->nonblocking && bdi_write_congested(bdi)) {
 			wbc->encountered_congestion = 1;
-			if (!sb_is_blkdev_sb(sb))
-				break;		/* Skip a congested fs */
-			requeue_io(inode);
-			continue;		/* Skip a congested blockdev */
-		}
-
-		if (wbc->bdi && bdi != wbc->bdi) {
-			if (!sb_is_blkdev_sb(sb))
-				break;		/* fs has the wrong queue */
+			if (bdi == wb->bdi)
+				break;		/* Skip a congested device */
 			requeue_io(inode);
-			continue;		/* blockdev has wrong queue */
+			continue;		/* Skip a congested foreign inode */
 		}
 
 		/*
-		 * Was this inode dirtied after sync_sb_inodes was called?
+		 * Was this inode dirtied after writeback_inodes_wb was called?
 		 * This keeps sync from extra jobs and livelock.
 		 */
 		if (inode_dirtied_after(inode, start))
 			break;
 
-		/* Is another pdflush already flushing this queue? */
-		if (current_is_pdflush() && !writeback_acquire(bdi))
-			break;
+		if (!wbc->sb && !pin_sb_for_writeback(sb)) {
+			requeue_io(inode);
+			continue;
+		}
 
 		BUG_ON(inode->i_state & I_FREEING);
 		__iget(inode);
 		pages_skipped = wbc->pages_skipped;
 		__writeback_single_inode(inode, wbc);
-		if (current_is_pdflush())
-			writeback_release(bdi);
 		if (wbc->pages_skipped != pages_skipped) {
 			/*
 			 * writeback is not making progress due to locked
@@ -533,60 +633,105 @@ void generic_sync_sb_inodes(struct super_block *sb,
 		}
 		spin_unlock(&inode_lock);
 		iput(inode);
+		if (!wbc->sb)
+			drop_super(sb);
 		cond_resched();
 		spin_lock(&inode_lock);
 		if (wbc->nr_to_write <= 0) {
 			wbc->more_io = 1;
 			break;
 		}
-		if (!list_empty(&sb->s_more_io))
+		if (!list_empty(&wb->b_more_io))
 			wbc->more_io = 1;
 	}
+	spin_unlock(&inode_lock);
+	/* Leave any unwritten inodes on b_io */
+}
 
-	if (sync) {
-		struct inode *inode, *old_inode = NULL;
+/*
+ * Start writeback of dirty pagecache data against wbc->bdi.  This is the
+ * throttled writer in balance_dirty_pages() helping out the flusher thread.
+ */
+void writeback_inodes_wbc(struct writeback_control *wbc)
+{
+	struct bdi_writeback *wb;
 
-		/*
-		 * Data integrity sync. Must wait for all pages under writeback,
-		 * because there may have been pages dirtied before our sync
-		 * call, but which had writeout started before we write it out.
-		 * In which case, the inode may not be on the dirty list, but
-		 * we still have to wait for that writeout.
-		 */
-		list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
-			struct address_space *mapping;
-
-			if (inode->i_state &
-					(I_FREEING|I_CLEAR|I_WILL_FREE|I_NEW))
-				continue;
-			mapping = inode->i_mapping;
-			if (mapping->nrpages == 0)
-				continue;
-			__iget(inode);
-			spin_unlock(&inode_lock);
-			/*
-			 * We hold a reference to 'inode' so it couldn't have
-			 * been removed from s_inodes list while we dropped the
-			 * inode_lock.  We cannot iput the inode now as we can
-			 * be holding the last reference and we cannot iput it
-			 * under inode_lock. So we keep the reference and iput
-			 * it later.
-			 */
-			iput(old_inode);
-			old_inode = inode;
+	might_sleep();
+	spin_lock(&inode_lock);
+	wb = bdi_to_wb(wbc->bdi);
+	spin_unlock(&inode_lock);
 
-			filemap_fdatawait(mapping);
+	writeback_inodes_wb(wb, wbc);
+}
 
-			cond_resched();
+/*
+ * Data integrity sync. Must wait for all pages under writeback, because
+ * there may have been pages dirtied before our sync call, but which had
+ * writeout started before we write it out.  In which case, the inode may
+ * not be on the dirty list, but we still have to wait for that writeout.
+ */
+static void wait_sb_inodes(struct super_block *sb)
+{
+	struct inode *inode, *old_inode = NULL;
 
-			spin_lock(&inode_lock);
-		}
+	spin_lock(&inode_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		struct address_space *mapping;
+
+		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE|I_NEW))
+			continue;
+		mapping = inode->i_mapping;
+		if (mapping->nrpages == 0)
+			continue;
+		__iget(inode);
 		spin_unlock(&inode_lock);
+		/*
+		 * We hold a reference to 'inode' so it couldn't have
+		 * been removed from s_inodes list while we dropped the
+		 * inode_lock.  We cannot iput the inode now as we can
+		 * be holding the last reference and we cannot iput it
+		 * under inode_lock. So we keep the reference and iput
+		 * it later.
+		 */
 		iput(old_inode);
-	} else
-		spin_unlock(&inode_lock);
+		old_inode = inode;
+
+		filemap_fdatawait(mapping);
 
-	return;		/* Leave any unwritten inodes on s_io */
+		cond_resched();
+
+		spin_lock(&inode_lock);
+	}
+	spin_unlock(&inode_lock);
+	iput(old_inode);
+}
+
+/*
+ * Write out a superblock's dirty inodes.  They are spread over the writeback
+ * lists of the backing devices they live on, so walk every registered device
+ * in the caller's context.  A wait will be performed upon no inodes, all
+ * inodes or the final one, depending upon sync_mode.
+ *
+ * The caller must keep the superblock alive, normally by holding s_umount.
+ */
+void generic_sync_sb_inodes(struct super_block *sb,
+				struct writeback_control *wbc)
+{
+	struct backing_dev_info *bdi;
+
+	wbc->sb = sb;
+	mutex_lock(&bdi_mutex);
+	list_for_each_entry(bdi, &bdi_list, bdi_list) {
+		if (!bdi_has_dirty_io(bdi))
+			continue;
+		writeback_inodes_wb(&bdi->wb, wbc);
+		if (wbc->nr_to_write <= 0)
+			break;
+	}
+	mutex_unlock(&bdi_mutex);
+
+	if (wbc->sync_mode == WB_SYNC_ALL)
+		wait_sb_inodes(sb);
 }
 EXPORT_SYMBOL_GPL(generic_sync_sb_inodes);
 
@@ -596,56 +741,222 @@ static void sync_sb_inodes(struct super_block *sb,
 	generic_sync_sb_inodes(sb, wbc);
 }
 
+static inline bool over_bground_thresh(void)
+{
+	unsigned long background_thresh, dirty_thresh;
+
+	get_dirty_limits(&background_thresh, &dirty_thresh, NULL, NULL);
+
+	return (global_page_state(NR_FILE_DIRTY) +
+		global_page_state(NR_UNSTABLE_NFS) >= background_thresh);
+}
+
 /*
- * Start writeback of dirty pagecache data against all unlocked inodes.
- *
- * Note:
- * We don't need to grab a reference to superblock here. If it has non-empty
- * ->s_dirty it's hadn't been killed yet and kill_super() won't proceed
- * past sync_inodes_sb() until the ->s_dirty/s_io/s_more_io lists are all
- * empty. Since __sync_single_inode() regains inode_lock before it finally moves
- * inode from superblock lists we are OK.
- *
- * If `older_than_this' is non-zero then only flush inodes which have a
- * flushtime older than *older_than_this.
- *
- * If `bdi' is non-zero then we will scan the first inode against each
- * superblock until we find the matching ones.  One group will be the dirty
- * inodes against a filesystem.  Then when we hit the dummy blockdev superblock,
- * sync_sb_inodes will seekout the blockdev which matches `bdi'.  Maybe not
- * super-efficient but we're about to do a ton of I/O...
+ * Explicit flushing or periodic writeback of "old" data.
+ *
+ * Define "old": the first time one of an inode's pages is dirtied, we mark the
+ * dirtying-time in the inode's address_space.  So this periodic writeback code
+ * just walks the device's dirty inode list, writing back any inodes which are
+ * older than a specific point in time.
+ *
+ * older_than_this takes precedence over nr_to_write.  So we'll only write back
+ * all dirty pages if they are all attached to "old" mappings.
+ *
+ * Background writeback keeps going after nr_pages have been written, until
+ * the amount of dirty memory drops below the background threshold.
  */
-void
-writeback_inodes(struct writeback_control *wbc)
+static long wb_writeback(struct bdi_writeback *wb,
+			 struct wb_writeback_args *args)
 {
-	struct super_block *sb;
+	struct writeback_control wbc = {
+		.sync_mode		= WB_SYNC_NONE,
+		.older_than_this	= NULL,
+		.for_kupdate		= args->for_kupdate,
+		.nonblocking		= 1,
+		.range_cyclic		= 1,
+	};
+	unsigned long oldest_jif;
+	long nr_pages = args->nr_pages;
+	long wrote = 0;
+
+	if (wbc.for_kupdate) {
+		wbc.older_than_this = &oldest_jif;
+		oldest_jif = jiffies -
+				msecs_to_jiffies(dirty_expire_interval * 10);
+	}
 
-	might_sleep();
-	spin_lock(&sb_lock);
-restart:
-	list_for_each_entry_reverse(sb, &super_blocks, s_list) {
-		if (sb_has_dirty_inodes(sb)) {
-			/* we're making our own get_super here */
-			sb->s_count++;
-			spin_unlock(&sb_lock);
-			/*
-			 * If we can't get the readlock, there's no sense in
-			 * waiting around, most of the time the FS is going to
-			 * be unmounted by the time it is released.
-			 */
-			if (down_read_trylock(&sb->s_umount)) {
-				if (sb->s_root)
-					sync_sb_inodes(sb, wbc);
-				up_read(&sb->s_umount);
-			}
-			spin_lock(&sb_lock);
-			if (__put_super_and_need_restart(sb))
-				goto restart;
-		}
-		if (wbc->nr_to_write <= 0)
+	for (;;) {
+		if (args->for_background) {
+			if (nr_pages <= 0 && !over_bground_thresh())
+				break;
+		} else if (nr_pages <= 0)
 			break;
+
+		wbc.more_io = 0;
+		wbc.encountered_congestion = 0;
+		wbc.nr_to_write = MAX_WRITEBACK_PAGES;
+		wbc.pages_skipped = 0;
+		writeback_inodes_wb(wb, &wbc);
+		nr_pages -= MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+		wrote += MAX_WRITEBACK_PAGES - wbc.nr_to_write;
+
+		if (wbc.nr_to_write > 0 || wbc.pages_skipped > 0) {
+			/* Wrote less than expected */
+			if (wbc.encountered_congestion || wbc.more_io)
+				congestion_wait(WRITE, HZ/10);
+			else
+				break;
+		}
 	}
-	spin_unlock(&sb_lock);
+
+	return wrote;
+}
+
+static struct bdi_work *get_next_work_item(struct backing_dev_info *bdi)
+{
+	struct bdi_work *work = NULL;
+
+	spin_lock_bh(&bdi->wb_lock);
+	if (!list_empty(&bdi->work_list)) {
+		work = list_entry(bdi->work_list.next, struct bdi_work, list);
+		list_del(&work->list);
+	}
+	spin_unlock_bh(&bdi->wb_lock);
+	return work;
+}
+
+/*
+ * kupdate-style writeback of old data, at most once per
+ * dirty_writeback_interval.  The default flusher thread also takes care of
+ * writing back dirty superblocks, like the old kupdate timer did.
+ */
+static long wb_check_old_data_flush(struct bdi_writeback *wb)
+{
+	struct wb_writeback_args args = {
+		.for_kupdate	= 1,
+	};
+	unsigned long expired;
+
+	if (!dirty_writeback_interval)
+		return 0;
+
+	expired = wb->last_old_flush +
+			msecs_to_jiffies(dirty_writeback_interval * 10);
+	if (time_before(jiffies, expired))
+		return 0;
+
+	wb->last_old_flush = jiffies;
+	if (wb == &default_backing_dev_info.wb)
+		sync_supers();
+
+	args.nr_pages = global_page_state(NR_FILE_DIRTY) +
+			global_page_state(NR_UNSTABLE_NFS) +
+			(inodes_stat.nr_inodes - inodes_stat.nr_unused);
+	if (args.nr_pages <= 0)
+		return 0;
+
+	return wb_writeback(wb, &args);
+}
+
+/*
+ * Background writeback requests that could not be queued (see
+ * bdi_queue_work()) are picked up here: if we are over the background
+ * threshold, write until we are not.
+ */
+static long wb_check_background_flush(struct bdi_writeback *wb)
+{
+	struct wb_writeback_args args = {
+		.nr_pages	= 0,
+		.for_background	= 1,
+	};
+
+	if (!over_bground_thresh())
+		return 0;
+
+	return wb_writeback(wb, &args);
+}
+
+/*
+ * Retrieve work items and do the writeback they describe
+ */
+static long wb_do_writeback(struct bdi_writeback *wb)
+{
+	struct backing_dev_info *bdi = wb->bdi;
+	struct bdi_work *work;
+	long wrote = 0;
+
+	set_bit(BDI_writeback_running, &bdi->state);
+
+	while ((work = get_next_work_item(bdi)) != NULL) {
+		wrote += wb_writeback(wb, &work->args);
+		kfree(work);
+	}
+
+	wrote += wb_check_old_data_flush(wb);
+	wrote += wb_check_background_flush(wb);
+
+	clear_bit(BDI_writeback_running, &bdi->state);
+	return wrote;
+}
+
+/*
+ * Handle writeback of dirty data for the device backed by this bdi.  Also
+ * wakes up periodically and does kupdated style flushing.
+ */
+int bdi_writeback_thread(void *data)
+{
+	struct bdi_writeback *wb = data;
+
+	current->flags |= PF_FLUSHER | PF_SWAPWRITE;
+	set_freezable();
+
+	/*
+	 * Our parent may run at a different priority, just set us to normal
+	 */
+	set_user_nice(current, 0);
+
+	wb->last_old_flush = jiffies;
+
+	while (!kthread_should_stop()) {
+		wb_do_writeback(wb);
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!list_empty(&wb->bdi->work_list) || kthread_should_stop()) {
+			__set_current_state(TASK_RUNNING);
+			continue;
+		}
+
+		if (dirty_writeback_interval)
+			schedule_timeout(msecs_to_jiffies(
+					dirty_writeback_interval * 10));
+		else
+			schedule();
+
+		try_to_freeze();
+	}
+
+	return 0;
+}
+
+/*
+ * Start writeback of `nr_pages' pages on every device with dirty inodes.
+ * If `nr_pages' is zero, write back the whole world.
+ */
+void wakeup_flusher_threads(long nr_pages)
+{
+	struct backing_dev_info *bdi;
+
+	if (nr_pages == 0)
+		nr_pages = global_page_state(NR_FILE_DIRTY) +
+				global_page_state(NR_UNSTABLE_NFS);
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
+		if (!bdi_has_dirty_io(bdi))
+			continue;
+		bdi_start_writeback(bdi, nr_pages);
+	}
+	rcu_read_unlock();
 }
 
 /*
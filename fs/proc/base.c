@@ -2456,6 +2456,44 @@ static int proc_tgid_io_accounting(struct task_struct *task, char *buffer)
 }
 #endif /* CONFIG_TASK_IO_ACCOUNTING */
 
+#ifdef CONFIG_NUMA_BALANCING
+static int do_numa_stat(struct task_struct *task, char *buffer, int whole)
+{
+	struct task_numa_stats stats = task->numa_stats;
+	unsigned long total, flags;
+
+	if (whole && lock_task_sighand(task, &flags)) {
+		struct task_struct *t = task;
+
+		task_numa_stats_add(&stats, &task->signal->numa_stats);
+		while_each_thread(task, t)
+			task_numa_stats_add(&stats, &t->numa_stats);
+
+		unlock_task_sighand(task, &flags);
+	}
+	total = stats.faults_local + stats.faults_remote;
+	return sprintf(buffer,
+			"local_faults: %lu\n"
+			"remote_faults: %lu\n"
+			"local_percent: %lu\n"
+			"pages_migrated: %lu\n"
+			"migrate_failed: %lu\n",
+			stats.faults_local, stats.faults_remote,
+			total ? stats.faults_local * 100 / total : 100,
+			stats.pages_migrated, stats.migrate_failed);
+}
+
+static int proc_tid_numa_stat(struct task_struct *task, char *buffer)
+{
+	return do_numa_stat(task, buffer, 0);
+}
+
+static int proc_tgid_numa_stat(struct task_struct *task, char *buffer)
+{
+	return do_numa_stat(task, buffer, 1);
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 				struct pid *pid, struct task_struct *task)
 {
@@ -2493,6 +2531,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 	REG("maps",       S_IRUGO, proc_maps_operations),
 #ifdef CONFIG_NUMA
 	REG("numa_maps",  S_IRUGO, proc_numa_maps_operations),
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	INF("numa_stat",  S_IRUGO, proc_tgid_numa_stat),
 #endif
 	REG("mem",        S_IRUSR|S_IWUSR, proc_mem_operations),
 	LNK("cwd",        proc_cwd_link),
@@ -2832,6 +2873,9 @@ static const struct pid_entry tid_base_stuff[] = {
 	REG("maps",      S_IRUGO, proc_maps_operations),
 #ifdef CONFIG_NUMA
 	REG("numa_maps", S_IRUGO, proc_numa_maps_operations),
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	INF("numa_stat", S_IRUGO, proc_tid_numa_stat),
 #endif
 	REG("mem",       S_IRUSR|S_IWUSR, proc_mem_operations),
 	LNK("cwd",       proc_cwd_link),
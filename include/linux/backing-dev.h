@@ -13,17 +13,19 @@
 #include <linux/proportions.h>
 #include <linux/kernel.h>
 #include <linux/fs.h>
+#include <linux/spinlock.h>
 #include <asm/atomic.h>
 
 struct page;
 struct device;
 struct dentry;
+struct task_struct;
 
 /*
  * Bits in backing_dev_info.state
  */
 enum bdi_state {
-	BDI_pdflush,		/* A pdflush thread is working this device */
+	BDI_writeback_running,	/* The flusher thread is writing this device */
 	BDI_async_congested,	/* The async (write) queue is getting full */
 	BDI_sync_congested,	/* The sync queue is getting full */
 	BDI_unused,		/* Available bits start here */
@@ -39,7 +41,44 @@ enum bdi_stat_item {
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+/*
+ * Per-device writeback state.  Dirty inodes whose mapping is backed by this
+ * device are kept on b_dirty/b_io/b_more_io and written back by the flusher
+ * thread @task.  Devices without a flusher thread park their dirty inodes on
+ * the lists of default_backing_dev_info instead.  All lists and @task are
+ * protected by inode_lock.
+ */
+struct bdi_writeback {
+	struct backing_dev_info *bdi;	/* our parent bdi */
+
+	unsigned long last_old_flush;	/* last old data flush */
+
+	struct task_struct	*task;	/* writeback task */
+	struct list_head	b_dirty;	/* dirty inodes */
+	struct list_head	b_io;		/* parked for writeback */
+	struct list_head	b_more_io;	/* parked for more writeback */
+};
+
+/*
+ * Passed into wb_writeback(), essentially a subset of writeback_control
+ */
+struct wb_writeback_args {
+	long nr_pages;
+	unsigned int for_kupdate:1;
+	unsigned int for_background:1;
+};
+
+/*
+ * Work items for the flusher threads, queued on bdi->work_list.
+ */
+struct bdi_work {
+	struct list_head list;
+	struct wb_writeback_args args;
+};
+
 struct backing_dev_info {
+	struct list_head bdi_list;	/* registered devices, see bdi_list */
+
 	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
 	unsigned long state;	/* Always use atomic bitops on this */
 	unsigned int capabilities; /* Device capabilities */
@@ -56,6 +95,10 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	struct bdi_writeback wb;	/* default writeback info for this bdi */
+	spinlock_t wb_lock;		/* protects work_list */
+	struct list_head work_list;	/* pending struct bdi_work */
+
 	struct device *dev;
 
 #ifdef CONFIG_DEBUG_FS
@@ -71,6 +114,20 @@ int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 		const char *fmt, ...);
 int bdi_register_dev(struct backing_dev_info *bdi, dev_t dev);
 void bdi_unregister(struct backing_dev_info *bdi);
+void bdi_start_writeback(struct backing_dev_info *bdi, long nr_pages);
+void bdi_start_background_writeback(struct backing_dev_info *bdi);
+int bdi_writeback_thread(void *data);
+void bdi_kick_flushers(void);
+
+extern struct mutex bdi_mutex;
+extern struct list_head bdi_list;
+
+static inline int bdi_has_dirty_io(struct backing_dev_info *bdi)
+{
+	return !list_empty(&bdi->wb.b_dirty) ||
+	       !list_empty(&bdi->wb.b_io) ||
+	       !list_empty(&bdi->wb.b_more_io);
+}
 
 static inline void __add_bdi_stat(struct backing_dev_info *bdi,
 		enum bdi_stat_item item, s64 amount)
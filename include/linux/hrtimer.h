@@ -164,10 +164,12 @@ struct hrtimer_clock_base {
  *			event devices whether high resolution mode can be
  *			activated.
  * @nr_events:		Total number of timer interrupt events
+ * @nr_expired:		Total number of timers which expired
  */
 struct hrtimer_cpu_base {
 	spinlock_t			lock;
 	struct hrtimer_clock_base	clock_base[HRTIMER_MAX_CLOCK_BASES];
+	unsigned long			nr_expired;
 #ifdef CONFIG_HIGH_RES_TIMERS
 	ktime_t				expires_next;
 	int				hres_active;
@@ -239,6 +239,17 @@ static inline int vma_migratable(struct vm_area_struct *vma)
 	return 1;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+extern int sysctl_numa_balancing;
+extern unsigned int sysctl_numa_balancing_scan_delay;
+extern unsigned int sysctl_numa_balancing_scan_period;
+extern unsigned int sysctl_numa_balancing_scan_size;
+extern unsigned int sysctl_numa_balancing_migrate_ratelimit;
+
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+				unsigned long start, unsigned long end);
+#endif
+
 #else
 
 struct mempolicy {};
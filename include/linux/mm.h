@@ -324,6 +324,7 @@ void put_page(struct page *page);
 void put_pages_list(struct list_head *pages);
 
 void split_page(struct page *page, unsigned int order);
+int split_free_page(struct page *page);
 
 /*
  * Compound pages have a destructor function.  Provide a
@@ -705,6 +706,7 @@ static inline int page_mapped(struct page *page)
 
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
+#define VM_FAULT_RETRY	0x0400	/* speculative fault failed, retry under mmap_sem */
 
 #define VM_FAULT_ERROR	(VM_FAULT_OOM | VM_FAULT_SIGBUS)
 
@@ -822,6 +824,58 @@ static inline int handle_mm_fault(struct mm_struct *mm,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Speculative faults look up VMAs without mmap_sem, so VMAs must stay
+ * type stable until an RCU grace period has passed. Anybody changing the
+ * VMA tree or the fields of a linked VMA brackets the change with
+ * vma_write_begin/end(); the fault rechecks mm->vma_seq before it
+ * installs a pte. Writers hold mmap_sem for writing and may nest.
+ */
+#define VMA_CACHE_FLAGS		SLAB_DESTROY_BY_RCU
+
+static inline void mm_init_vma_seq(struct mm_struct *mm)
+{
+	seqcount_init(&mm->vma_seq);
+	mm->vma_write_depth = 0;
+}
+
+static inline void vma_write_begin(struct mm_struct *mm)
+{
+	if (!mm->vma_write_depth++)
+		write_seqcount_begin(&mm->vma_seq);
+}
+
+static inline void vma_write_end(struct mm_struct *mm)
+{
+	if (!--mm->vma_write_depth)
+		write_seqcount_end(&mm->vma_seq);
+}
+
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, int write_access);
+#else
+#define VMA_CACHE_FLAGS		0
+
+static inline void mm_init_vma_seq(struct mm_struct *mm)
+{
+}
+
+static inline void vma_write_begin(struct mm_struct *mm)
+{
+}
+
+static inline void vma_write_end(struct mm_struct *mm)
+{
+}
+
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, int write_access)
+{
+	return VM_FAULT_RETRY;
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 
@@ -836,6 +890,8 @@ int __set_page_dirty_no_writeback(struct page *page);
 int redirty_page_for_writepage(struct writeback_control *wbc,
 				struct page *page);
 void account_page_dirtied(struct page *page, struct address_space *mapping);
+int tag_page_dirtied(struct page *page, struct address_space *mapping,
+		     int warn);
 int set_page_dirty(struct page *page);
 int set_page_dirty_lock(struct page *page);
 int clear_page_dirty_for_io(struct page *page);
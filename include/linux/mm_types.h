@@ -9,6 +9,7 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
@@ -208,6 +209,10 @@ struct mm_struct {
 	atomic_t mm_count;			/* How many references to "struct mm_struct" (users count as 1) */
 	int map_count;				/* number of VMAs */
 	struct rw_semaphore mmap_sem;
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	seqcount_t vma_seq;			/* Odd while VMAs are changing */
+	int vma_write_depth;			/* Nesting of vma_seq writers */
+#endif
 	spinlock_t page_table_lock;		/* Protects page tables and some counters */
 
 	struct list_head mmlist;		/* List of maybe swapped mm's.	These are globally strung
@@ -278,6 +283,30 @@ struct mm_struct {
 #ifdef CONFIG_MMU_NOTIFIER
 	struct mmu_notifier_mm *mmu_notifier_mm;
 #endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	/*
+	 * Reclaim unmaps of this mm whose TLB flush is deferred (low bits)
+	 * and how many of them are known to be flushed (high bits), see
+	 * flush_tlb_batched_pending().
+	 */
+	atomic_t tlb_flush_batched;
+#endif
+#ifdef CONFIG_FUTEX
+	/*
+	 * Hash table for the PROCESS_PRIVATE futexes of this mm, NULL while
+	 * they still live in the global table. Replaced under RCU when the
+	 * number of threads grows, see futex_hash_grow().
+	 */
+	struct futex_hash *futex_hash;
+	seqcount_t futex_hash_seq;
+	spinlock_t futex_hash_lock;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	/* jiffies when the next NUMA sampling pass is due */
+	unsigned long numa_next_scan;
+	/* address the next sampling pass starts from */
+	unsigned long numa_scan_offset;
+#endif
 };
 
 /* Future-safe accessor for struct mm_struct's cpu_vm_mask. */
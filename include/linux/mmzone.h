@@ -318,6 +318,15 @@ struct zone {
 	unsigned long		*pageblock_flags;
 #endif /* CONFIG_SPARSEMEM */
 
+#ifdef CONFIG_COMPACTION
+	/*
+	 * On compaction failure, 1<<compact_defer_shift compactions
+	 * are skipped before trying again. The number attempted since
+	 * last failure is tracked with compact_considered.
+	 */
+	unsigned int		compact_considered;
+	unsigned int		compact_defer_shift;
+#endif
 
 	ZONE_PADDING(_pad1_)
 
@@ -351,6 +360,13 @@ struct zone {
 	 */
 	int prev_priority;
 
+	/*
+	 * Number of tasks doing direct reclaim on this zone, and the tasks
+	 * queued behind them when vm_max_zone_concurrent_reclaimers is hit.
+	 */
+	atomic_t		concurrent_reclaimers;
+	wait_queue_head_t	reclaim_wait;
+
 	/*
 	 * The target ratio of ACTIVE_ANON to INACTIVE_ANON pages on
 	 * this zone's LRU.  Maintained by the pageout code.
@@ -601,6 +617,24 @@ extern struct page *mem_map;
  * per-zone basis.
  */
 struct bootmem_data;
+struct pglist_data;
+
+/* Upper bound on kswapd threads per node beyond the first one */
+#define MAX_KSWAPD_HELPERS	7
+
+/*
+ * An extra kswapd thread of a node, see kswapd_threads=. It balances the
+ * zones in zone_mask (bits are zone indices), which no other kswapd thread
+ * of the node touches, and is woken for them only.
+ */
+struct kswapd_helper {
+	struct pglist_data *pgdat;
+	struct task_struct *task;
+	wait_queue_head_t wait;
+	int max_order;
+	unsigned int zone_mask;
+};
+
 typedef struct pglist_data {
 	struct zone node_zones[MAX_NR_ZONES];
 	struct zonelist node_zonelists[MAX_ZONELISTS];
@@ -630,6 +664,15 @@ typedef struct pglist_data {
 	wait_queue_head_t kswapd_wait;
 	struct task_struct *kswapd;
 	int kswapd_max_order;
+	/* zones kswapd balances itself, the others are the helpers' */
+	unsigned int kswapd_zone_mask;
+	struct kswapd_helper kswapd_helper[MAX_KSWAPD_HELPERS];
+#ifdef CONFIG_NUMA_BALANCING
+	/* Rate limiting of NUMA balancing migrations into this node */
+	spinlock_t numa_migrate_lock;
+	unsigned long numa_migrate_next_window;
+	unsigned long numa_migrate_nr_pages;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -122,6 +122,11 @@ do {									\
  * access to data items when inserting into or looking up from the radix tree)
  *
  * radix_tree_tagged is able to be called without locking or RCU.
+ *
+ * radix_tree_tag_set_rcu is the one modification that may be made under
+ * rcu_read_lock() alone, concurrently with locked modifications. It only
+ * succeeds when it has nothing to do beyond setting a leaf tag bit; when
+ * it fails the caller must redo the work under its lock.
  */
 
 /**
@@ -171,6 +176,8 @@ int radix_tree_preload(gfp_t gfp_mask);
 void radix_tree_init(void);
 void *radix_tree_tag_set(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag);
+int radix_tree_tag_set_rcu(struct radix_tree_root *root,
+			unsigned long index, void *item, unsigned int tag);
 void *radix_tree_tag_clear(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag);
 int radix_tree_tag_get(struct radix_tree_root *root,
@@ -164,6 +164,16 @@ struct rcu_data {
 	/* 5) For future __rcu_pending statistics. */
 	long n_rcu_pending;		/* rcu_pending() calls since boot. */
 
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	/* 6) Callbacks handed to the offload kthread of this CPU. */
+	struct task_struct *nocb_task;	/* NULL if not offloaded. */
+	struct rcu_head *nocb_head;	/* Callbacks the kthread has not */
+	struct rcu_head **nocb_tail;	/*  picked up yet. */
+	spinlock_t nocb_lock;		/* Guards the above list. */
+	atomic_long_t nocb_qlen;	/* # not invoked by the kthread. */
+	bool nocb_defer_wakeup;		/* Kthread to be woken at softirq. */
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 	int cpu;
 };
 
@@ -232,6 +242,7 @@ struct rcu_state {
 #ifdef CONFIG_NO_HZ
 	long dynticks_completed;		/* Value of completed @ snap. */
 #endif /* #ifdef CONFIG_NO_HZ */
+	char *name;				/* Name of structure. */
 };
 
 extern void rcu_qsctr_inc(int cpu);
@@ -38,6 +38,17 @@ struct res_counter {
 	 * the number of unsuccessful attempts to consume the resource
 	 */
 	unsigned long long failcnt;
+	/*
+	 * the limit that usage may exceed, but which is enforced when the
+	 * system as a whole is under memory pressure
+	 */
+	unsigned long long soft_limit;
+	/*
+	 * usage above high_wmark starts background reclaim, which stops
+	 * once usage falls below low_wmark
+	 */
+	unsigned long long high_wmark;
+	unsigned long long low_wmark;
 	/*
 	 * the lock to protect all of the above.
 	 * the routines below consider this to be IRQ-safe
@@ -85,6 +96,9 @@ enum {
 	RES_MAX_USAGE,
 	RES_LIMIT,
 	RES_FAILCNT,
+	RES_SOFT_LIMIT,
+	RES_HIGH_WMARK,
+	RES_LOW_WMARK,
 };
 
 /*
@@ -145,6 +159,40 @@ static inline bool res_counter_check_under_limit(struct res_counter *cnt)
 	return ret;
 }
 
+/*
+ * Returns the amount by which usage exceeds the soft limit, 0 if it
+ * does not.
+ */
+static inline unsigned long long
+res_counter_soft_limit_excess(struct res_counter *cnt)
+{
+	unsigned long long excess;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	if (cnt->usage <= cnt->soft_limit)
+		excess = 0;
+	else
+		excess = cnt->usage - cnt->soft_limit;
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return excess;
+}
+
+/*
+ * The watermark checks are done without the lock: they are hints used
+ * to kick and stop background reclaim, and a stale value only delays
+ * that decision by one charge.
+ */
+static inline bool res_counter_above_high_wmark(struct res_counter *cnt)
+{
+	return cnt->usage > cnt->high_wmark;
+}
+
+static inline bool res_counter_below_low_wmark(struct res_counter *cnt)
+{
+	return cnt->usage <= cnt->low_wmark;
+}
+
 static inline void res_counter_reset_max(struct res_counter *cnt)
 {
 	unsigned long flags;
@@ -163,6 +211,10 @@ static inline void res_counter_reset_failcnt(struct res_counter *cnt)
 	spin_unlock_irqrestore(&cnt->lock, flags);
 }
 
+/*
+ * Lowering the limit below the watermarks pulls those down with it, see
+ * res_counter_set_wmark(). Unset (unlimited) watermarks are left alone.
+ */
 static inline int res_counter_set_limit(struct res_counter *cnt,
 		unsigned long long limit)
 {
@@ -172,10 +224,59 @@ static inline int res_counter_set_limit(struct res_counter *cnt,
 	spin_lock_irqsave(&cnt->lock, flags);
 	if (cnt->usage <= limit) {
 		cnt->limit = limit;
+		if (cnt->high_wmark != (unsigned long long)LLONG_MAX &&
+		    cnt->high_wmark > limit)
+			cnt->high_wmark = limit;
+		if (cnt->low_wmark != (unsigned long long)LLONG_MAX &&
+		    cnt->low_wmark > cnt->high_wmark)
+			cnt->low_wmark = cnt->high_wmark;
 		ret = 0;
 	}
 	spin_unlock_irqrestore(&cnt->lock, flags);
 	return ret;
 }
 
+static inline int res_counter_set_soft_limit(struct res_counter *cnt,
+		unsigned long long soft_limit)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	cnt->soft_limit = soft_limit;
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return 0;
+}
+
+/*
+ * The watermarks must satisfy low_wmark <= high_wmark <= limit, unless they
+ * are unset. Lowering the high watermark below the low one lowers that one
+ * as well, so that they can be set in either order.
+ */
+static inline int res_counter_set_wmark(struct res_counter *cnt, int member,
+		unsigned long long val)
+{
+	unsigned long flags;
+	int ret = -EINVAL;
+
+	spin_lock_irqsave(&cnt->lock, flags);
+	switch (member) {
+	case RES_HIGH_WMARK:
+		if (val <= cnt->limit) {
+			cnt->high_wmark = val;
+			if (cnt->low_wmark > val)
+				cnt->low_wmark = val;
+			ret = 0;
+		}
+		break;
+	case RES_LOW_WMARK:
+		if (val <= cnt->high_wmark) {
+			cnt->low_wmark = val;
+			ret = 0;
+		}
+		break;
+	}
+	spin_unlock_irqrestore(&cnt->lock, flags);
+	return ret;
+}
+
 #endif
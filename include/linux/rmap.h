@@ -84,7 +84,7 @@ static inline void page_dup_rmap(struct page *page, struct vm_area_struct *vma,
  * Called from mm/vmscan.c to handle paging out
  */
 int page_referenced(struct page *, int is_locked, struct mem_cgroup *cnt);
-int try_to_unmap(struct page *, int ignore_refs);
+int try_to_unmap(struct page *, int flags);
 
 /*
  * Called from mm/filemap_xip.c to unmap empty zero page
@@ -135,6 +135,26 @@ static inline int page_mkclean(struct page *page)
 
 #endif	/* CONFIG_MMU */
 
+/* try_to_unmap() flags */
+#define TTU_MIGRATION	0x1	/* leave migration entries behind */
+#define TTU_BATCH_FLUSH	0x2	/* defer TLB flushes to try_to_unmap_flush() */
+
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+void try_to_unmap_flush(void);
+void try_to_unmap_flush_dirty(void);
+void flush_tlb_batched_pending(struct mm_struct *mm);
+#else
+static inline void try_to_unmap_flush(void)
+{
+}
+static inline void try_to_unmap_flush_dirty(void)
+{
+}
+static inline void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+}
+#endif
+
 /*
  * Return values of try_to_unmap
  */
@@ -264,6 +264,10 @@ static inline int select_nohz_load_balancer(int cpu)
 }
 #endif
 
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+extern int sched_can_stop_tick(void);
+#endif
+
 /*
  * Only dump TASK_* tasks. (0 for all tasks)
  */
@@ -341,6 +345,8 @@ extern signed long schedule_timeout_uninterruptible(signed long timeout);
 asmlinkage void __schedule(void);
 asmlinkage void schedule(void);
 extern int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner);
+extern int rwsem_spin_on_owner(struct rw_semaphore *sem,
+			       struct thread_info *owner);
 
 struct nsproxy;
 struct user_namespace;
@@ -498,6 +504,42 @@ struct thread_group_cputimer {
 	spinlock_t lock;
 };
 
+/* NUMA hinting faults taken by a task, and what became of them */
+struct task_numa_stats {
+	unsigned long faults_local;
+	unsigned long faults_remote;
+	unsigned long pages_migrated;
+	unsigned long migrate_failed;
+};
+
+static inline void task_numa_stats_add(struct task_numa_stats *dst,
+				       struct task_numa_stats *src)
+{
+	dst->faults_local += src->faults_local;
+	dst->faults_remote += src->faults_remote;
+	dst->pages_migrated += src->pages_migrated;
+	dst->migrate_failed += src->migrate_failed;
+}
+
+/* task_numa_work samples current's memory on its way back to user mode */
+#ifdef CONFIG_NUMA_BALANCING
+extern void task_numa_work(void);
+#else
+static inline void task_numa_work(void) {}
+#endif
+
+/*
+ * TLB flushes deferred by try_to_unmap(TTU_BATCH_FLUSH) in reclaim: the
+ * cpus that may still cache the cleared ptes, whether any flush is owed
+ * at all, and whether a cleared pte was dirty, in which case stale TLB
+ * entries could still write to the page.
+ */
+struct tlbflush_unmap_batch {
+	struct cpumask cpumask;
+	bool flush_required;
+	bool writable;
+};
+
 /*
  * NOTE! "signal_struct" does not have it's own
  * locking, because a shared signal_struct always
@@ -574,6 +616,9 @@ struct signal_struct {
 	unsigned long min_flt, maj_flt, cmin_flt, cmaj_flt;
 	unsigned long inblock, oublock, cinblock, coublock;
 	struct task_io_accounting ioac;
+#ifdef CONFIG_NUMA_BALANCING
+	struct task_numa_stats numa_stats;
+#endif
 
 	/*
 	 * Cumulative ns of schedule CPU time fo dead threads in the
@@ -838,6 +883,23 @@ struct sched_group {
 	 */
 	u32 reciprocal_cpu_power;
 
+	/*
+	 * Load statistics of the group as last computed by the load
+	 * balancer. Groups are shared by the domains of all their cpus, so
+	 * other cpus balancing against this group within the same jiffy and
+	 * with the same load index reuse them instead of walking the group's
+	 * runqueues again.
+	 */
+	struct sched_group_lb_cache {
+		seqlock_t lock;
+		unsigned long stamp;	/* jiffies, stale when != jiffies */
+		int load_idx;
+		int group_imb;
+		unsigned long group_load;
+		unsigned long sum_nr_running;
+		unsigned long sum_weighted_load;
+	} lb_cache;
+
 	unsigned long cpumask[];
 };
 
@@ -887,8 +949,6 @@ struct sched_domain {
 	unsigned int balance_interval;	/* initialise to 1. units in ms. */
 	unsigned int nr_balance_failed; /* initialise to 0 */
 
-	u64 last_update;
-
 #ifdef CONFIG_SCHEDSTATS
 	/* load_balance() stats */
 	unsigned int lb_count[CPU_MAX_IDLE_TYPES];
@@ -1383,6 +1443,12 @@ struct task_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *mempolicy;
 	short il_next;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	struct task_numa_stats numa_stats;
+#endif
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+	struct tlbflush_unmap_batch tlb_ubc;
 #endif
 	atomic_t fs_excl;	/* holding fs exclusive resources */
 	struct rcu_head rcu;
@@ -1410,6 +1476,15 @@ struct task_struct {
 	unsigned long default_timer_slack_ns;
 
 	struct list_head	*scm_work_list;
+#ifdef CONFIG_CGROUP_MEM_RES_CTLR
+	/* memcg uncharges coalesced while unmapping or truncating */
+	struct memcg_batch_info {
+		int do_batch;	/* incremented when batch uncharge started */
+		struct mem_cgroup *memcg; /* target memcg of uncharge */
+		unsigned long bytes;		/* uncharged usage */
+		unsigned long memsw_bytes;	/* uncharged mem+swap usage */
+	} memcg_batch;
+#endif
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
 	/* Index of current stored adress in ret_stack */
 	int curr_ret_stack;
@@ -1623,6 +1698,7 @@ extern cputime_t task_gtime(struct task_struct *p);
 #define PF_EXITING	0x00000004	/* getting shut down */
 #define PF_EXITPIDONE	0x00000008	/* pi exit done on shut down */
 #define PF_VCPU		0x00000010	/* I'm a virtual CPU */
+#define PF_WQ_WORKER	0x00000020	/* I'm a workqueue worker */
 #define PF_FORKNOEXEC	0x00000040	/* forked but didn't exec */
 #define PF_SUPERPRIV	0x00000100	/* used super-user privileges */
 #define PF_DUMPCORE	0x00000200	/* dumped core */
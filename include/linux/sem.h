@@ -79,6 +79,7 @@ struct  seminfo {
 #ifdef __KERNEL__
 #include <asm/atomic.h>
 #include <linux/rcupdate.h>
+#include <linux/spinlock.h>
 
 struct task_struct;
 
@@ -86,6 +87,8 @@ struct task_struct;
 struct sem {
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
+	spinlock_t	lock;	/* for single semaphore operations */
+	struct list_head sem_pending; /* pending single semaphore operations */
 };
 
 /* One sem_array data structure for each set of semaphores in the system. */
@@ -94,9 +97,10 @@ struct sem_array {
 	time_t			sem_otime;	/* last semop time */
 	time_t			sem_ctime;	/* last change time */
 	struct sem		*sem_base;	/* ptr to first semaphore in array */
-	struct list_head	sem_pending;	/* pending operations to be processed */
+	struct list_head	sem_pending;	/* pending multi semaphore operations */
 	struct list_head	list_id;	/* undo requests on this array */
 	unsigned long		sem_nsems;	/* no. of semaphores in array */
+	int			complex_count;	/* number of entries in sem_pending */
 };
 
 /* One queue for each sleeping process in the system. */
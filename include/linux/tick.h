@@ -43,6 +43,10 @@ enum tick_nohz_mode {
  * @idle_exittime:	Time when the idle state was left
  * @idle_sleeptime:	Sum of the time slept in idle with sched tick stopped
  * @sleep_length:	Duration of the current idle sleep
+ * @adaptive:		Indicator that the tick has been stopped while a task
+ *			runs (CONFIG_NO_HZ_ADAPTIVE)
+ * @adaptive_jiffies:	jiffies up to which the running task has been
+ *			accounted with the tick stopped
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -64,6 +68,8 @@ struct tick_sched {
 	unsigned long			last_jiffies;
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
+	int				adaptive;
+	unsigned long			adaptive_jiffies;
 };
 
 extern void __init tick_init(void);
@@ -128,4 +134,51 @@ static inline ktime_t tick_nohz_get_sleep_length(void)
 static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_ADAPTIVE
+extern const struct cpumask *const tick_nohz_adaptive_mask;
+extern void __tick_nohz_adaptive_update(void);
+extern void __tick_nohz_adaptive_restart(void);
+extern void __tick_nohz_adaptive_timer_added(void);
+extern void __tick_nohz_adaptive_kick(int cpu);
+
+static inline int tick_nohz_adaptive_cpu(int cpu)
+{
+	return cpumask_test_cpu(cpu, tick_nohz_adaptive_mask);
+}
+
+/* Stop the tick if the current task runs alone, restart it otherwise */
+static inline void tick_nohz_adaptive_update(void)
+{
+	if (tick_nohz_adaptive_cpu(smp_processor_id()))
+		__tick_nohz_adaptive_update();
+}
+
+/* Restart the tick if it was stopped for the current task */
+static inline void tick_nohz_adaptive_restart(void)
+{
+	if (tick_nohz_adaptive_cpu(smp_processor_id()))
+		__tick_nohz_adaptive_restart();
+}
+
+/* A timer was added to the timer wheel of this CPU */
+static inline void tick_nohz_adaptive_timer_added(void)
+{
+	if (tick_nohz_adaptive_cpu(smp_processor_id()))
+		__tick_nohz_adaptive_timer_added();
+}
+
+/* Make @cpu reevaluate its tick, if it stopped it for a busy task */
+static inline void tick_nohz_adaptive_kick(int cpu)
+{
+	if (tick_nohz_adaptive_cpu(cpu))
+		__tick_nohz_adaptive_kick(cpu);
+}
+# else
+static inline int tick_nohz_adaptive_cpu(int cpu) { return 0; }
+static inline void tick_nohz_adaptive_update(void) { }
+static inline void tick_nohz_adaptive_restart(void) { }
+static inline void tick_nohz_adaptive_timer_added(void) { }
+static inline void tick_nohz_adaptive_kick(int cpu) { }
+# endif /* !NO_HZ_ADAPTIVE */
+
 #endif
@@ -17,6 +17,9 @@ struct timer_list {
 	unsigned long data;
 
 	struct tvec_base *base;
+
+	int slack;
+
 #ifdef CONFIG_TIMER_STATS
 	void *start_site;
 	char start_comm[16];
@@ -48,6 +51,7 @@ extern struct tvec_base boot_tvec_bases;
 		.expires = (_expires),				\
 		.data = (_data),				\
 		.base = &boot_tvec_bases,			\
+		.slack = -1,					\
 		__TIMER_LOCKDEP_MAP_INITIALIZER(		\
 			__FILE__ ":" __stringify(__LINE__))	\
 	}
@@ -164,6 +168,10 @@ extern int del_timer(struct timer_list * timer);
 extern int mod_timer(struct timer_list *timer, unsigned long expires);
 extern int mod_timer_pending(struct timer_list *timer, unsigned long expires);
 
+extern void set_timer_slack(struct timer_list *timer, int slack_hz);
+extern void timer_wheel_stats(int cpu, unsigned long *nr_expiries,
+			      unsigned long *nr_expired);
+
 /*
  * The jiffies value which is added to now, when there is no timer
  * in the timer wheel:
@@ -0,0 +1,8 @@
+#ifndef _TRACE_RCU_H
+#define _TRACE_RCU_H
+
+#include <linux/tracepoint.h>
+
+#include <trace/rcu_event_types.h>
+
+#endif
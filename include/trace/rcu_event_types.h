@@ -0,0 +1,71 @@
+
+/* use <trace/rcu.h> instead */
+#ifndef TRACE_EVENT
+# error Do not include this file directly.
+# error Unless you know what you are doing.
+#endif
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM rcu
+
+/*
+ * Tracepoint for the start of a batch of RCU callback invocations, from
+ * softirq or from the offload kthread of a CPU. qlen is the number of
+ * callbacks queued on the CPU that were not invoked yet, limit the most
+ * that are invoked in this batch.
+ */
+TRACE_EVENT(rcu_batch_start,
+
+	TP_PROTO(const char *rcuname, int cpu, long qlen, long limit),
+
+	TP_ARGS(rcuname, cpu, qlen, limit),
+
+	TP_STRUCT__entry(
+		__field(	const char *,	rcuname		)
+		__field(	int,		cpu		)
+		__field(	long,		qlen		)
+		__field(	long,		limit		)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname	= rcuname;
+		__entry->cpu		= cpu;
+		__entry->qlen		= qlen;
+		__entry->limit		= limit;
+	),
+
+	TP_printk("%s cpu=%d qlen=%ld limit=%ld",
+		  __entry->rcuname, __entry->cpu, __entry->qlen,
+		  __entry->limit)
+);
+
+/*
+ * Tracepoint for the end of a batch: count callbacks were invoked and
+ * qlen are still left.
+ */
+TRACE_EVENT(rcu_batch_end,
+
+	TP_PROTO(const char *rcuname, int cpu, long count, long qlen),
+
+	TP_ARGS(rcuname, cpu, count, qlen),
+
+	TP_STRUCT__entry(
+		__field(	const char *,	rcuname		)
+		__field(	int,		cpu		)
+		__field(	long,		count		)
+		__field(	long,		qlen		)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname	= rcuname;
+		__entry->cpu		= cpu;
+		__entry->count		= count;
+		__entry->qlen		= qlen;
+	),
+
+	TP_printk("%s cpu=%d count=%ld qlen=%ld",
+		  __entry->rcuname, __entry->cpu, __entry->count,
+		  __entry->qlen)
+);
+
+#undef TRACE_SYSTEM
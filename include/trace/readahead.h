@@ -0,0 +1,9 @@
+#ifndef _TRACE_READAHEAD_H
+#define _TRACE_READAHEAD_H
+
+#include <linux/fs.h>
+#include <linux/tracepoint.h>
+
+#include <trace/readahead_event_types.h>
+
+#endif
@@ -0,0 +1,59 @@
+
+/* use <trace/readahead.h> instead */
+#ifndef TRACE_EVENT
+# error Do not include this file directly.
+# error Unless you know what you are doing.
+#endif
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM readahead
+
+/*
+ * Tracepoint for an on-demand readahead window being submitted.  stream
+ * is the slot in the file's stream table the access matched, or -1 if it
+ * started a new stream; async is set if it came from a PG_readahead hit.
+ */
+TRACE_EVENT(mm_readahead,
+
+	TP_PROTO(struct address_space *mapping, pgoff_t offset,
+		 unsigned long req_size, struct file_ra_state *ra,
+		 int stream, int async, int actual),
+
+	TP_ARGS(mapping, offset, req_size, ra, stream, async, actual),
+
+	TP_STRUCT__entry(
+		__field(	dev_t,		dev		)
+		__field(	unsigned long,	ino		)
+		__field(	pgoff_t,	offset		)
+		__field(	unsigned long,	req_size	)
+		__field(	pgoff_t,	start		)
+		__field(	unsigned int,	size		)
+		__field(	unsigned int,	async_size	)
+		__field(	int,		stream		)
+		__field(	int,		async		)
+		__field(	int,		actual		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= mapping->host->i_sb->s_dev;
+		__entry->ino		= mapping->host->i_ino;
+		__entry->offset		= offset;
+		__entry->req_size	= req_size;
+		__entry->start		= ra->start;
+		__entry->size		= ra->size;
+		__entry->async_size	= ra->async_size;
+		__entry->stream		= stream;
+		__entry->async		= async;
+		__entry->actual		= actual;
+	),
+
+	TP_printk("dev=%d:%d ino=%lu offset=%lu req_size=%lu start=%lu "
+		  "size=%u async_size=%u stream=%d async=%d actual=%d",
+		MAJOR(__entry->dev), MINOR(__entry->dev), __entry->ino,
+		(unsigned long)__entry->offset, __entry->req_size,
+		(unsigned long)__entry->start, __entry->size,
+		__entry->async_size, __entry->stream, __entry->async,
+		__entry->actual)
+);
+
+#undef TRACE_SYSTEM
@@ -3,3 +3,6 @@
 #include <trace/sched_event_types.h>
 #include <trace/irq_event_types.h>
 #include <trace/lockdep_event_types.h>
+#include <trace/vmscan_event_types.h>
+#include <trace/readahead_event_types.h>
+#include <trace/rcu_event_types.h>
@@ -3,3 +3,6 @@
 #include <trace/sched.h>
 #include <trace/irq.h>
 #include <trace/lockdep.h>
+#include <trace/vmscan.h>
+#include <trace/readahead.h>
+#include <trace/rcu.h>
@@ -0,0 +1,9 @@
+#ifndef _TRACE_VMSCAN_H
+#define _TRACE_VMSCAN_H
+
+#include <linux/mmzone.h>
+#include <linux/tracepoint.h>
+
+#include <trace/vmscan_event_types.h>
+
+#endif
@@ -0,0 +1,86 @@
+
+/* use <trace/vmscan.h> instead */
+#ifndef TRACE_EVENT
+# error Do not include this file directly.
+# error Unless you know what you are doing.
+#endif
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM vmscan
+
+/*
+ * Tracepoint for a task entering direct reclaim:
+ */
+TRACE_EVENT(mm_vmscan_direct_reclaim_begin,
+
+	TP_PROTO(int order, gfp_t gfp_flags),
+
+	TP_ARGS(order, gfp_flags),
+
+	TP_STRUCT__entry(
+		__field(	int,	order		)
+		__field(	gfp_t,	gfp_flags	)
+	),
+
+	TP_fast_assign(
+		__entry->order		= order;
+		__entry->gfp_flags	= gfp_flags;
+	),
+
+	TP_printk("order=%d gfp_flags=0x%x",
+		__entry->order, __entry->gfp_flags)
+);
+
+/*
+ * Tracepoint for a task leaving direct reclaim, with the time it spent
+ * there (including any time throttled):
+ */
+TRACE_EVENT(mm_vmscan_direct_reclaim_end,
+
+	TP_PROTO(unsigned long nr_reclaimed, u64 delta_ns),
+
+	TP_ARGS(nr_reclaimed, delta_ns),
+
+	TP_STRUCT__entry(
+		__field(	unsigned long,	nr_reclaimed	)
+		__field(	u64,		delta_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->nr_reclaimed	= nr_reclaimed;
+		__entry->delta_ns	= delta_ns;
+	),
+
+	TP_printk("nr_reclaimed=%lu delta_ns=%llu",
+		__entry->nr_reclaimed, (unsigned long long)__entry->delta_ns)
+);
+
+/*
+ * Tracepoint for a direct reclaimer which had to queue for a zone:
+ */
+TRACE_EVENT(mm_vmscan_reclaim_throttle,
+
+	TP_PROTO(struct zone *zone, u64 delta_ns, int skipped),
+
+	TP_ARGS(zone, delta_ns, skipped),
+
+	TP_STRUCT__entry(
+		__field(	int,	nid		)
+		__field(	int,	zid		)
+		__field(	u64,	delta_ns	)
+		__field(	int,	skipped		)
+	),
+
+	TP_fast_assign(
+		__entry->nid		= zone_to_nid(zone);
+		__entry->zid		= zone_idx(zone);
+		__entry->delta_ns	= delta_ns;
+		__entry->skipped	= skipped;
+	),
+
+	TP_printk("nid=%d zid=%d delta_ns=%llu skipped=%d",
+		__entry->nid, __entry->zid,
+		(unsigned long long)__entry->delta_ns, __entry->skipped)
+);
+
+#undef TRACE_SYSTEM
@@ -106,8 +106,21 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *	sem_undo.id_next,
  *	sem_array.sem_pending{,last},
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: sem_lock() or sem.lock
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
+ * Locking:
+ * Operations on a single semaphore are the common case, e.g. for sets of
+ * semaphores used as independent locks. As long as no operation on more
+ * than one semaphore is pending (complex_count is 0), semtimedop() does
+ * those under the lock of that semaphore only and leaves the array alone.
+ * Everything else takes the lock of the array (sem_perm.lock) and then
+ * waits until no semaphore lock is held anymore, which excludes the
+ * single semaphore operations as well; see sem_lock_semop() and
+ * sem_wait_array().
+ *
+ * Single semaphore operations that have to sleep are queued on the
+ * pending list of their semaphore, all others on the list of the array.
  */
 
 #define sc_semmsl	sem_ctls[0]
@@ -140,6 +153,21 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Wait for all single semaphore operations to finish after taking the
+ * lock of the array. New ones see the array lock and take it as well.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	/* pairs with the smp_mb() in sem_lock_semop() */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	smp_rmb();
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
  * is not held.
@@ -147,17 +175,38 @@ void __init sem_init (void)
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
+}
+
+/*
+ * Must be called with rcu_read_lock() held, the array still needs to be
+ * locked and checked for ->deleted.
+ */
+static inline struct sem_array *sem_obtain_object_check(struct ipc_namespace *ns,
+							int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object_check(&sem_ids(ns), id);
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
@@ -165,9 +214,49 @@ static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 	return container_of(ipcp, struct sem_array, sem_perm);
 }
 
+/*
+ * Lock the array for semtimedop(). A single semaphore operation only
+ * takes the lock of that semaphore, unless a complex operation is pending
+ * or somebody holds the array lock. Returns the number of the semaphore
+ * that was locked, or -1 if the whole array was. Must be called with
+ * rcu_read_lock() held.
+ */
+static inline int sem_lock_semop(struct sem_array *sma, struct sembuf *sops,
+				 int nsops)
+{
+	struct sem *sem;
+
+	if (nsops == 1 && !sma->complex_count) {
+		sem = sma->sem_base + sops->sem_num;
+		spin_lock(&sem->lock);
+		/*
+		 * Order taking the semaphore lock against the check of the
+		 * array lock, pairs with the smp_mb() in sem_wait_array().
+		 */
+		smp_mb();
+		if (likely(!spin_is_locked(&sma->sem_perm.lock) &&
+			   !sma->complex_count))
+			return sops->sem_num;
+		spin_unlock(&sem->lock);
+	}
+
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void sem_unlock_semop(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+}
+
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_wait_array(sma);
 	ipc_rcu_putref(sma);
 }
 
@@ -194,7 +283,7 @@ static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
  * Without the check/retry algorithm a lockless wakeup is possible:
  * - queue.status is initialized to -EINTR before blocking.
  * - wakeup is performed by
- *	* unlinking the queue entry from sma->sem_pending
+ *	* unlinking the queue entry from its pending list
  *	* setting queue.status to IN_WAKEUP
  *	  This is the notification for the blocked thread that a
  *	  result value is imminent.
@@ -223,6 +312,22 @@ static inline void sem_rmid(struct ipc_namespace *ns, struct sem_array *s)
  */
 #define IN_WAKEUP	1
 
+static void wake_up_sem_queue(struct sem_queue *q, int error)
+{
+	q->status = IN_WAKEUP;
+	wake_up_process(q->sleeper);
+	/* hands-off: q will disappear immediately after writing q->status */
+	smp_wmb();
+	q->status = error;
+}
+
+static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
+{
+	list_del(&q->list);
+	if (q->nsops > 1)
+		sma->complex_count--;
+}
+
 /**
  * newary - Create a new semaphore set
  * @ns: namespace
@@ -240,6 +345,7 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	key_t key = params->key;
 	int nsems = params->u.nsems;
 	int semflg = params->flg;
+	int i;
 
 	if (!nsems)
 		return -EINVAL;
@@ -263,6 +369,17 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 		return retval;
 	}
 
+	/* semtimedop() may find the array before ipc_addid() returns */
+	sma->sem_base = (struct sem *) &sma[1];
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
+		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
+	INIT_LIST_HEAD(&sma->sem_pending);
+	INIT_LIST_HEAD(&sma->list_id);
+	sma->sem_nsems = nsems;
+	sma->sem_ctime = get_seconds();
+
 	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
 	if (id < 0) {
 		security_sem_free(sma);
@@ -271,11 +388,6 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 	}
 	ns->used_sems += nsems;
 
-	sma->sem_base = (struct sem *) &sma[1];
-	INIT_LIST_HEAD(&sma->sem_pending);
-	INIT_LIST_HEAD(&sma->list_id);
-	sma->sem_nsems = nsems;
-	sma->sem_ctime = get_seconds();
 	sem_unlock(sma);
 
 	return sma->sem_perm.id;
@@ -397,16 +509,33 @@ undo:
 	return result;
 }
 
-/* Go through the pending queue for the indicated semaphore
- * looking for tasks that can be completed.
+/* Go through the pending queue for the indicated semaphore, or the
+ * queue of complex operations for semnum -1, looking for tasks that can
+ * be completed. Returns 1 if an operation that altered the array was
+ * completed.
  */
-static void update_queue (struct sem_array * sma)
+static int update_queue(struct sem_array *sma, int semnum)
 {
-	int error;
+	int error, altered = 0;
 	struct sem_queue * q;
+	struct list_head *pending;
+
+	if (semnum == -1)
+		pending = &sma->sem_pending;
+	else
+		pending = &sma->sem_base[semnum].sem_pending;
+
+	q = list_entry(pending->next, struct sem_queue, list);
+	while (&q->list != pending) {
+		/*
+		 * The altering operations on the list of a semaphore are
+		 * all decrements and queued behind the waits for zero:
+		 * none of them can succeed once the semaphore is 0.
+		 */
+		if (semnum != -1 && q->alter &&
+		    !sma->sem_base[semnum].semval)
+			break;
 
-	q = list_entry(sma->sem_pending.next, struct sem_queue, list);
-	while (&q->list != &sma->sem_pending) {
 		error = try_atomic_semop(sma, q->sops, q->nsops,
 					 q->undo, q->pid);
 
@@ -432,29 +561,60 @@ static void update_queue (struct sem_array * sma)
 			 * [because the list is invalid after the list_del()]
 			 */
 			if (q->alter) {
-				list_del(&q->list);
-				n = list_entry(sma->sem_pending.next,
+				unlink_queue(sma, q);
+				n = list_entry(pending->next,
 						struct sem_queue, list);
+				if (!error)
+					altered = 1;
 			} else {
 				n = list_entry(q->list.next, struct sem_queue,
 						list);
-				list_del(&q->list);
+				unlink_queue(sma, q);
 			}
 
 			/* wake up the waiting thread */
-			q->status = IN_WAKEUP;
-
-			wake_up_process(q->sleeper);
-			/* hands-off: q will disappear immediately after
-			 * writing q->status.
-			 */
-			smp_wmb();
-			q->status = error;
+			wake_up_sem_queue(q, error);
 			q = n;
 		} else {
 			q = list_entry(q->list.next, struct sem_queue, list);
 		}
 	}
+	return altered;
+}
+
+/*
+ * Wake up the pending operations that can complete after the semaphores
+ * in sops were changed, or any of them if sops is NULL. Operations on
+ * single semaphores only need a look at the queues of the semaphores
+ * that changed; complex operations are checked whenever anything
+ * changed, and once one of them completes all queues are.
+ */
+static void do_smart_update(struct sem_array *sma, struct sembuf *sops,
+			    int nsops)
+{
+	int i, altered;
+
+	if (sma->complex_count && update_queue(sma, -1))
+		sops = NULL;
+
+	for (;;) {
+		altered = 0;
+		if (sops) {
+			for (i = 0; i < nsops; i++)
+				if (sops[i].sem_op)
+					altered |= update_queue(sma,
+							sops[i].sem_num);
+		} else {
+			for (i = 0; i < sma->sem_nsems; i++)
+				altered |= update_queue(sma, i);
+		}
+
+		/* that may have unblocked a complex operation */
+		if (!altered || !sma->complex_count ||
+		    !update_queue(sma, -1))
+			break;
+		sops = NULL;
+	}
 }
 
 /* The following counts are associated to each semaphore:
@@ -466,42 +626,35 @@ static void update_queue (struct sem_array * sma)
  * The counts we return here are a rough approximation, but still
  * warrant that semncnt+semzcnt>0 if the task is on the pending queue.
  */
-static int count_semncnt (struct sem_array * sma, ushort semnum)
+static int count_semcnt(struct list_head *pending, ushort semnum, int zero)
 {
-	int semncnt;
+	int semcnt;
 	struct sem_queue * q;
 
-	semncnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
+	semcnt = 0;
+	list_for_each_entry(q, pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
 		int i;
 		for (i = 0; i < nsops; i++)
 			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op < 0)
+			    && (zero ? sops[i].sem_op == 0 : sops[i].sem_op < 0)
 			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semncnt++;
+				semcnt++;
 	}
-	return semncnt;
+	return semcnt;
 }
 
-static int count_semzcnt (struct sem_array * sma, ushort semnum)
+static int count_semncnt (struct sem_array * sma, ushort semnum)
 {
-	int semzcnt;
-	struct sem_queue * q;
+	return count_semcnt(&sma->sem_pending, semnum, 0) +
+	       count_semcnt(&sma->sem_base[semnum].sem_pending, semnum, 0);
+}
 
-	semzcnt = 0;
-	list_for_each_entry(q, &sma->sem_pending, list) {
-		struct sembuf * sops = q->sops;
-		int nsops = q->nsops;
-		int i;
-		for (i = 0; i < nsops; i++)
-			if (sops[i].sem_num == semnum
-			    && (sops[i].sem_op == 0)
-			    && !(sops[i].sem_flg & IPC_NOWAIT))
-				semzcnt++;
-	}
-	return semzcnt;
+static int count_semzcnt (struct sem_array * sma, ushort semnum)
+{
+	return count_semcnt(&sma->sem_pending, semnum, 1) +
+	       count_semcnt(&sma->sem_base[semnum].sem_pending, semnum, 1);
 }
 
 static void free_un(struct rcu_head *head)
@@ -519,9 +672,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_undo *un, *tu;
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_wait_array(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -533,12 +688,16 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 
 	/* Wake up all pending processes and let them fail with EIDRM. */
 	list_for_each_entry_safe(q, tq, &sma->sem_pending, list) {
-		list_del(&q->list);
+		unlink_queue(sma, q);
+		wake_up_sem_queue(q, -EIDRM);
+	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = &sma->sem_base[i];
 
-		q->status = IN_WAKEUP;
-		wake_up_process(q->sleeper); /* doesn't sleep */
-		smp_wmb();
-		q->status = -EIDRM;	/* hands-off q */
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue(q, -EIDRM);
+		}
 	}
 
 	/* Remove the semaphore set from the IDR */
@@ -759,7 +918,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		}
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		err = 0;
 		goto out_unlock;
 	}
@@ -801,7 +960,7 @@ static int semctl_main(struct ipc_namespace *ns, int semid, int semnum,
 		curr->sempid = task_tgid_vnr(current);
 		sma->sem_ctime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		err = 0;
 		goto out_unlock;
 	}
@@ -1065,8 +1224,10 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sem_undo *un;
 	int undos = 0, alter = 0, max;
 	struct sem_queue queue;
+	struct list_head *pending;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
+	int locknum;
 
 	ns = current->nsproxy->ipc_ns;
 
@@ -1112,58 +1273,54 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
-	sma = sem_lock_check(ns, semid);
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
 		error = PTR_ERR(sma);
-		goto out_free;
-	}
-
-	/*
-	 * semid identifiers are not unique - find_alloc_undo may have
-	 * allocated an undo structure, it was invalidated by an RMID
-	 * and now a new array with received the same id. Check and fail.
-	 * This case can be detected checking un->semid. The existance of
-	 * "un" itself is guaranteed by rcu.
-	 */
-	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
+		goto out_rcu;
 	}
 
 	error = -EFBIG;
 	if (max >= sma->sem_nsems)
-		goto out_unlock_free;
+		goto out_rcu;
 
 	error = -EACCES;
 	if (ipcperms(&sma->sem_perm, alter ? S_IWUGO : S_IRUGO))
-		goto out_unlock_free;
+		goto out_rcu;
 
 	error = security_sem_semop(sma, sops, nsops, alter);
 	if (error)
+		goto out_rcu;
+
+	locknum = sem_lock_semop(sma, sops, nsops);
+
+	error = -EIDRM;
+	if (sma->sem_perm.deleted)
+		goto out_unlock_free;
+
+	/*
+	 * semid identifiers are not unique - find_alloc_undo may have
+	 * allocated an undo structure, it was invalidated by an RMID
+	 * and now a new array with received the same id. Check and fail.
+	 * This case can be detected checking un->semid. The existance of
+	 * "un" itself is guaranteed by rcu, and it cannot go away while
+	 * we hold a lock of the array:
+	 * - IPC_RMID takes the array lock and waits for the semaphore
+	 *   locks.
+	 * - exit_sem is impossible, it always operates on
+	 *   current (or a dead task).
+	 */
+	if (un && un->semid == -1)
 		goto out_unlock_free;
 
 	error = try_atomic_semop (sma, sops, nsops, un, task_tgid_vnr(current));
 	if (error <= 0) {
 		if (alter && error == 0)
-			update_queue (sma);
+			do_smart_update(sma, sops, nsops);
 		goto out_unlock_free;
 	}
 
@@ -1176,15 +1333,22 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
+	if (nsops == 1) {
+		pending = &sma->sem_base[sops->sem_num].sem_pending;
+	} else {
+		pending = &sma->sem_pending;
+		sma->complex_count++;
+	}
 	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
+		list_add_tail(&queue.list, pending);
 	else
-		list_add(&queue.list, &sma->sem_pending);
+		list_add(&queue.list, pending);
 
 	queue.status = -EINTR;
 	queue.sleeper = current;
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	sem_unlock_semop(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1203,14 +1367,19 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object_check(ns, semid);
 	if (IS_ERR(sma)) {
 		error = -EIDRM;
-		goto out_free;
+		goto out_rcu;
 	}
 
+	locknum = sem_lock_semop(sma, sops, nsops);
+
 	/*
-	 * If queue.status != -EINTR we are woken up by another process
+	 * If queue.status != -EINTR we are woken up by another process.
+	 * This includes IPC_RMID, which wakes up everybody before it
+	 * marks the array deleted.
 	 */
 	error = queue.status;
 	if (error != -EINTR) {
@@ -1222,10 +1391,12 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	 */
 	if (timeout && jiffies_left == 0)
 		error = -EAGAIN;
-	list_del(&queue.list);
+	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	sem_unlock_semop(sma, locknum);
+out_rcu:
+	rcu_read_unlock();
 out_free:
 	if(sops != fast_sops)
 		kfree(sops);
@@ -1351,7 +1522,7 @@ void exit_sem(struct task_struct *tsk)
 		}
 		sma->sem_otime = get_seconds();
 		/* maybe some queued-up processes were waiting for this */
-		update_queue(sma);
+		do_smart_update(sma, NULL, 0);
 		sem_unlock(sma);
 
 		call_rcu(&un->rcu, free_un);
@@ -715,6 +715,31 @@ struct kern_ipc_perm *ipc_lock(struct ipc_ids *ids, int id)
 	return out;
 }
 
+/**
+ * ipc_obtain_object_check - Look up an ipc structure without locking it
+ * @ids: IPC identifier set
+ * @id: ipc id to look for
+ *
+ * Look for an id in the ipc ids idr and check its sequence number, for
+ * callers that do their own locking of the object. Must be called with
+ * rcu_read_lock() held; the object may have been removed meanwhile, which
+ * the caller has to check with ->deleted once it holds its lock.
+ */
+
+struct kern_ipc_perm *ipc_obtain_object_check(struct ipc_ids *ids, int id)
+{
+	struct kern_ipc_perm *out;
+
+	out = idr_find(&ids->ipcs_idr, ipcid_to_idx(id));
+	if (out == NULL)
+		return ERR_PTR(-EINVAL);
+
+	if (ipc_checkid(out, id))
+		return ERR_PTR(-EIDRM);
+
+	return out;
+}
+
 struct kern_ipc_perm *ipc_lock_check(struct ipc_ids *ids, int id)
 {
 	struct kern_ipc_perm *out;
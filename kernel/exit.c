@@ -124,6 +124,9 @@ static void __exit_signal(struct task_struct *tsk)
 		sig->inblock += task_io_get_inblock(tsk);
 		sig->oublock += task_io_get_oublock(tsk);
 		task_io_accounting_add(&sig->ioac, &tsk->ioac);
+#ifdef CONFIG_NUMA_BALANCING
+		task_numa_stats_add(&sig->numa_stats, &tsk->numa_stats);
+#endif
 		sig->sum_sched_runtime += tsk->se.sum_exec_runtime;
 		sig = NULL; /* Marker for below. */
 	}
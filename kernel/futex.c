@@ -55,6 +55,9 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/log2.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -64,6 +67,13 @@ int __read_mostly futex_cmpxchg_enabled;
 
 #define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
 
+/*
+ * Size limits of the per-mm hash tables for PROCESS_PRIVATE futexes,
+ * which get four buckets per thread.
+ */
+#define FUTEX_PRIVATE_HASHBITS_MIN	4
+#define FUTEX_PRIVATE_HASHBITS_MAX	(CONFIG_BASE_SMALL ? 6 : 10)
+
 /*
  * Priority Inheritance state:
  */
@@ -125,15 +135,86 @@ struct futex_hash_bucket {
 
 static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
 
+/*
+ * PROCESS_PRIVATE futexes of a multi-threaded mm are hashed into a table
+ * of their own, so that they neither collide with the futexes of other
+ * processes nor share a bucket lock with them. Shared futexes and all PI
+ * futexes stay in futex_queues.
+ */
+struct futex_hash {
+	struct rcu_head rcu;
+	unsigned int bits;
+	struct futex_hash_bucket queues[0];
+};
+
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
+static inline u32 futex_key_hash(union futex_key *key)
+{
+	return jhash2((u32*)&key->both.word,
+		      (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
+		      key->both.offset);
+}
+
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
-	u32 hash = jhash2((u32*)&key->both.word,
-			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
-			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	return &futex_queues[futex_key_hash(key) & ((1 << FUTEX_HASHBITS)-1)];
+}
+
+static inline int futex_key_private(union futex_key *key)
+{
+	return !(key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED));
+}
+
+/*
+ * Find the bucket of a non-PI key: private keys go to the mm's own table
+ * if it has one. Must be called under rcu_read_lock() and the result
+ * validated against mm->futex_hash_seq once the bucket is locked.
+ */
+static struct futex_hash_bucket *__hash_futex(union futex_key *key)
+{
+	struct futex_hash *fh;
+
+	if (futex_key_private(key)) {
+		fh = rcu_dereference(key->private.mm->futex_hash);
+		if (fh)
+			return &fh->queues[futex_key_hash(key) &
+					   ((1 << fh->bits) - 1)];
+	}
+	return hash_futex(key);
+}
+
+static inline seqcount_t *futex_hash_seq(union futex_key *key)
+{
+	return futex_key_private(key) ? &key->private.mm->futex_hash_seq : NULL;
+}
+
+/*
+ * Lock the hash bucket of a non-PI key. The mm's private table cannot
+ * be replaced while one of its bucket locks is held, see
+ * futex_hash_grow().
+ */
+static struct futex_hash_bucket *lock_futex_hash(union futex_key *key)
+{
+	seqcount_t *seq = futex_hash_seq(key);
+	struct futex_hash_bucket *hb;
+	unsigned start = 0;
+
+again:
+	if (seq)
+		start = read_seqcount_begin(seq);
+	rcu_read_lock();
+	hb = __hash_futex(key);
+	spin_lock(&hb->lock);
+	if (seq && read_seqcount_retry(seq, start)) {
+		spin_unlock(&hb->lock);
+		rcu_read_unlock();
+		goto again;
+	}
+	rcu_read_unlock();
+
+	return hb;
 }
 
 /*
@@ -663,6 +744,33 @@ double_unlock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 		spin_unlock(&hb2->lock);
 }
 
+/*
+ * Lock the hash buckets of two non-PI keys of the same kind, see
+ * lock_futex_hash().
+ */
+static void double_lock_futex_hash(union futex_key *key1,
+				   union futex_key *key2,
+				   struct futex_hash_bucket **hb1,
+				   struct futex_hash_bucket **hb2)
+{
+	seqcount_t *seq = futex_hash_seq(key1);
+	unsigned start = 0;
+
+again:
+	if (seq)
+		start = read_seqcount_begin(seq);
+	rcu_read_lock();
+	*hb1 = __hash_futex(key1);
+	*hb2 = __hash_futex(key2);
+	double_lock_hb(*hb1, *hb2);
+	if (seq && read_seqcount_retry(seq, start)) {
+		double_unlock_hb(*hb1, *hb2);
+		rcu_read_unlock();
+		goto again;
+	}
+	rcu_read_unlock();
+}
+
 /*
  * Wake up waiters matching bitset queued on this futex (uaddr).
  */
@@ -681,8 +789,7 @@ static int futex_wake(u32 __user *uaddr, int fshared, int nr_wake, u32 bitset)
 	if (unlikely(ret != 0))
 		goto out;
 
-	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	hb = lock_futex_hash(&key);
 	head = &hb->chain;
 
 	plist_for_each_entry_safe(this, next, head, list) {
@@ -730,11 +837,8 @@ retry:
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
-
-	double_lock_hb(hb1, hb2);
 retry_private:
+	double_lock_futex_hash(&key1, &key2, &hb1, &hb2);
 	op_ret = futex_atomic_op_inuser(op, uaddr2);
 	if (unlikely(op_ret < 0)) {
 		u32 dummy;
@@ -821,11 +925,8 @@ retry:
 	if (unlikely(ret != 0))
 		goto out_put_key1;
 
-	hb1 = hash_futex(&key1);
-	hb2 = hash_futex(&key2);
-
 retry_private:
-	double_lock_hb(hb1, hb2);
+	double_lock_futex_hash(&key1, &key2, &hb1, &hb2);
 
 	if (likely(cmpval != NULL)) {
 		u32 curval;
@@ -907,6 +1008,20 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 
 	init_waitqueue_head(&q->waiter);
 
+	get_futex_key_refs(&q->key);
+	hb = lock_futex_hash(&q->key);
+	q->lock_ptr = &hb->lock;
+
+	return hb;
+}
+
+/* PI futexes always live in the global hash, see exit_pi_state_list(). */
+static inline struct futex_hash_bucket *queue_lock_pi(struct futex_q *q)
+{
+	struct futex_hash_bucket *hb;
+
+	init_waitqueue_head(&q->waiter);
+
 	get_futex_key_refs(&q->key);
 	hb = hash_futex(&q->key);
 	q->lock_ptr = &hb->lock;
@@ -956,7 +1071,12 @@ static int unqueue_me(struct futex_q *q)
 	spinlock_t *lock_ptr;
 	int ret = 0;
 
-	/* In the common case we don't take the spinlock, which is nice. */
+	/*
+	 * In the common case we don't take the spinlock, which is nice.
+	 * The rcu read lock keeps a private hash table that we were moved
+	 * out of from being freed under us.
+	 */
+	rcu_read_lock();
 retry:
 	lock_ptr = q->lock_ptr;
 	barrier();
@@ -987,6 +1107,7 @@ retry:
 		spin_unlock(lock_ptr);
 		ret = 1;
 	}
+	rcu_read_unlock();
 
 	drop_futex_key_refs(&q->key);
 	return ret;
@@ -1300,6 +1421,180 @@ static long futex_wait_restart(struct restart_block *restart)
 }
 
 
+struct futex_wait_multiple {
+	struct futex_q q;
+	wait_queue_t wait;
+};
+
+/*
+ * Unqueue the first @count entries of @wm. Returns the index of the first
+ * one that had been woken, or -1.
+ */
+static int unqueue_multiple(struct futex_wait_multiple *wm, int count)
+{
+	int i, woken = -1;
+
+	for (i = 0; i < count; i++) {
+		if (!unqueue_me(&wm[i].q) && woken < 0)
+			woken = i;
+	}
+	return woken;
+}
+
+/*
+ * Queue the task on all futexes, checking each value under its bucket
+ * lock like futex_wait() does. Returns 0 when all are queued, the index
+ * of a futex that was woken meanwhile, or a negative error with nothing
+ * left queued.
+ */
+static int queue_multiple(struct futex_wait_block *wb,
+			  struct futex_wait_multiple *wm, int count)
+{
+	struct futex_hash_bucket *hb;
+	u32 uval;
+	int i, ret;
+
+retry:
+	for (i = 0; i < count; i++) {
+		hb = queue_lock(&wm[i].q);
+
+		ret = get_futex_value_locked(&uval, wb[i].uaddr);
+		if (unlikely(ret)) {
+			queue_unlock(&wm[i].q, hb);
+
+			ret = unqueue_multiple(wm, i);
+			if (ret >= 0)
+				return ret + 1;
+
+			if (get_user(uval, wb[i].uaddr))
+				return -EFAULT;
+			goto retry;
+		}
+		if (uval != wb[i].val) {
+			queue_unlock(&wm[i].q, hb);
+
+			ret = unqueue_multiple(wm, i);
+			return ret >= 0 ? ret + 1 : -EWOULDBLOCK;
+		}
+
+		init_waitqueue_entry(&wm[i].wait, current);
+		add_wait_queue(&wm[i].q.waiter, &wm[i].wait);
+		queue_me(&wm[i].q, hb);
+	}
+	return 0;
+}
+
+/*
+ * Wait on several futexes at once and return the index of the one that
+ * was woken. A futex_q is queued on every futex before the task goes to
+ * sleep, so a wakeup on any of them that comes after its value was
+ * checked is seen. If more than one is woken before the task unqueues
+ * itself, the lowest index is returned and the other wakeups are
+ * consumed, just as a single FUTEX_WAIT can absorb a wakeup.
+ */
+static int futex_wait_multiple(u32 __user *uaddr, int fshared, u32 count,
+			       ktime_t *abs_time, int clockrt)
+{
+	struct futex_wait_block *wb;
+	struct futex_wait_multiple *wm;
+	struct hrtimer_sleeper t;
+	int i, ret, woken, rem = 0;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return -EINVAL;
+
+	wb = kmalloc(count * sizeof(*wb), GFP_KERNEL);
+	wm = kmalloc(count * sizeof(*wm), GFP_KERNEL);
+	ret = -ENOMEM;
+	if (!wb || !wm)
+		goto out_free;
+
+	ret = -EFAULT;
+	if (copy_from_user(wb, uaddr, count * sizeof(*wb)))
+		goto out_free;
+
+	for (i = 0; i < count; i++) {
+		ret = -EINVAL;
+		if (!wb[i].bitset)
+			goto out_put_keys;
+		wm[i].q.pi_state = NULL;
+		wm[i].q.bitset = wb[i].bitset;
+		wm[i].q.key = FUTEX_KEY_INIT;
+		ret = get_futex_key(wb[i].uaddr, fshared, &wm[i].q.key);
+		if (unlikely(ret != 0))
+			goto out_put_keys;
+	}
+
+	ret = queue_multiple(wb, wm, count);
+	if (ret) {
+		/* a futex was woken while we queued: report it */
+		if (ret > 0)
+			ret--;
+		goto out_put_keys;
+	}
+
+	/*
+	 * Any futex_wake() from now on takes us off one of the queues
+	 * and then wakes us, so checking the queues after setting the
+	 * task state cannot miss a wakeup.
+	 */
+	set_current_state(TASK_INTERRUPTIBLE);
+	for (woken = 0, i = 0; i < count; i++)
+		if (plist_node_empty(&wm[i].q.list))
+			woken = 1;
+
+	if (!woken) {
+		if (!abs_time)
+			schedule();
+		else {
+			hrtimer_init_on_stack(&t.timer,
+					      clockrt ? CLOCK_REALTIME :
+					      CLOCK_MONOTONIC,
+					      HRTIMER_MODE_ABS);
+			hrtimer_init_sleeper(&t, current);
+			hrtimer_set_expires_range_ns(&t.timer, *abs_time,
+						     current->timer_slack_ns);
+
+			hrtimer_start_expires(&t.timer, HRTIMER_MODE_ABS);
+			if (!hrtimer_active(&t.timer))
+				t.task = NULL;
+
+			if (likely(t.task))
+				schedule();
+
+			hrtimer_cancel(&t.timer);
+
+			/* Flag if a timeout occured */
+			rem = (t.task == NULL);
+
+			destroy_hrtimer_on_stack(&t.timer);
+		}
+	}
+	__set_current_state(TASK_RUNNING);
+
+	/* If we were woken (and unqueued), we succeeded, whatever. */
+	ret = unqueue_multiple(wm, count);
+	if (ret >= 0)
+		goto out_put_keys;
+
+	if (rem)
+		ret = -ETIMEDOUT;
+	else
+		/*
+		 * The timeout is absolute, so the call can simply be
+		 * restarted with the same arguments.
+		 */
+		ret = -ERESTARTSYS;
+
+out_put_keys:
+	while (--i >= 0)
+		put_futex_key(fshared, &wm[i].q.key);
+out_free:
+	kfree(wm);
+	kfree(wb);
+	return ret;
+}
+
 /*
  * Userspace tried a 0 -> TID atomic transition of the futex value
  * and failed. The kernel side here does the whole locking operation:
@@ -1335,7 +1630,7 @@ retry:
 		goto out;
 
 retry_private:
-	hb = queue_lock(&q);
+	hb = queue_lock_pi(&q);
 
 retry_locked:
 	ret = lock_taken = 0;
@@ -1894,7 +2189,7 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		fshared = 1;
 
 	clockrt = op & FUTEX_CLOCK_REALTIME;
-	if (clockrt && cmd != FUTEX_WAIT_BITSET)
+	if (clockrt && cmd != FUTEX_WAIT_BITSET && cmd != FUTEX_WAIT_MULTIPLE)
 		return -ENOSYS;
 
 	switch (cmd) {
@@ -1929,6 +2224,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		if (futex_cmpxchg_enabled)
 			ret = futex_lock_pi(uaddr, fshared, 0, timeout, 1);
 		break;
+	case FUTEX_WAIT_MULTIPLE:
+		ret = futex_wait_multiple(uaddr, fshared, val, timeout, clockrt);
+		break;
 	default:
 		ret = -ENOSYS;
 	}
@@ -1946,7 +2244,7 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	int cmd = op & FUTEX_CMD_MASK;
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
-		      cmd == FUTEX_WAIT_BITSET)) {
+		      cmd == FUTEX_WAIT_BITSET || cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (copy_from_user(&ts, utime, sizeof(ts)) != 0)
 			return -EFAULT;
 		if (!timespec_valid(&ts))
@@ -1968,6 +2266,220 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+/*
+ * Move the queued non-PI waiters on private futexes of @mm from @hb to
+ * their bucket in @fh.
+ */
+static void futex_rehash_bucket(struct mm_struct *mm,
+				struct futex_hash_bucket *hb,
+				struct futex_hash *fh)
+{
+	struct futex_hash_bucket *nhb;
+	struct futex_q *this, *next;
+
+	spin_lock(&hb->lock);
+	plist_for_each_entry_safe(this, next, &hb->chain, list) {
+		if (this->pi_state || !futex_key_private(&this->key) ||
+		    this->key.private.mm != mm)
+			continue;
+
+		nhb = &fh->queues[futex_key_hash(&this->key) &
+				  ((1 << fh->bits) - 1)];
+		spin_lock_nested(&nhb->lock, SINGLE_DEPTH_NESTING);
+		plist_del(&this->list, &hb->chain);
+		plist_add(&this->list, &nhb->chain);
+		this->lock_ptr = &nhb->lock;
+#ifdef CONFIG_DEBUG_PI_LIST
+		this->list.plist.lock = &nhb->lock;
+#endif
+		spin_unlock(&nhb->lock);
+	}
+	spin_unlock(&hb->lock);
+}
+
+static void futex_hash_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct futex_hash, rcu));
+}
+
+/**
+ * futex_hash_grow - size the private futex hash of an mm for its threads
+ * @mm: the mm that just gained a user
+ *
+ * Called when a task is cloned with CLONE_VM. Once an mm is shared, its
+ * PROCESS_PRIVATE futexes get a hash table of their own with four buckets
+ * per thread, which is grown as threads are added. Waiters already queued
+ * are moved to the new table with every bucket they may be found in
+ * locked, while futex_hash_seq makes lookups that raced with the switch
+ * try again. The old table is freed after a grace period because
+ * unqueue_me() may still be spinning on one of its locks.
+ *
+ * Allocation failures are not fatal: the old table stays in use.
+ */
+void futex_hash_grow(struct mm_struct *mm)
+{
+	unsigned int threads = atomic_read(&mm->mm_users);
+	struct futex_hash *fh, *old;
+	unsigned int bits;
+	int i;
+
+	bits = ilog2(roundup_pow_of_two(4 * threads));
+	bits = clamp_t(unsigned int, bits, FUTEX_PRIVATE_HASHBITS_MIN,
+		       FUTEX_PRIVATE_HASHBITS_MAX);
+
+	rcu_read_lock();
+	old = rcu_dereference(mm->futex_hash);
+	if (old && old->bits >= bits) {
+		rcu_read_unlock();
+		return;
+	}
+	rcu_read_unlock();
+
+	fh = kmalloc(sizeof(*fh) + (sizeof(struct futex_hash_bucket) << bits),
+		     GFP_KERNEL);
+	if (!fh)
+		return;
+	fh->bits = bits;
+	for (i = 0; i < 1 << bits; i++) {
+		plist_head_init(&fh->queues[i].chain, &fh->queues[i].lock);
+		spin_lock_init(&fh->queues[i].lock);
+	}
+
+	spin_lock(&mm->futex_hash_lock);
+	old = mm->futex_hash;
+	if (old && old->bits >= bits) {
+		spin_unlock(&mm->futex_hash_lock);
+		kfree(fh);
+		return;
+	}
+
+	write_seqcount_begin(&mm->futex_hash_seq);
+	rcu_assign_pointer(mm->futex_hash, fh);
+	if (old) {
+		for (i = 0; i < 1 << old->bits; i++)
+			futex_rehash_bucket(mm, &old->queues[i], fh);
+	} else if (threads > 2) {
+		/*
+		 * Other users of the mm may already be waiting on private
+		 * futexes in the global hash. With just the parent and the
+		 * child being cloned, nobody can be.
+		 */
+		for (i = 0; i < ARRAY_SIZE(futex_queues); i++)
+			futex_rehash_bucket(mm, &futex_queues[i], fh);
+	}
+	write_seqcount_end(&mm->futex_hash_seq);
+	spin_unlock(&mm->futex_hash_lock);
+
+	if (old)
+		call_rcu(&old->rcu, futex_hash_free_rcu);
+}
+
+/*
+ * The last reference to the mm is gone, so nobody can be queued on its
+ * private futexes any more.
+ */
+void futex_hash_free(struct mm_struct *mm)
+{
+	kfree(mm->futex_hash);
+}
+
+#ifdef CONFIG_DEBUG_FS
+struct futex_hash_stats {
+	unsigned int used, collisions, longest;
+	unsigned long waiters;
+};
+
+/*
+ * Print the buckets of one table that have waiters: the number of waiters
+ * and of distinct futexes, each futex beyond the first being a collision.
+ */
+static void futex_hash_show_table(struct seq_file *m, const char *name,
+				  struct futex_hash_bucket *queues,
+				  unsigned int size)
+{
+	struct futex_hash_stats st = { 0, };
+	struct futex_q *this, *prev;
+	unsigned int i, waiters, keys;
+
+	seq_printf(m, "%s: %u buckets\n", name, size);
+	seq_printf(m, "  bucket waiters futexes\n");
+	for (i = 0; i < size; i++) {
+		struct futex_hash_bucket *hb = &queues[i];
+
+		waiters = keys = 0;
+		spin_lock(&hb->lock);
+		plist_for_each_entry(this, &hb->chain, list) {
+			waiters++;
+			keys++;
+			plist_for_each_entry(prev, &hb->chain, list) {
+				if (prev == this)
+					break;
+				if (match_futex(&prev->key, &this->key)) {
+					keys--;
+					break;
+				}
+			}
+		}
+		spin_unlock(&hb->lock);
+
+		if (!waiters)
+			continue;
+		seq_printf(m, "  %6u %7u %7u\n", i, waiters, keys);
+		st.used++;
+		st.waiters += waiters;
+		st.collisions += keys - 1;
+		st.longest = max(st.longest, waiters);
+	}
+	seq_printf(m, "  %u buckets used, %lu waiters, %u collisions, "
+		   "longest chain %u\n", st.used, st.waiters, st.collisions,
+		   st.longest);
+}
+
+/*
+ * futex_hash shows the global table and the private table of the mm of
+ * the reading task, so a benchmark can inspect its own futexes.
+ */
+static int futex_hash_show(struct seq_file *m, void *v)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash *fh;
+
+	futex_hash_show_table(m, "global", futex_queues,
+			      ARRAY_SIZE(futex_queues));
+
+	if (!mm)
+		return 0;
+	rcu_read_lock();
+	fh = rcu_dereference(mm->futex_hash);
+	if (fh)
+		futex_hash_show_table(m, "private", fh->queues, 1 << fh->bits);
+	rcu_read_unlock();
+
+	return 0;
+}
+
+static int futex_hash_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_hash_show, NULL);
+}
+
+static const struct file_operations futex_hash_fops = {
+	.open		= futex_hash_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void __init futex_debugfs_init(void)
+{
+	debugfs_create_file("futex_hash", 0444, NULL, NULL, &futex_hash_fops);
+}
+#else
+static inline void futex_debugfs_init(void)
+{
+}
+#endif
+
 static int __init futex_init(void)
 {
 	u32 curval;
@@ -1992,6 +2504,8 @@ static int __init futex_init(void)
 		spin_lock_init(&futex_queues[i].lock);
 	}
 
+	futex_debugfs_init();
+
 	return 0;
 }
 __initcall(futex_init);
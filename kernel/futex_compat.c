@@ -170,6 +170,40 @@ err_unlock:
 	return ret;
 }
 
+struct compat_futex_wait_block {
+	compat_uptr_t uaddr;
+	u32 val;
+	u32 bitset;
+};
+
+/*
+ * Convert a FUTEX_WAIT_MULTIPLE array to the native layout on the user
+ * stack, where futex_wait_multiple() copies it from.
+ */
+static u32 __user *
+compat_futex_wait_blocks(struct compat_futex_wait_block __user *cwb, u32 count)
+{
+	struct futex_wait_block __user *wb;
+	compat_uptr_t uaddr;
+	u32 val, bitset;
+	int i;
+
+	if (!count || count > FUTEX_MULTIPLE_MAX_COUNT)
+		return ERR_PTR(-EINVAL);
+
+	wb = compat_alloc_user_space(count * sizeof(*wb));
+	for (i = 0; i < count; i++) {
+		if (get_user(uaddr, &cwb[i].uaddr) ||
+		    get_user(val, &cwb[i].val) ||
+		    get_user(bitset, &cwb[i].bitset) ||
+		    put_user(compat_ptr(uaddr), &wb[i].uaddr) ||
+		    put_user(val, &wb[i].val) ||
+		    put_user(bitset, &wb[i].bitset))
+			return ERR_PTR(-EFAULT);
+	}
+	return (u32 __user *)wb;
+}
+
 asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 		struct compat_timespec __user *utime, u32 __user *uaddr2,
 		u32 val3)
@@ -180,7 +214,7 @@ asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 	int cmd = op & FUTEX_CMD_MASK;
 
 	if (utime && (cmd == FUTEX_WAIT || cmd == FUTEX_LOCK_PI ||
-		      cmd == FUTEX_WAIT_BITSET)) {
+		      cmd == FUTEX_WAIT_BITSET || cmd == FUTEX_WAIT_MULTIPLE)) {
 		if (get_compat_timespec(&ts, utime))
 			return -EFAULT;
 		if (!timespec_valid(&ts))
@@ -194,5 +228,11 @@ asmlinkage long compat_sys_futex(u32 __user *uaddr, int op, u32 val,
 	if (cmd == FUTEX_REQUEUE || cmd == FUTEX_CMP_REQUEUE)
 		val2 = (int) (unsigned long) utime;
 
+	if (cmd == FUTEX_WAIT_MULTIPLE) {
+		uaddr = compat_futex_wait_blocks((void __user *)uaddr, val);
+		if (IS_ERR(uaddr))
+			return PTR_ERR(uaddr);
+	}
+
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
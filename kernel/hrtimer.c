@@ -1153,6 +1153,7 @@ static void __run_hrtimer(struct hrtimer *timer)
 	debug_hrtimer_deactivate(timer);
 	__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
 	timer_stats_account_hrtimer(timer);
+	cpu_base->nr_expired++;
 	fn = timer->function;
 
 	/*
@@ -1378,8 +1379,13 @@ void hrtimer_run_queues(void)
 			struct hrtimer *timer;
 
 			timer = rb_entry(node, struct hrtimer, node);
-			if (base->softirq_time.tv64 <=
-					hrtimer_get_expires_tv64(timer))
+			/*
+			 * As in hrtimer_interrupt(), run the timers whose
+			 * soft expiry passed with this tick, the next event
+			 * is based on the hard expiry of the others.
+			 */
+			if (base->softirq_time.tv64 <
+					hrtimer_get_softexpires_tv64(timer))
 				break;
 
 			__run_hrtimer(timer);
@@ -50,6 +50,19 @@ struct kthread_stop_info
 static DEFINE_MUTEX(kthread_stop_lock);
 static struct kthread_stop_info kthread_stop_info;
 
+/*
+ * Per-thread part of kthread(), kept on its stack for as long as the
+ * thread lives.  ->vfork_done of a kthread points at ->exited, which
+ * lets kthread_data() find it from the task.
+ */
+struct kthread {
+	void *data;
+	struct completion exited;
+};
+
+#define to_kthread(tsk)	\
+	container_of((tsk)->vfork_done, struct kthread, exited)
+
 /**
  * kthread_should_stop - should this kthread return now?
  *
@@ -63,16 +76,31 @@ int kthread_should_stop(void)
 }
 EXPORT_SYMBOL(kthread_should_stop);
 
+/**
+ * kthread_data - return data value specified on kthread creation
+ * @task: kthread task in question
+ *
+ * Return the data value specified when kthread @task was created.
+ * The caller is responsible for ensuring the validity of @task when
+ * calling this function.
+ */
+void *kthread_data(struct task_struct *task)
+{
+	return to_kthread(task)->data;
+}
+
 static int kthread(void *_create)
 {
 	struct kthread_create_info *create = _create;
 	int (*threadfn)(void *data);
-	void *data;
+	struct kthread self;
 	int ret = -EINTR;
 
 	/* Copy data: it's on kthread's stack */
 	threadfn = create->threadfn;
-	data = create->data;
+	self.data = create->data;
+	init_completion(&self.exited);
+	current->vfork_done = &self.exited;
 
 	/* OK, tell user we're spawned, wait for stop or wakeup */
 	__set_current_state(TASK_UNINTERRUPTIBLE);
@@ -81,14 +109,15 @@ static int kthread(void *_create)
 	schedule();
 
 	if (!kthread_should_stop())
-		ret = threadfn(data);
+		ret = threadfn(self.data);
 
 	/* It might have exited on its own, w/o kthread_stop.  Check. */
 	if (kthread_should_stop()) {
 		kthread_stop_info.err = ret;
 		complete(&kthread_stop_info.done);
 	}
-	return 0;
+	/* exit from here, @self has to stay valid until the very end */
+	do_exit(0);
 }
 
 static void create_kthread(struct kthread_create_info *create)
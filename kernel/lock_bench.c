@@ -0,0 +1,247 @@
+/*
+ * Lock contention and scaling benchmark
+ *
+ * Loading the module starts one thread per online CPU (or nr_threads of
+ * them), bound round robin to the online CPUs. Each thread takes one
+ * shared lock iterations times, touches hold_lines cache lines of shared
+ * data under it, and then works on private data for think_loops loop
+ * iterations before taking it again. The lock is an rw_semaphore, which
+ * is taken for writing write_pct percent of the time and for reading
+ * otherwise, a mutex and a spinlock. For each the wall time, the cost per
+ * acquisition and the number of context switches done by the threads are
+ * printed; a large number of switches per acquisition shows waiters going
+ * to sleep instead of spinning on a running owner.
+ *
+ * With scale=1 every lock is measured with 1, 2, 4, ... threads up to
+ * nr_threads, which shows how the cost of handing a lock over grows with
+ * the number of waiting CPUs.
+ *
+ * Example: modprobe lock_bench nr_threads=16 write_pct=20 hold_lines=4
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/rwsem.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#include <linux/cache.h>
+
+static int bench_threads;
+module_param_named(nr_threads, bench_threads, int, 0444);
+MODULE_PARM_DESC(nr_threads, "Number of threads (default: online CPUs)");
+
+static int iterations = 100000;
+module_param(iterations, int, 0444);
+MODULE_PARM_DESC(iterations, "Lock acquisitions per thread");
+
+static int write_pct = 100;
+module_param(write_pct, int, 0444);
+MODULE_PARM_DESC(write_pct, "Percentage of rwsem acquisitions for writing");
+
+static int hold_lines = 2;
+module_param(hold_lines, int, 0444);
+MODULE_PARM_DESC(hold_lines, "Shared cache lines written under the lock");
+
+static int think_loops = 100;
+module_param(think_loops, int, 0444);
+MODULE_PARM_DESC(think_loops, "Loop iterations between acquisitions");
+
+static int scale;
+module_param(scale, bool, 0444);
+MODULE_PARM_DESC(scale, "Run with 1, 2, 4, ... threads up to nr_threads");
+
+enum { BENCH_RWSEM, BENCH_MUTEX, BENCH_SPINLOCK, NR_BENCH };
+
+static const char *bench_name[] = { "rwsem", "mutex", "spinlock" };
+
+struct bench_line {
+	unsigned long val;
+} ____cacheline_aligned_in_smp;
+
+static struct bench_line *shared;
+
+static DECLARE_RWSEM(bench_rwsem);
+static DEFINE_MUTEX(bench_mutex);
+static DEFINE_SPINLOCK(bench_spinlock);
+
+struct bench_thread {
+	struct task_struct *task;
+	int mode;
+	unsigned int seed;
+	unsigned long switches;
+};
+
+static DECLARE_WAIT_QUEUE_HEAD(bench_start_wait);
+static DECLARE_COMPLETION(bench_done);
+static atomic_t bench_running;
+static int bench_go;
+
+static void bench_hold(int write)
+{
+	int i;
+
+	for (i = 0; i < hold_lines; i++) {
+		if (write)
+			shared[i].val++;
+		else
+			ACCESS_ONCE(shared[i].val);
+	}
+}
+
+static void bench_think(void)
+{
+	volatile unsigned long sink = 0;
+	int i;
+
+	for (i = 0; i < think_loops; i++)
+		sink += i;
+}
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned long switches;
+	int i, write;
+
+	wait_event(bench_start_wait, bench_go || kthread_should_stop());
+	if (!bench_go)
+		return 0;
+
+	switches = current->nvcsw + current->nivcsw;
+	for (i = 0; i < iterations; i++) {
+		switch (bt->mode) {
+		case BENCH_RWSEM:
+			bt->seed = bt->seed * 1103515245 + 12345;
+			write = (bt->seed >> 16) % 100 < write_pct;
+			if (write)
+				down_write(&bench_rwsem);
+			else
+				down_read(&bench_rwsem);
+			bench_hold(write);
+			if (write)
+				up_write(&bench_rwsem);
+			else
+				up_read(&bench_rwsem);
+			break;
+		case BENCH_MUTEX:
+			mutex_lock(&bench_mutex);
+			bench_hold(1);
+			mutex_unlock(&bench_mutex);
+			break;
+		case BENCH_SPINLOCK:
+			spin_lock(&bench_spinlock);
+			bench_hold(1);
+			spin_unlock(&bench_spinlock);
+			break;
+		}
+		bench_think();
+	}
+	bt->switches = current->nvcsw + current->nivcsw - switches;
+
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+
+	/* stay around until the result has been collected */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static void bench_run(struct bench_thread *bt, int mode, int nr)
+{
+	unsigned long long ns, ops, switches = 0;
+	ktime_t start;
+	int cpu = -1;
+	int i;
+
+	bench_go = 0;
+	INIT_COMPLETION(bench_done);
+	atomic_set(&bench_running, nr);
+
+	for (i = 0; i < nr; i++) {
+		bt[i].mode = mode;
+		bt[i].seed = i + 1;
+		bt[i].task = kthread_create(bench_thread_fn, &bt[i],
+					    "lock_bench/%d", i);
+		if (IS_ERR(bt[i].task)) {
+			printk(KERN_ERR "lock_bench: cannot start thread\n");
+			while (--i >= 0)
+				kthread_stop(bt[i].task);
+			return;
+		}
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(bt[i].task, cpu);
+		wake_up_process(bt[i].task);
+	}
+
+	start = ktime_get();
+	bench_go = 1;
+	wake_up_all(&bench_start_wait);
+	wait_for_completion(&bench_done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < nr; i++) {
+		switches += bt[i].switches;
+		kthread_stop(bt[i].task);
+	}
+
+	ops = (unsigned long long)nr * iterations;
+	printk(KERN_INFO "lock_bench: %s: %d threads: %llu ops in %llu ms, "
+	       "%llu ns per acquisition per thread, %llu context switches\n",
+	       bench_name[mode], nr, ops,
+	       div_u64(ns, NSEC_PER_MSEC), div64_u64(ns * nr, ops),
+	       switches);
+}
+
+static int __init lock_bench_init(void)
+{
+	struct bench_thread *bt;
+	int mode, nr;
+
+	if (bench_threads <= 0)
+		bench_threads = num_online_cpus();
+	if (iterations <= 0 || hold_lines < 0 || think_loops < 0 ||
+	    write_pct < 0 || write_pct > 100)
+		return -EINVAL;
+
+	bt = kcalloc(bench_threads, sizeof(*bt), GFP_KERNEL);
+	shared = kcalloc(max(hold_lines, 1), sizeof(*shared), GFP_KERNEL);
+	if (!bt || !shared) {
+		kfree(bt);
+		kfree(shared);
+		return -ENOMEM;
+	}
+
+	for (mode = 0; mode < NR_BENCH; mode++) {
+		for (nr = scale ? 1 : bench_threads; nr < bench_threads; nr *= 2)
+			bench_run(bt, mode, nr);
+		bench_run(bt, mode, bench_threads);
+	}
+
+	kfree(shared);
+	kfree(bt);
+	return 0;
+}
+
+static void __exit lock_bench_exit(void)
+{
+}
+
+module_init(lock_bench_init);
+module_exit(lock_bench_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Lock contention and scaling benchmark");
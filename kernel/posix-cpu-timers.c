@@ -1375,6 +1375,22 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return sig->rlim[RLIMIT_CPU].rlim_cur != RLIM_INFINITY;
 }
 
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+/*
+ * CPU timers are run from the tick, which must not be stopped while a
+ * task that has some armed runs.
+ */
+int posix_cpu_timers_need_tick(struct task_struct *tsk)
+{
+	if (unlikely(tsk->exit_state))
+		return 0;
+
+	return !task_cputime_zero(&tsk->cputime_expires) ||
+	       !task_cputime_zero(&tsk->signal->cputime_expires) ||
+	       tsk->signal->rlim[RLIMIT_CPU].rlim_cur != RLIM_INFINITY;
+}
+#endif
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -45,6 +45,9 @@
 #include <linux/cpu.h>
 #include <linux/mutex.h>
 #include <linux/time.h>
+#include <linux/kthread.h>
+#include <linux/tick.h>
+#include <trace/rcu.h>
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 static struct lock_class_key rcu_lock_key;
@@ -55,8 +58,8 @@ EXPORT_SYMBOL_GPL(rcu_lock_map);
 
 /* Data structures. */
 
-#define RCU_STATE_INITIALIZER(name) { \
-	.level = { &name.node[0] }, \
+#define RCU_STATE_INITIALIZER(structname) { \
+	.level = { &structname.node[0] }, \
 	.levelcnt = { \
 		NUM_RCU_LVL_0,  /* root of hierarchy. */ \
 		NUM_RCU_LVL_1, \
@@ -66,10 +69,11 @@ EXPORT_SYMBOL_GPL(rcu_lock_map);
 	.signaled = RCU_SIGNAL_INIT, \
 	.gpnum = -300, \
 	.completed = -300, \
-	.onofflock = __SPIN_LOCK_UNLOCKED(&name.onofflock), \
-	.fqslock = __SPIN_LOCK_UNLOCKED(&name.fqslock), \
+	.onofflock = __SPIN_LOCK_UNLOCKED(&structname.onofflock), \
+	.fqslock = __SPIN_LOCK_UNLOCKED(&structname.fqslock), \
 	.n_force_qs = 0, \
 	.n_force_qs_ngp = 0, \
+	.name = #structname, \
 }
 
 struct rcu_state rcu_state = RCU_STATE_INITIALIZER(rcu_state);
@@ -109,8 +113,116 @@ static int blimit = 10;		/* Maximum callbacks per softirq. */
 static int qhimark = 10000;	/* If this many pending, ignore blimit. */
 static int qlowmark = 100;	/* Once only this many pending, use blimit. */
 
+DEFINE_TRACE(rcu_batch_start);
+DEFINE_TRACE(rcu_batch_end);
+
 static void force_quiescent_state(struct rcu_state *rsp, int relaxed);
 
+#ifdef CONFIG_RCU_CB_OFFLOAD
+
+/*
+ * Callback offloading.  The callbacks queued on the CPUs in rcu_offload=
+ * do not go through the callback lists of the grace-period machinery of
+ * these CPUs but onto a list of their own, from which a kthread per CPU
+ * and flavor of RCU takes them, waits for a grace period on them with an
+ * ordinary callback and invokes them.  Neither the grace-period tracking
+ * nor the tick of the CPU is involved in handling them.
+ */
+static DECLARE_BITMAP(rcu_offload_bits, CONFIG_NR_CPUS);
+#define rcu_offload_mask to_cpumask(rcu_offload_bits)
+
+static int __init rcu_offload_setup(char *str)
+{
+	cpulist_parse(str, rcu_offload_mask);
+	return 1;
+}
+__setup("rcu_offload=", rcu_offload_setup);
+
+/*
+ * Hand a callback to the offload kthread of this CPU, if it has one.
+ * Called with irqs disabled, flags are the ones our caller had.  As
+ * call_rcu() may be called with scheduler locks held, the kthread is
+ * only woken up right away if irqs were enabled, else from softirq.
+ */
+static int rcu_offload_enqueue(struct rcu_data *rdp, struct rcu_head *head,
+			       unsigned long flags)
+{
+	struct task_struct *t = rdp->nocb_task;
+	int was_empty;
+
+	if (!t)
+		return 0;
+
+	spin_lock(&rdp->nocb_lock);
+	was_empty = !rdp->nocb_head;
+	*rdp->nocb_tail = head;
+	rdp->nocb_tail = &head->next;
+	atomic_long_inc(&rdp->nocb_qlen);
+	spin_unlock(&rdp->nocb_lock);
+
+	if (was_empty) {
+		if (irqs_disabled_flags(flags))
+			rdp->nocb_defer_wakeup = 1;
+		else
+			wake_up_process(t);
+	}
+	return 1;
+}
+
+static void rcu_offload_deferred_wakeup(struct rcu_data *rdp)
+{
+	if (rdp->nocb_defer_wakeup) {
+		rdp->nocb_defer_wakeup = 0;
+		wake_up_process(rdp->nocb_task);
+	}
+}
+
+static int rcu_offload_pending(struct rcu_data *rdp)
+{
+	return rdp->nocb_defer_wakeup;
+}
+
+/*
+ * Wait for the kthread of a CPU that went offline to invoke the callbacks
+ * queued there, so that rcu_barrier() on the remaining CPUs covers them.
+ * A wakeup deferred on the dead CPU will not be done by its softirq any
+ * more, do it here.
+ */
+static void rcu_offload_drain(struct rcu_data *rdp)
+{
+	if (!rdp->nocb_task)
+		return;
+
+	rdp->nocb_defer_wakeup = 0;
+	wake_up_process(rdp->nocb_task);
+	while (atomic_long_read(&rdp->nocb_qlen))
+		schedule_timeout_uninterruptible(1);
+}
+
+#else /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
+static inline int rcu_offload_enqueue(struct rcu_data *rdp,
+				      struct rcu_head *head,
+				      unsigned long flags)
+{
+	return 0;
+}
+
+static inline void rcu_offload_deferred_wakeup(struct rcu_data *rdp)
+{
+}
+
+static inline int rcu_offload_pending(struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static inline void rcu_offload_drain(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 /*
  * Return the number of RCU batches processed thus far for debug & stats.
  */
@@ -181,11 +293,17 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
 		return 1;
 	}
 
-	/* The CPU is online, so send it a reschedule IPI. */
-	if (rdp->cpu != smp_processor_id())
-		smp_send_reschedule(rdp->cpu);
-	else
+	/*
+	 * The CPU is online, so send it a reschedule IPI. A CPU that stopped
+	 * its tick for a busy task would not notice that, kick it into
+	 * restarting the tick instead.
+	 */
+	if (rdp->cpu == smp_processor_id())
 		set_need_resched();
+	else if (tick_nohz_adaptive_cpu(rdp->cpu))
+		tick_nohz_adaptive_kick(rdp->cpu);
+	else
+		smp_send_reschedule(rdp->cpu);
 	rdp->resched_ipi++;
 	return 0;
 }
@@ -878,6 +996,8 @@ static void rcu_offline_cpu(int cpu)
 {
 	__rcu_offline_cpu(cpu, &rcu_state);
 	__rcu_offline_cpu(cpu, &rcu_bh_state);
+	rcu_offload_drain(&per_cpu(rcu_data, cpu));
+	rcu_offload_drain(&per_cpu(rcu_bh_data, cpu));
 }
 
 #else /* #ifdef CONFIG_HOTPLUG_CPU */
@@ -892,16 +1012,21 @@ static void rcu_offline_cpu(int cpu)
  * Invoke any RCU callbacks that have made it to the end of their grace
  * period.  Thottle as specified by rdp->blimit.
  */
-static void rcu_do_batch(struct rcu_data *rdp)
+static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 {
 	unsigned long flags;
 	struct rcu_head *next, *list, **tail;
-	int count;
+	int count, invoked;
 
 	/* If no callbacks are ready, just return.*/
 	if (!cpu_has_callbacks_ready_to_invoke(rdp))
 		return;
 
+	/* Pick up changes of the blimit parameter. */
+	if (rdp->blimit != LONG_MAX)
+		rdp->blimit = max(blimit, 1);
+	trace_rcu_batch_start(rsp->name, rdp->cpu, rdp->qlen, rdp->blimit);
+
 	/*
 	 * Extract the list of ready callbacks, disabling to prevent
 	 * races with call_rcu() from interrupt handlers.
@@ -926,6 +1051,7 @@ static void rcu_do_batch(struct rcu_data *rdp)
 		if (++count >= rdp->blimit)
 			break;
 	}
+	invoked = count;
 
 	local_irq_save(flags);
 
@@ -947,6 +1073,8 @@ static void rcu_do_batch(struct rcu_data *rdp)
 
 	local_irq_restore(flags);
 
+	trace_rcu_batch_end(rsp->name, rdp->cpu, invoked, rdp->qlen);
+
 	/* Re-raise the RCU softirq if there are callbacks remaining. */
 	if (cpu_has_callbacks_ready_to_invoke(rdp))
 		raise_softirq(RCU_SOFTIRQ);
@@ -1154,8 +1282,11 @@ __rcu_process_callbacks(struct rcu_state *rsp, struct rcu_data *rdp)
 		rcu_start_gp(rsp, flags);  /* releases above lock */
 	}
 
+	/* Wake up the offload kthread if call_rcu() could not. */
+	rcu_offload_deferred_wakeup(rdp);
+
 	/* If there are callbacks ready, invoke them. */
-	rcu_do_batch(rdp);
+	rcu_do_batch(rsp, rdp);
 }
 
 /*
@@ -1183,7 +1314,7 @@ static void rcu_process_callbacks(struct softirq_action *unused)
 
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, int offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1201,6 +1332,10 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	 */
 	local_irq_save(flags);
 	rdp = rsp->rda[smp_processor_id()];
+	if (offload && rcu_offload_enqueue(rdp, head, flags)) {
+		local_irq_restore(flags);
+		return;
+	}
 	rcu_process_gp_end(rsp, rdp);
 	check_for_new_grace_period(rsp, rdp);
 
@@ -1231,7 +1366,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_state);
+	__call_rcu(head, func, &rcu_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -1240,10 +1375,151 @@ EXPORT_SYMBOL_GPL(call_rcu);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, 1);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
+#ifdef CONFIG_RCU_CB_OFFLOAD
+
+/*
+ * Wait for a grace period from an offload kthread.  The callback must not
+ * be offloaded itself, it might end up behind the ones we wait for.
+ */
+static void rcu_offload_wait_gp(struct rcu_state *rsp)
+{
+	struct rcu_synchronize rcu;
+
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rsp, 0);
+	wait_for_completion(&rcu.completion);
+}
+
+/*
+ * Invoke a list of callbacks whose grace period has ended, in batches of
+ * blimit callbacks with bottom halves disabled as in softirq.
+ */
+static void rcu_offload_invoke(struct rcu_state *rsp, struct rcu_data *rdp,
+			       struct rcu_head *list)
+{
+	struct rcu_head *next;
+	long limit, count;
+
+	while (list) {
+		limit = max(ACCESS_ONCE(blimit), 1);
+		trace_rcu_batch_start(rsp->name, rdp->cpu,
+				      atomic_long_read(&rdp->nocb_qlen), limit);
+		local_bh_disable();
+		for (count = 0; list && count < limit; count++) {
+			next = list->next;
+			prefetch(next);
+			list->func(list);
+			list = next;
+		}
+		local_bh_enable();
+		atomic_long_sub(count, &rdp->nocb_qlen);
+		trace_rcu_batch_end(rsp->name, rdp->cpu, count,
+				    atomic_long_read(&rdp->nocb_qlen));
+		cond_resched();
+	}
+}
+
+static int rcu_offload_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_state *rsp;
+	struct rcu_head *list;
+	unsigned long flags;
+
+	if (rdp == &per_cpu(rcu_data, rdp->cpu))
+		rsp = &rcu_state;
+	else
+		rsp = &rcu_bh_state;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!ACCESS_ONCE(rdp->nocb_head)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		spin_lock_irqsave(&rdp->nocb_lock, flags);
+		list = rdp->nocb_head;
+		rdp->nocb_head = NULL;
+		rdp->nocb_tail = &rdp->nocb_head;
+		spin_unlock_irqrestore(&rdp->nocb_lock, flags);
+
+		/* All of them were queued before this grace period began. */
+		rcu_offload_wait_gp(rsp);
+		rcu_offload_invoke(rsp, rdp, list);
+	}
+	return 0;
+}
+
+static void __init rcu_offload_spawn(struct rcu_state *rsp, int cpu,
+				     const char *namefmt,
+				     const struct cpumask *housekeeping)
+{
+	struct rcu_data *rdp = rsp->rda[cpu];
+	struct task_struct *t;
+
+	rdp->cpu = cpu;
+	spin_lock_init(&rdp->nocb_lock);
+	rdp->nocb_head = NULL;
+	rdp->nocb_tail = &rdp->nocb_head;
+	atomic_long_set(&rdp->nocb_qlen, 0);
+
+	t = kthread_run(rcu_offload_kthread, rdp, namefmt, cpu);
+	if (IS_ERR(t)) {
+		printk(KERN_ERR "RCU: cannot start %s offload kthread "
+		       "for CPU %d\n", rsp->name, cpu);
+		return;
+	}
+	if (housekeeping)
+		set_cpus_allowed_ptr(t, housekeeping);
+	/* From now on call_rcu() on this CPU hands callbacks to t. */
+	smp_wmb();
+	rdp->nocb_task = t;
+}
+
+static int __init rcu_offload_init(void)
+{
+	const struct cpumask *housekeeping = NULL;
+	cpumask_var_t mask;
+	char buf[128];
+	int cpu;
+
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+	/*
+	 * CPUs with an adaptive tick offload their callbacks, to kthreads
+	 * which are kept away from them.
+	 */
+	cpumask_or(rcu_offload_mask, rcu_offload_mask, tick_nohz_adaptive_mask);
+	if (!cpumask_empty(tick_nohz_adaptive_mask) &&
+	    alloc_cpumask_var(&mask, GFP_KERNEL)) {
+		cpumask_andnot(mask, cpu_possible_mask, tick_nohz_adaptive_mask);
+		housekeeping = mask;
+	}
+#endif
+
+	for_each_cpu(cpu, rcu_offload_mask) {
+		if (!cpu_possible(cpu))
+			continue;
+		rcu_offload_spawn(&rcu_state, cpu, "rcuo/%d", housekeeping);
+		rcu_offload_spawn(&rcu_bh_state, cpu, "rcuob/%d", housekeeping);
+	}
+	if (housekeeping)
+		free_cpumask_var(mask);
+	if (!cpumask_empty(rcu_offload_mask)) {
+		cpulist_scnprintf(buf, sizeof(buf), rcu_offload_mask);
+		printk(KERN_INFO "RCU callbacks offloaded for CPUs %s\n", buf);
+	}
+	return 0;
+}
+early_initcall(rcu_offload_init);
+
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+
 /*
  * Check to see if there is any immediate RCU-related work to be done
  * by the current CPU, for the specified type of RCU, returning 1 if so.
@@ -1262,6 +1538,10 @@ static int __rcu_pending(struct rcu_state *rsp, struct rcu_data *rdp)
 	if (rdp->qs_pending)
 		return 1;
 
+	/* Does the offload kthread of this CPU need to be woken up? */
+	if (rcu_offload_pending(rdp))
+		return 1;
+
 	/* Does this CPU have callbacks ready to invoke? */
 	if (cpu_has_callbacks_ready_to_invoke(rdp))
 		return 1;
@@ -1308,7 +1588,9 @@ int rcu_needs_cpu(int cpu)
 {
 	/* RCU callbacks either ready or pending? */
 	return per_cpu(rcu_data, cpu).nxtlist ||
-	       per_cpu(rcu_bh_data, cpu).nxtlist;
+	       per_cpu(rcu_bh_data, cpu).nxtlist ||
+	       rcu_offload_pending(&per_cpu(rcu_data, cpu)) ||
+	       rcu_offload_pending(&per_cpu(rcu_bh_data, cpu));
 }
 
 /*
@@ -1536,6 +1818,6 @@ void __init __rcu_init(void)
 	printk(KERN_WARNING "Experimental hierarchical RCU init done.\n");
 }
 
-module_param(blimit, int, 0);
-module_param(qhimark, int, 0);
-module_param(qlowmark, int, 0);
+module_param(blimit, int, 0644);
+module_param(qhimark, int, 0644);
+module_param(qlowmark, int, 0644);
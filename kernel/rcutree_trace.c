@@ -63,7 +63,12 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   rdp->dynticks_fqs);
 #endif /* #ifdef CONFIG_NO_HZ */
 	seq_printf(m, " of=%lu ri=%lu", rdp->offline_fqs, rdp->resched_ipi);
-	seq_printf(m, " ql=%ld b=%ld\n", rdp->qlen, rdp->blimit);
+	seq_printf(m, " ql=%ld b=%ld", rdp->qlen, rdp->blimit);
+#ifdef CONFIG_RCU_CB_OFFLOAD
+	if (rdp->nocb_task)
+		seq_printf(m, " oql=%ld", atomic_long_read(&rdp->nocb_qlen));
+#endif /* #ifdef CONFIG_RCU_CB_OFFLOAD */
+	seq_putc(m, '\n');
 }
 
 #define PRINT_RCU_DATA(name, func, m) \
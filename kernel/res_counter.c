@@ -19,6 +19,9 @@ void res_counter_init(struct res_counter *counter, struct res_counter *parent)
 {
 	spin_lock_init(&counter->lock);
 	counter->limit = (unsigned long long)LLONG_MAX;
+	counter->soft_limit = (unsigned long long)LLONG_MAX;
+	counter->high_wmark = (unsigned long long)LLONG_MAX;
+	counter->low_wmark = (unsigned long long)LLONG_MAX;
 	counter->parent = parent;
 }
 
@@ -101,6 +104,12 @@ res_counter_member(struct res_counter *counter, int member)
 		return &counter->limit;
 	case RES_FAILCNT:
 		return &counter->failcnt;
+	case RES_SOFT_LIMIT:
+		return &counter->soft_limit;
+	case RES_HIGH_WMARK:
+		return &counter->high_wmark;
+	case RES_LOW_WMARK:
+		return &counter->low_wmark;
 	};
 
 	BUG();
@@ -13,6 +13,85 @@
 #include <asm/system.h>
 #include <asm/atomic.h>
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * The writer holding the semaphore is tracked non-atomically, like the
+ * owner of a mutex, so that contending tasks can tell whether it is
+ * running.
+ */
+static inline void rwsem_set_owner(struct rw_semaphore *sem)
+{
+	sem->owner = current_thread_info();
+}
+
+static inline void rwsem_clear_owner(struct rw_semaphore *sem)
+{
+	sem->owner = NULL;
+}
+
+/*
+ * Optimistic spinning.
+ *
+ * When a writer holds the semaphore and is running on another cpu, it
+ * is likely to release it soon, so rather than going to sleep at once,
+ * spin until it does and then try to take the semaphore. Readers are
+ * not tracked, so we only spin on a writer. The trylock respects the
+ * queue, so sleeping waiters are not overtaken.
+ */
+static int rwsem_spin(struct rw_semaphore *sem, int write)
+{
+	struct thread_info *owner;
+	int ret = 0;
+
+	preempt_disable();
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (!owner || !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (write ? __down_write_trylock(sem) :
+			    __down_read_trylock(sem)) {
+			ret = 1;
+			break;
+		}
+
+		if (need_resched())
+			break;
+
+		/* see the comment in __mutex_lock_common() */
+		cpu_relax();
+	}
+	preempt_enable();
+
+	return ret;
+}
+#else
+static inline void rwsem_set_owner(struct rw_semaphore *sem)
+{
+}
+
+static inline void rwsem_clear_owner(struct rw_semaphore *sem)
+{
+}
+
+static inline int rwsem_spin(struct rw_semaphore *sem, int write)
+{
+	return 0;
+}
+#endif
+
+static inline void __down_read_spin(struct rw_semaphore *sem)
+{
+	if (!rwsem_spin(sem, 0))
+		__down_read(sem);
+}
+
+static inline void __down_write_spin(struct rw_semaphore *sem)
+{
+	if (!rwsem_spin(sem, 1))
+		__down_write(sem);
+}
+
 /*
  * lock for reading
  */
@@ -21,7 +100,7 @@ void __sched down_read(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, 0, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	LOCK_CONTENDED(sem, __down_read_trylock, __down_read_spin);
 }
 
 EXPORT_SYMBOL(down_read);
@@ -48,7 +127,8 @@ void __sched down_write(struct rw_semaphore *sem)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, 0, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	LOCK_CONTENDED(sem, __down_write_trylock, __down_write_spin);
+	rwsem_set_owner(sem);
 }
 
 EXPORT_SYMBOL(down_write);
@@ -60,8 +140,10 @@ int down_write_trylock(struct rw_semaphore *sem)
 {
 	int ret = __down_write_trylock(sem);
 
-	if (ret == 1)
+	if (ret == 1) {
 		rwsem_acquire(&sem->dep_map, 0, 1, _RET_IP_);
+		rwsem_set_owner(sem);
+	}
 	return ret;
 }
 
@@ -86,6 +168,7 @@ void up_write(struct rw_semaphore *sem)
 {
 	rwsem_release(&sem->dep_map, 1, _RET_IP_);
 
+	rwsem_clear_owner(sem);
 	__up_write(sem);
 }
 
@@ -100,6 +183,7 @@ void downgrade_write(struct rw_semaphore *sem)
 	 * lockdep: a downgraded write will live on as a write
 	 * dependency.
 	 */
+	rwsem_clear_owner(sem);
 	__downgrade_write(sem);
 }
 
@@ -112,7 +196,7 @@ void down_read_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire_read(&sem->dep_map, subclass, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_read_trylock, __down_read);
+	LOCK_CONTENDED(sem, __down_read_trylock, __down_read_spin);
 }
 
 EXPORT_SYMBOL(down_read_nested);
@@ -131,7 +215,8 @@ void down_write_nested(struct rw_semaphore *sem, int subclass)
 	might_sleep();
 	rwsem_acquire(&sem->dep_map, subclass, 0, _RET_IP_);
 
-	LOCK_CONTENDED(sem, __down_write_trylock, __down_write);
+	LOCK_CONTENDED(sem, __down_write_trylock, __down_write_spin);
+	rwsem_set_owner(sem);
 }
 
 EXPORT_SYMBOL(down_write_nested);
@@ -72,12 +72,15 @@
 #include <linux/debugfs.h>
 #include <linux/ctype.h>
 #include <linux/ftrace.h>
+#include <linux/tracehook.h>
+#include <linux/mempolicy.h>
 #include <trace/sched.h>
 
 #include <asm/tlb.h>
 #include <asm/irq_regs.h>
 
 #include "sched_cpupri.h"
+#include "workqueue_sched.h"
 
 /*
  * Convert user-nice values [ -20 ... 0 ... 19 ]
@@ -286,6 +289,11 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+
+#ifdef CONFIG_SMP
+	/* sum of the load_contribution of this group's cfs_rqs */
+	atomic_long_t load_weight;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -479,6 +487,11 @@ struct cfs_rq {
 	 * load.weight at the time we set shares
 	 */
 	unsigned long rq_weight;
+
+	/*
+	 * the part of tg->load_weight accounted to this cpu
+	 */
+	unsigned long load_contribution;
 #endif
 #endif
 };
@@ -626,6 +639,12 @@ struct rq {
 
 	unsigned long avg_load_per_task;
 
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	/* cpu_clock() of the last group shares update on this cpu */
+	u64 last_shares_update;
+	int shares_updating;
+#endif
+
 	struct task_struct *migration_thread;
 	struct list_head migration_queue;
 #endif
@@ -1514,77 +1533,80 @@ static unsigned long cpu_avg_load_per_task(int cpu)
 static void __set_se_shares(struct sched_entity *se, unsigned long shares);
 
 /*
- * Calculate and set the cpu's group shares.
+ * Fold this cpu's load of the group into tg->load_weight. The global sum is
+ * only touched when the load moved by more than an eighth of what was last
+ * accounted, so that a busy group does not bounce the cacheline around
+ * on every update.
  */
-static void
-update_group_shares_cpu(struct task_group *tg, int cpu,
-			unsigned long sd_shares, unsigned long sd_rq_weight)
+static unsigned long update_tg_load_weight(struct task_group *tg, int cpu)
 {
-	unsigned long shares;
-	unsigned long rq_weight;
+	struct cfs_rq *cfs_rq = tg->cfs_rq[cpu];
+	unsigned long load = cfs_rq->load.weight;
+	long delta = load - cfs_rq->load_contribution;
+
+	if (delta && abs(delta) >= cfs_rq->load_contribution / 8) {
+		atomic_long_add(delta, &tg->load_weight);
+		cfs_rq->load_contribution = load;
+	}
+
+	return load;
+}
+
+/*
+ * Re-compute the cpu's part of the group shares from the group load on
+ * this cpu and the group load over all cpus. Only the local runqueue is
+ * touched, so no domain span has to be walked and no remote rq->lock is
+ * taken.
+ * This needs to be done in a bottom-up fashion because the rq weight of a
+ * parent group depends on the shares of its child groups.
+ */
+static int tg_shares_up(struct task_group *tg, void *data)
+{
+	unsigned long load, tg_load, shares;
+	long cpu = (long)data;
+	struct cfs_rq *cfs_rq;
 
 	if (!tg->se[cpu])
-		return;
+		return 0;
 
-	rq_weight = tg->cfs_rq[cpu]->rq_weight;
+	cfs_rq = tg->cfs_rq[cpu];
+	load = update_tg_load_weight(tg, cpu);
 
 	/*
-	 *           \Sum shares * rq_weight
-	 * shares =  -----------------------
-	 *               \Sum rq_weight
-	 *
+	 * If there are currently no tasks on the cpu pretend there
+	 * is one of average load so that when a new task gets to
+	 * run here it will not get delayed by group starvation.
 	 */
-	shares = (sd_shares * rq_weight) / sd_rq_weight;
+	if (!load)
+		load = NICE_0_LOAD;
+
+	/*
+	 *                  tg->shares * load
+	 * shares =  -------------------------------
+	 *           \Sum load of the other cpus + load
+	 */
+	tg_load = atomic_long_read(&tg->load_weight);
+	tg_load -= cfs_rq->load_contribution;
+	if ((long)tg_load < 0)
+		tg_load = 0;
+	tg_load += load;
+
+	shares = (tg->shares * load) / tg_load;
 	shares = clamp_t(unsigned long, shares, MIN_SHARES, MAX_SHARES);
 
+	cfs_rq->rq_weight = load;
+
 	if (abs(shares - tg->se[cpu]->load.weight) >
 			sysctl_sched_shares_thresh) {
 		struct rq *rq = cpu_rq(cpu);
 		unsigned long flags;
 
 		spin_lock_irqsave(&rq->lock, flags);
-		tg->cfs_rq[cpu]->shares = shares;
+		cfs_rq->shares = shares;
 
 		__set_se_shares(tg->se[cpu], shares);
 		spin_unlock_irqrestore(&rq->lock, flags);
 	}
-}
-
-/*
- * Re-compute the task group their per cpu shares over the given domain.
- * This needs to be done in a bottom-up fashion because the rq weight of a
- * parent group depends on the shares of its child groups.
- */
-static int tg_shares_up(struct task_group *tg, void *data)
-{
-	unsigned long weight, rq_weight = 0;
-	unsigned long shares = 0;
-	struct sched_domain *sd = data;
-	int i;
-
-	for_each_cpu(i, sched_domain_span(sd)) {
-		/*
-		 * If there are currently no tasks on the cpu pretend there
-		 * is one of average load so that when a new task gets to
-		 * run here it will not get delayed by group starvation.
-		 */
-		weight = tg->cfs_rq[i]->load.weight;
-		if (!weight)
-			weight = NICE_0_LOAD;
-
-		tg->cfs_rq[i]->rq_weight = weight;
-		rq_weight += weight;
-		shares += tg->cfs_rq[i]->shares;
-	}
-
-	if ((!shares && rq_weight) || shares > tg->shares)
-		shares = tg->shares;
-
-	if (!sd->parent || !(sd->parent->flags & SD_LOAD_BALANCE))
-		shares = tg->shares;
-
-	for_each_cpu(i, sched_domain_span(sd))
-		update_group_shares_cpu(tg, i, shares, rq_weight);
 
 	return 0;
 }
@@ -1612,24 +1634,50 @@ static int tg_load_down(struct task_group *tg, void *data)
 	return 0;
 }
 
-static void update_shares(struct sched_domain *sd)
+/*
+ * Update the group shares of @cpu, at most once per
+ * sysctl_sched_shares_ratelimit. Only the shares of @cpu are updated; the
+ * load of the other cpus is seen through tg->load_weight. This is usually
+ * the local cpu, but the nohz idle balancer updates the idle cpus it
+ * balances for, so that their load does not stay in tg->load_weight.
+ */
+static void update_shares(int cpu)
 {
-	u64 now = cpu_clock(raw_smp_processor_id());
-	s64 elapsed = now - sd->last_update;
+	struct rq *rq = cpu_rq(cpu);
+	u64 now = cpu_clock(cpu);
 
-	if (elapsed >= (s64)(u64)sysctl_sched_shares_ratelimit) {
-		sd->last_update = now;
-		walk_tg_tree(tg_nop, tg_shares_up, sd);
-	}
+	if (now - rq->last_shares_update < sysctl_sched_shares_ratelimit)
+		return;
+
+	/*
+	 * An interrupt or another cpu may try to update while we are
+	 * walking the tree.
+	 */
+	if (cmpxchg(&rq->shares_updating, 0, 1))
+		return;
+
+	rq->last_shares_update = now;
+	walk_tg_tree(tg_nop, tg_shares_up, (void *)(long)cpu);
+	smp_wmb();
+	rq->shares_updating = 0;
 }
 
-static void update_shares_locked(struct rq *rq, struct sched_domain *sd)
+static void update_shares_locked(struct rq *rq)
 {
 	spin_unlock(&rq->lock);
-	update_shares(sd);
+	update_shares(cpu_of(rq));
 	spin_lock(&rq->lock);
 }
 
+/*
+ * The cpu went away and its runqueues are empty: drop its load from the
+ * groups' load_weight.
+ */
+static inline void update_shares_dead(int cpu)
+{
+	walk_tg_tree(tg_nop, tg_shares_up, (void *)(long)cpu);
+}
+
 static void update_h_load(long cpu)
 {
 	walk_tg_tree(tg_load_down, tg_nop, (void *)cpu);
@@ -1637,11 +1685,15 @@ static void update_h_load(long cpu)
 
 #else
 
-static inline void update_shares(struct sched_domain *sd)
+static inline void update_shares(int cpu)
+{
+}
+
+static inline void update_shares_locked(struct rq *rq)
 {
 }
 
-static inline void update_shares_locked(struct rq *rq, struct sched_domain *sd)
+static inline void update_shares_dead(int cpu)
 {
 }
 
@@ -1743,6 +1795,14 @@ static void cfs_rq_set_shares(struct cfs_rq *cfs_rq, unsigned long shares)
 static void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+	/*
+	 * The tick may be stopped for the task running alone there, and is
+	 * needed again to share the CPU: have it go through schedule().
+	 */
+	if (rq->nr_running == 2 && tick_nohz_adaptive_cpu(cpu_of(rq)))
+		resched_task(rq->curr);
+#endif
 }
 
 static void dec_nr_running(struct rq *rq)
@@ -2282,7 +2342,7 @@ static int sched_balance_self(int cpu, int flag)
 	}
 
 	if (sd)
-		update_shares(sd);
+		update_shares(cpu);
 
 	while (sd) {
 		struct sched_group *group;
@@ -2349,19 +2409,8 @@ static int try_to_wake_up(struct task_struct *p, unsigned int state, int sync)
 		sync = 0;
 
 #ifdef CONFIG_SMP
-	if (sched_feat(LB_WAKEUP_UPDATE) && !root_task_group_empty()) {
-		struct sched_domain *sd;
-
-		this_cpu = raw_smp_processor_id();
-		cpu = task_cpu(p);
-
-		for_each_domain(this_cpu, sd) {
-			if (cpumask_test_cpu(cpu, sched_domain_span(sd))) {
-				update_shares(sd);
-				break;
-			}
-		}
-	}
+	if (sched_feat(LB_WAKEUP_UPDATE) && !root_task_group_empty())
+		update_shares(raw_smp_processor_id());
 #endif
 
 	smp_wmb();
@@ -2427,6 +2476,13 @@ out_activate:
 	activate_task(rq, p, 1);
 	success = 1;
 
+	/*
+	 * If a worker is waking up, let the workqueue code account it
+	 * as running again.  This has to be done after set_task_cpu().
+	 */
+	if (p->flags & PF_WQ_WORKER)
+		wq_worker_waking_up(p, cpu);
+
 	/*
 	 * Only attribute actual wakeups done by this task.
 	 */
@@ -2458,6 +2514,36 @@ out:
 	return success;
 }
 
+/**
+ * try_to_wake_up_local - try to wake up a local task with rq lock held
+ * @p: the thread to be awakened
+ *
+ * Put @p on the run-queue if it's not already there.  The caller must
+ * ensure that this_rq() is locked, @p is bound to this_rq() and not
+ * the current task.  this_rq() stays locked over invocation.
+ */
+static void try_to_wake_up_local(struct task_struct *p)
+{
+	struct rq *rq = task_rq(p);
+
+	BUG_ON(rq != this_rq());
+	BUG_ON(p == current);
+	assert_spin_locked(&rq->lock);
+
+	if (!(p->state & TASK_NORMAL))
+		return;
+
+	if (!p->se.on_rq) {
+		schedstat_inc(p, se.nr_wakeups);
+		schedstat_inc(p, se.nr_wakeups_local);
+		activate_task(rq, p, 1);
+	}
+
+	trace_sched_wakeup(rq, p, 1);
+	check_preempt_curr(rq, p, 0);
+	p->state = TASK_RUNNING;
+}
+
 int wake_up_process(struct task_struct *p)
 {
 	return try_to_wake_up(p, TASK_ALL, 0);
@@ -3436,6 +3522,57 @@ static inline int check_power_save_busiest_group(struct sd_lb_stats *sds,
 #endif /* CONFIG_SCHED_MC || CONFIG_SCHED_SMT */
 
 
+/*
+ * Try to fill in the load statistics of a remote group from what another
+ * cpu computed for it during this jiffy. Returns 1 on success.
+ */
+static int sg_lb_stats_cached(struct sched_group *group, int load_idx,
+			      int *sd_idle, struct sg_lb_stats *sgs)
+{
+	struct sched_group_lb_cache *c = &group->lb_cache;
+	unsigned seq;
+	int imb;
+
+	do {
+		seq = read_seqbegin(&c->lock);
+		if (c->stamp != jiffies || c->load_idx != load_idx)
+			return 0;
+		sgs->group_load = c->group_load;
+		sgs->sum_nr_running = c->sum_nr_running;
+		sgs->sum_weighted_load = c->sum_weighted_load;
+		imb = c->group_imb;
+	} while (read_seqretry(&c->lock, seq));
+
+	sgs->group_imb = imb;
+	if (*sd_idle && sgs->sum_nr_running)
+		*sd_idle = 0;
+
+	return 1;
+}
+
+static void sg_lb_stats_publish(struct sched_group *group, int load_idx,
+				struct sg_lb_stats *sgs)
+{
+	struct sched_group_lb_cache *c = &group->lb_cache;
+
+	/* someone else is publishing the same numbers */
+	if (!write_tryseqlock(&c->lock))
+		return;
+	c->stamp = jiffies;
+	c->load_idx = load_idx;
+	c->group_load = sgs->group_load;
+	c->sum_nr_running = sgs->sum_nr_running;
+	c->sum_weighted_load = sgs->sum_weighted_load;
+	c->group_imb = sgs->group_imb;
+	write_sequnlock(&c->lock);
+}
+
+static void init_sched_group_lb_cache(struct sched_group *sg)
+{
+	seqlock_init(&sg->lb_cache.lock);
+	sg->lb_cache.stamp = jiffies - 1;
+}
+
 /**
  * update_sg_lb_stats - Update sched_group's statistics for load balancing.
  * @group: sched_group whose statistics are to be updated.
@@ -3458,9 +3595,15 @@ static inline void update_sg_lb_stats(struct sched_group *group, int this_cpu,
 	unsigned int balance_cpu = -1, first_idle_cpu = 0;
 	unsigned long sum_avg_load_per_task;
 	unsigned long avg_load_per_task;
+	int cacheable = 0;
 
 	if (local_group)
 		balance_cpu = group_first_cpu(group);
+	else if (cpumask_subset(sched_group_cpus(group), cpus)) {
+		cacheable = 1;
+		if (sg_lb_stats_cached(group, load_idx, sd_idle, sgs))
+			goto out;
+	}
 
 	/* Tally up the load of all CPUs in the group */
 	sum_avg_load_per_task = avg_load_per_task = 0;
@@ -3508,11 +3651,6 @@ static inline void update_sg_lb_stats(struct sched_group *group, int this_cpu,
 		return;
 	}
 
-	/* Adjust by relative CPU power of the group */
-	sgs->avg_load = sg_div_cpu_power(group,
-			sgs->group_load * SCHED_LOAD_SCALE);
-
-
 	/*
 	 * Consider the group unbalanced when the imbalance is larger
 	 * than the average weight of two tasks.
@@ -3528,8 +3666,14 @@ static inline void update_sg_lb_stats(struct sched_group *group, int this_cpu,
 	if ((max_cpu_load - min_cpu_load) > 2*avg_load_per_task)
 		sgs->group_imb = 1;
 
-	sgs->group_capacity = group->__cpu_power / SCHED_LOAD_SCALE;
+	if (cacheable)
+		sg_lb_stats_publish(group, load_idx, sgs);
+out:
+	/* Adjust by relative CPU power of the group */
+	sgs->avg_load = sg_div_cpu_power(group,
+			sgs->group_load * SCHED_LOAD_SCALE);
 
+	sgs->group_capacity = group->__cpu_power / SCHED_LOAD_SCALE;
 }
 
 /**
@@ -3871,7 +4015,7 @@ static int load_balance(int this_cpu, struct rq *this_rq,
 	schedstat_inc(sd, lb_count[idle]);
 
 redo:
-	update_shares(sd);
+	update_shares(this_cpu);
 	group = find_busiest_group(sd, this_cpu, &imbalance, idle, &sd_idle,
 				   cpus, balance);
 
@@ -3997,7 +4141,7 @@ out_one_pinned:
 		ld_moved = 0;
 out:
 	if (ld_moved)
-		update_shares(sd);
+		update_shares(this_cpu);
 	return ld_moved;
 }
 
@@ -4033,7 +4177,7 @@ load_balance_newidle(int this_cpu, struct rq *this_rq, struct sched_domain *sd)
 
 	schedstat_inc(sd, lb_count[CPU_NEWLY_IDLE]);
 redo:
-	update_shares_locked(this_rq, sd);
+	update_shares_locked(this_rq);
 	group = find_busiest_group(sd, this_cpu, &imbalance, CPU_NEWLY_IDLE,
 				   &sd_idle, cpus, NULL);
 	if (!group) {
@@ -4136,7 +4280,7 @@ redo:
 	} else
 		sd->nr_balance_failed = 0;
 
-	update_shares_locked(this_rq, sd);
+	update_shares_locked(this_rq);
 	return ld_moved;
 
 out_balanced:
@@ -4819,6 +4963,28 @@ inline cputime_t task_gtime(struct task_struct *p)
 	return p->gtime;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * When the process of the current task is due a NUMA sampling pass, have
+ * the task do it in task_numa_work() on its way back to user mode.
+ */
+static void task_tick_numa(struct task_struct *curr)
+{
+	struct mm_struct *mm = curr->mm;
+
+	if (!sysctl_numa_balancing || nr_node_ids == 1)
+		return;
+	if (!mm || (curr->flags & (PF_EXITING | PF_KTHREAD)))
+		return;
+	if (time_after_eq(jiffies, ACCESS_ONCE(mm->numa_next_scan)))
+		set_notify_resume(curr);
+}
+#else
+static inline void task_tick_numa(struct task_struct *curr)
+{
+}
+#endif
+
 /*
  * This function gets called by the timer code, with HZ frequency.
  * We call it with interrupts disabled.
@@ -4839,6 +5005,7 @@ void scheduler_tick(void)
 	update_cpu_load(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
 	spin_unlock(&rq->lock);
+	task_tick_numa(curr);
 
 #ifdef CONFIG_SMP
 	rq->idle_at_tick = idle_cpu(cpu);
@@ -5035,8 +5202,21 @@ need_resched_nonpreemptible:
 	if (prev->state && !(preempt_count() & PREEMPT_ACTIVE)) {
 		if (unlikely(signal_pending_state(prev->state, prev)))
 			prev->state = TASK_RUNNING;
-		else
+		else {
+			/*
+			 * If a worker is going to sleep, ask the workqueue
+			 * code whether another worker should take over to
+			 * keep the cpu busy, and wake that one up.
+			 */
+			if (prev->flags & PF_WQ_WORKER) {
+				struct task_struct *to_wakeup;
+
+				to_wakeup = wq_worker_sleeping(prev, cpu);
+				if (to_wakeup)
+					try_to_wake_up_local(to_wakeup);
+			}
 			deactivate_task(rq, prev, 1);
+		}
 		switch_count = &prev->nvcsw;
 	}
 
@@ -5076,7 +5256,9 @@ asmlinkage void __sched schedule(void)
 {
 need_resched:
 	preempt_disable();
+	tick_nohz_adaptive_restart();
 	__schedule();
+	tick_nohz_adaptive_update();
 	preempt_enable_no_resched();
 	if (unlikely(test_thread_flag(TIF_NEED_RESCHED)))
 		goto need_resched;
@@ -5085,16 +5267,15 @@ EXPORT_SYMBOL(schedule);
 
 #ifdef CONFIG_SMP
 /*
+ * Find the runqueue a lock owner was last seen on, NULL if that cannot
+ * be trusted.
+ *
  * Look out! "owner" is an entirely speculative pointer
  * access and not reliable.
  */
-int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+static struct rq *owner_rq(struct thread_info *owner)
 {
 	unsigned int cpu;
-	struct rq *rq;
-
-	if (!sched_feat(OWNER_SPIN))
-		return 0;
 
 #ifdef CONFIG_DEBUG_PAGEALLOC
 	/*
@@ -5103,7 +5284,7 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 	 * the mutex owner just released it and exited.
 	 */
 	if (probe_kernel_address(&owner->cpu, cpu))
-		goto out;
+		return NULL;
 #else
 	cpu = owner->cpu;
 #endif
@@ -5113,16 +5294,28 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 	 * the cpu field may no longer be valid.
 	 */
 	if (cpu >= nr_cpumask_bits)
-		goto out;
+		return NULL;
 
 	/*
 	 * We need to validate that we can do a
 	 * get_cpu() and that we have the percpu area.
 	 */
 	if (!cpu_online(cpu))
-		goto out;
+		return NULL;
 
-	rq = cpu_rq(cpu);
+	return cpu_rq(cpu);
+}
+
+int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
+{
+	struct rq *rq;
+
+	if (!sched_feat(OWNER_SPIN))
+		return 0;
+
+	rq = owner_rq(owner);
+	if (!rq)
+		return 1;
 
 	for (;;) {
 		/*
@@ -5139,9 +5332,37 @@ int mutex_spin_on_owner(struct mutex *lock, struct thread_info *owner)
 
 		cpu_relax();
 	}
-out:
 	return 1;
 }
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Same as mutex_spin_on_owner(), for the writer owning an rwsem: returns
+ * 0 when it is not worth spinning any more, 1 when the owner changed.
+ */
+int rwsem_spin_on_owner(struct rw_semaphore *sem, struct thread_info *owner)
+{
+	struct rq *rq;
+
+	if (!sched_feat(OWNER_SPIN))
+		return 0;
+
+	rq = owner_rq(owner);
+	if (!rq)
+		return 1;
+
+	for (;;) {
+		if (ACCESS_ONCE(sem->owner) != owner)
+			break;
+
+		if (task_thread_info(rq->curr) != owner || need_resched())
+			return 0;
+
+		cpu_relax();
+	}
+	return 1;
+}
+#endif
 #endif
 
 #ifdef CONFIG_PREEMPT
@@ -5749,6 +5970,22 @@ struct task_struct *idle_task(int cpu)
 	return cpu_rq(cpu)->idle;
 }
 
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+/**
+ * sched_can_stop_tick - can the tick of this cpu be stopped for its task?
+ *
+ * Only if the current task runs alone: nothing needs to preempt it, and a
+ * SCHED_RR task has nobody to share its timeslice with either.
+ */
+int sched_can_stop_tick(void)
+{
+	struct rq *rq = this_rq();
+
+	return rq->nr_running == 1 && rq->curr != rq->idle &&
+	       !test_tsk_need_resched(rq->curr);
+}
+#endif
+
 /**
  * find_process_by_pid - find a process with a matching PID value.
  * @pid: the pid in question.
@@ -7243,6 +7480,7 @@ migration_call(struct notifier_block *nfb, unsigned long action, void *hcpu)
 		cpuset_unlock();
 		migrate_nr_uninterruptible(rq);
 		BUG_ON(rq->nr_running != 0);
+		update_shares_dead(cpu);
 
 		/*
 		 * No need to migrate the tasks: it was best-effort if
@@ -7660,6 +7898,7 @@ init_sched_build_groups(const struct cpumask *span,
 
 		cpumask_clear(sched_group_cpus(sg));
 		sg->__cpu_power = 0;
+		init_sched_group_lb_cache(sg);
 
 		for_each_cpu(j, span) {
 			if (group_fn(j, cpu_map, NULL, tmpmask) != group)
@@ -8253,6 +8492,7 @@ static int __build_sched_domains(const struct cpumask *cpu_map,
 			sd->groups = sg;
 		}
 		sg->__cpu_power = 0;
+		init_sched_group_lb_cache(sg);
 		cpumask_copy(sched_group_cpus(sg), nodemask);
 		sg->next = sg;
 		cpumask_or(covered, covered, nodemask);
@@ -8280,6 +8520,7 @@ static int __build_sched_domains(const struct cpumask *cpu_map,
 				goto error;
 			}
 			sg->__cpu_power = 0;
+			init_sched_group_lb_cache(sg);
 			cpumask_copy(sched_group_cpus(sg), tmpmask);
 			sg->next = prev->next;
 			cpumask_or(covered, covered, tmpmask);
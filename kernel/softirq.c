@@ -307,6 +307,8 @@ void irq_exit(void)
 	rcu_irq_exit();
 	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
 		tick_nohz_stop_sched_tick(0);
+	else if (!in_interrupt())
+		tick_nohz_adaptive_update();
 #endif
 	preempt_enable_no_resched();
 }
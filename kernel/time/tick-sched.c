@@ -19,8 +19,10 @@
 #include <linux/percpu.h>
 #include <linux/profile.h>
 #include <linux/sched.h>
+#include <linux/smp.h>
 #include <linux/tick.h>
 #include <linux/module.h>
+#include <linux/posix-timers.h>
 
 #include <asm/irq_regs.h>
 
@@ -99,6 +101,18 @@ static ktime_t tick_init_jiffy_update(void)
 	return period;
 }
 
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+static int tick_nohz_adaptive_keep_duty(int cpu);
+#else
+static inline void tick_nohz_adaptive_account(struct tick_sched *ts, int tick)
+{
+}
+static inline int tick_nohz_adaptive_keep_duty(int cpu)
+{
+	return 0;
+}
+#endif
+
 /*
  * NOHZ - aka dynamic tick functionality
  */
@@ -216,7 +230,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	struct tick_sched *ts;
 	ktime_t last_update, expires, now;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
-	int cpu;
+	int cpu, keep_duty;
 
 	local_irq_save(flags);
 
@@ -270,7 +284,14 @@ void tick_nohz_stop_sched_tick(int inidle)
 	next_jiffies = get_next_timer_interrupt(last_jiffies);
 	delta_jiffies = next_jiffies - last_jiffies;
 
-	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu))
+	/*
+	 * The jiffies must be kept up to date for the CPUs which stopped
+	 * their tick for a busy task, so the cpu which updates them keeps
+	 * ticking while there are any.
+	 */
+	keep_duty = tick_nohz_adaptive_keep_duty(cpu);
+
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) || keep_duty)
 		delta_jiffies = 1;
 	/*
 	 * Do not stop the tick, if we are only one off
@@ -297,7 +318,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 		 * jiffies might be stale and do_timer() never
 		 * invoked.
 		 */
-		if (cpu == tick_do_timer_cpu)
+		if (cpu == tick_do_timer_cpu && !keep_duty)
 			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
 
 		if (delta_jiffies > 1)
@@ -469,6 +490,283 @@ void tick_nohz_restart_sched_tick(void)
 	local_irq_enable();
 }
 
+#ifdef CONFIG_NO_HZ_ADAPTIVE
+/*
+ * Adaptive tick: the CPUs given with nohz_adaptive= stop the tick also
+ * while they run a single task. This is evaluated on irq exit, where a
+ * wakeup IPI lands, and around each context switch; enqueueing a second
+ * task on such a CPU makes it reschedule (see inc_nr_running()). The
+ * jiffies are updated by the housekeeping CPUs, which never stop the tick
+ * for a busy task; the boot CPU always is one of them. While any CPU has
+ * its tick stopped for a busy task, the housekeeping CPU which updates the
+ * jiffies does not stop its tick in idle either.
+ */
+static DECLARE_BITMAP(tick_nohz_adaptive_bits, CONFIG_NR_CPUS);
+const struct cpumask *const tick_nohz_adaptive_mask =
+	to_cpumask(tick_nohz_adaptive_bits);
+
+static int __init setup_tick_nohz_adaptive(char *str)
+{
+	struct cpumask *mask = to_cpumask(tick_nohz_adaptive_bits);
+	int cpu = smp_processor_id();
+
+	cpulist_parse(str, mask);
+	if (cpumask_test_cpu(cpu, mask)) {
+		printk(KERN_WARNING "NOHZ: boot CPU %d keeps its tick\n", cpu);
+		cpumask_clear_cpu(cpu, mask);
+	}
+	return 1;
+}
+
+__setup("nohz_adaptive=", setup_tick_nohz_adaptive);
+
+/*
+ * The tick is kept at least once a second for the process time accounting,
+ * the load average and the scheduler statistics.
+ */
+#define TICK_NOHZ_ADAPTIVE_MAX_DELTA	HZ
+
+/* Number of CPUs which stopped the tick for a busy task */
+static atomic_t tick_nohz_adaptive_stopped = ATOMIC_INIT(0);
+
+/*
+ * Called by a housekeeping CPU going idle: keep (or take) the do_timer
+ * duty and the tick if any CPU stopped its tick for a busy task. Pairs
+ * with the barrier in tick_nohz_adaptive_stop().
+ */
+static int tick_nohz_adaptive_keep_duty(int cpu)
+{
+	if (tick_nohz_adaptive_cpu(cpu) || !cpu_online(cpu))
+		return 0;
+	if (tick_do_timer_cpu != cpu &&
+	    tick_do_timer_cpu != TICK_DO_TIMER_NONE)
+		return 0;
+
+	if (!atomic_read(&tick_nohz_adaptive_stopped)) {
+		if (tick_do_timer_cpu == cpu)
+			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+		smp_mb();
+		if (!atomic_read(&tick_nohz_adaptive_stopped))
+			return 0;
+	}
+	tick_do_timer_cpu = cpu;
+	return 1;
+}
+
+/*
+ * Make sure a housekeeping CPU updates the jiffies while this one has its
+ * tick stopped. If none has the duty, they are all idle with their tick
+ * stopped: wake one up, it takes the duty from its tick handler.
+ */
+static void tick_nohz_adaptive_hand_duty(int cpu)
+{
+	int i;
+
+	if (cpu == tick_do_timer_cpu)
+		tick_do_timer_cpu = TICK_DO_TIMER_NONE;
+	smp_mb();
+	if (tick_do_timer_cpu != TICK_DO_TIMER_NONE)
+		return;
+
+	for_each_online_cpu(i) {
+		if (!tick_nohz_adaptive_cpu(i)) {
+			wake_up_idle_cpu(i);
+			break;
+		}
+	}
+}
+
+/*
+ * Account the ticks the current task ran without to it, except the one
+ * update_process_times() accounts if we are called from the tick. A task
+ * which has a CPU to itself for a while spends its time in user space, so
+ * they go to user time.
+ */
+static void tick_nohz_adaptive_account(struct tick_sched *ts, int tick)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->adaptive_jiffies;
+	cputime_t cputime;
+
+	if (ticks > tick && ticks < LONG_MAX) {
+		cputime = jiffies_to_cputime(ticks - tick);
+		account_user_time(current, cputime, cputime_to_scaled(cputime));
+	}
+#endif
+	ts->adaptive_jiffies = jiffies;
+}
+
+static int tick_nohz_adaptive_can_stop(int cpu)
+{
+	if (!sched_can_stop_tick() || local_softirq_pending())
+		return 0;
+	if (rcu_needs_cpu(cpu) || rcu_pending(cpu) || printk_needs_cpu(cpu))
+		return 0;
+	return !posix_cpu_timers_need_tick(current);
+}
+
+static void tick_nohz_adaptive_restart_tick(struct tick_sched *ts)
+{
+	ktime_t now = ktime_get();
+
+	tick_do_update_jiffies64(now);
+	tick_nohz_adaptive_account(ts, 0);
+	touch_softlockup_watchdog();
+
+	ts->adaptive = 0;
+	ts->tick_stopped = 0;
+	atomic_dec(&tick_nohz_adaptive_stopped);
+	tick_nohz_restart(ts, now);
+}
+
+static void tick_nohz_adaptive_stop(struct tick_sched *ts, int cpu)
+{
+	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
+	unsigned long seq, last_jiffies, next_jiffies, delta_jiffies;
+	ktime_t last_update, expires;
+
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		last_update = last_jiffies_update;
+		last_jiffies = jiffies;
+	} while (read_seqretry(&xtime_lock, seq));
+
+	next_jiffies = get_next_timer_interrupt(last_jiffies);
+	delta_jiffies = next_jiffies - last_jiffies;
+	if ((long)delta_jiffies <= 1) {
+		/* Do not stop the tick, if we are only one off */
+		if (!ts->tick_stopped)
+			return;
+		delta_jiffies = 1;
+	}
+	delta_jiffies = min(delta_jiffies,
+			    (unsigned long)TICK_NOHZ_ADAPTIVE_MAX_DELTA);
+
+	expires = ktime_add_ns(last_update, tick_period.tv64 * delta_jiffies);
+	if (ts->tick_stopped && ktime_equal(expires, dev->next_event))
+		return;
+
+	if (!ts->tick_stopped) {
+		ts->idle_tick = hrtimer_get_expires(&ts->sched_timer);
+		ts->tick_stopped = 1;
+		ts->adaptive = 1;
+		ts->adaptive_jiffies = last_jiffies;
+		atomic_inc(&tick_nohz_adaptive_stopped);
+
+		/* Leave the jiffies update to a housekeeping CPU */
+		tick_nohz_adaptive_hand_duty(cpu);
+	}
+
+	if (ts->nohz_mode == NOHZ_MODE_HIGHRES) {
+		hrtimer_start(&ts->sched_timer, expires, HRTIMER_MODE_ABS);
+		/* Check, if the timer was already in the past */
+		if (hrtimer_active(&ts->sched_timer))
+			return;
+	} else if (!tick_program_event(expires, 0))
+		return;
+
+	/* We are past the event already, keep ticking */
+	tick_nohz_adaptive_restart_tick(ts);
+}
+
+/**
+ * __tick_nohz_adaptive_update - stop or restart the tick of a busy CPU
+ *
+ * Called on irq exit and after a context switch on the CPUs given with
+ * nohz_adaptive=. The idle task handles the tick on its own.
+ */
+void __tick_nohz_adaptive_update(void)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+	int cpu;
+
+	local_irq_save(flags);
+
+	cpu = smp_processor_id();
+	ts = &per_cpu(tick_cpu_sched, cpu);
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE) || ts->inidle)
+		goto out;
+
+	if (tick_nohz_adaptive_can_stop(cpu))
+		tick_nohz_adaptive_stop(ts, cpu);
+	else if (ts->adaptive)
+		tick_nohz_adaptive_restart_tick(ts);
+out:
+	local_irq_restore(flags);
+}
+
+/**
+ * __tick_nohz_adaptive_restart - restart the tick stopped for a busy task
+ *
+ * Called before a context switch, so that the ticks the task ran without
+ * are accounted to it.
+ */
+void __tick_nohz_adaptive_restart(void)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->adaptive)
+		tick_nohz_adaptive_restart_tick(ts);
+	local_irq_restore(flags);
+}
+
+/*
+ * A timer was queued on this CPU, maybe before the next timer event the
+ * stopped tick was programmed for. Reschedule, which reevaluates it.
+ * Called with the timer base lock held.
+ */
+void __tick_nohz_adaptive_timer_added(void)
+{
+	if (__get_cpu_var(tick_cpu_sched).adaptive)
+		set_need_resched();
+}
+
+static DEFINE_PER_CPU(struct call_single_data, tick_nohz_adaptive_csd);
+static DEFINE_PER_CPU(unsigned long, tick_nohz_adaptive_kicked);
+
+static void tick_nohz_adaptive_kick_func(void *info)
+{
+	/* The tick is reevaluated on irq exit */
+	clear_bit(0, &__get_cpu_var(tick_nohz_adaptive_kicked));
+}
+
+/**
+ * __tick_nohz_adaptive_kick - make a CPU reevaluate its stopped tick
+ * @cpu:	the CPU to kick
+ *
+ * A CPU running a task with its tick stopped does not look at the tick
+ * again until it goes through irq_exit() or schedule(), and the reschedule
+ * IPI does neither on all architectures. Send it a function call IPI,
+ * which does, unless one is on its way already. Callable with interrupts
+ * disabled.
+ */
+void __tick_nohz_adaptive_kick(int cpu)
+{
+	struct call_single_data *csd;
+
+	if (!per_cpu(tick_cpu_sched, cpu).adaptive)
+		return;
+
+	if (cpu == smp_processor_id()) {
+		set_need_resched();
+		return;
+	}
+
+	if (test_and_set_bit(0, &per_cpu(tick_nohz_adaptive_kicked, cpu)))
+		return;
+
+	csd = &per_cpu(tick_nohz_adaptive_csd, cpu);
+	csd->func = tick_nohz_adaptive_kick_func;
+	csd->info = NULL;
+	__smp_call_function_single(cpu, csd, 0);
+}
+#endif /* CONFIG_NO_HZ_ADAPTIVE */
+
 static int tick_nohz_reprogram(struct tick_sched *ts, ktime_t now)
 {
 	hrtimer_forward(&ts->sched_timer, now, tick_period);
@@ -494,11 +792,13 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_adaptive_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
-	if (tick_do_timer_cpu == cpu)
+	if (tick_do_timer_cpu == cpu ||
+	    tick_do_timer_cpu == TICK_DO_TIMER_NONE)
 		tick_do_update_jiffies64(now);
 
 	/*
@@ -509,7 +809,9 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * of idle" jiffy stamp so the idle accounting adjustment we
 	 * do when we go busy again does not account too much ticks.
 	 */
-	if (ts->tick_stopped) {
+	if (ts->adaptive)
+		tick_nohz_adaptive_account(ts, 1);
+	else if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
 		ts->idle_jiffies++;
 	}
@@ -640,12 +942,14 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_adaptive_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
 	/* Check, if the jiffies need an update */
-	if (tick_do_timer_cpu == cpu)
+	if (tick_do_timer_cpu == cpu ||
+	    tick_do_timer_cpu == TICK_DO_TIMER_NONE)
 		tick_do_update_jiffies64(now);
 
 	/*
@@ -661,7 +965,9 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 		 * idle" jiffy stamp so the idle accounting adjustment we do
 		 * when we go busy again does not account too much ticks.
 		 */
-		if (ts->tick_stopped) {
+		if (ts->adaptive)
+			tick_nohz_adaptive_account(ts, 1);
+		else if (ts->tick_stopped) {
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
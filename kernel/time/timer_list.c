@@ -146,6 +146,7 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 	SEQ_printf(m, "  .%-15s: %Lu nsecs\n", #x, \
 		   (unsigned long long)(ktime_to_ns(cpu_base->x)))
 
+	P(nr_expired);
 #ifdef CONFIG_HIGH_RES_TIMERS
 	P_ns(expires_next);
 	P(hres_active);
@@ -154,6 +155,15 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 #undef P
 #undef P_ns
 
+	{
+		unsigned long nr_expiries, nr_expired;
+
+		timer_wheel_stats(cpu, &nr_expiries, &nr_expired);
+		SEQ_printf(m, " timer wheel:\n");
+		SEQ_printf(m, "  .%-15s: %lu\n", "nr_expiries", nr_expiries);
+		SEQ_printf(m, "  .%-15s: %lu\n", "nr_expired", nr_expired);
+	}
+
 #ifdef CONFIG_TICK_ONESHOT
 # define P(x) \
 	SEQ_printf(m, "  .%-15s: %Lu\n", #x, \
@@ -252,7 +262,7 @@ static int timer_list_show(struct seq_file *m, void *v)
 	u64 now = ktime_to_ns(ktime_get());
 	int cpu;
 
-	SEQ_printf(m, "Timer List Version: v0.4\n");
+	SEQ_printf(m, "Timer List Version: v0.5\n");
 	SEQ_printf(m, "HRTIMER_MAX_CLOCK_BASES: %d\n", HRTIMER_MAX_CLOCK_BASES);
 	SEQ_printf(m, "now at %Ld nsecs\n", (unsigned long long)now);
 
@@ -75,6 +75,8 @@ struct tvec_base {
 	struct tvec tv3;
 	struct tvec tv4;
 	struct tvec tv5;
+	unsigned long nr_expiries;	/* jiffies which expired timers */
+	unsigned long nr_expired;	/* timers expired */
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
@@ -522,6 +524,7 @@ static void __init_timer(struct timer_list *timer,
 {
 	timer->entry.next = NULL;
 	timer->base = __raw_get_cpu_var(tvec_bases);
+	timer->slack = -1;
 #ifdef CONFIG_TIMER_STATS
 	timer->start_site = NULL;
 	timer->start_pid = -1;
@@ -649,6 +652,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires, bool pending_only)
 
 	timer->expires = expires;
 	internal_add_timer(base, timer);
+	if (base == new_base)
+		tick_nohz_adaptive_timer_added();
 
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
@@ -672,6 +677,49 @@ int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
+/*
+ * Decide where to put the timer while taking the slack into account
+ *
+ * Algorithm:
+ *   1) calculate the maximum (absolute) time
+ *   2) calculate the highest bit where the expires and new max are different
+ *   3) use this bit to make a mask
+ *   4) use the bitmask to round down the maximum time, so that all last
+ *      bits are zeros
+ *
+ * Timers with nearly the same expiry thus end up on the same jiffy and
+ * expire together, with one timer interrupt instead of one each.
+ */
+static inline
+unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
+{
+	unsigned long expires_limit, mask;
+	int bit;
+
+	expires_limit = expires;
+
+	if (timer->slack >= 0) {
+		expires_limit = expires + timer->slack;
+	} else {
+		unsigned long now = jiffies;
+
+		/* No slack, if already expired else auto slack 0.4% */
+		if (time_after(expires, now))
+			expires_limit = expires + (expires - now) / 256;
+	}
+	mask = expires ^ expires_limit;
+	if (mask == 0)
+		return expires;
+
+	bit = find_last_bit(&mask, BITS_PER_LONG);
+
+	mask = (1UL << bit) - 1;
+
+	expires_limit = expires_limit & ~(mask);
+
+	return expires_limit;
+}
+
 /**
  * mod_timer - modify a timer's timeout
  * @timer: the timer to be modified
@@ -694,6 +742,8 @@ EXPORT_SYMBOL(mod_timer_pending);
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
+	expires = apply_slack(timer, expires);
+
 	/*
 	 * This is a common optimization triggered by the
 	 * networking code - if the timer is re-modified
@@ -706,6 +756,25 @@ int mod_timer(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer);
 
+/**
+ * set_timer_slack - set the allowed slack for a timer
+ * @timer: the timer to be modified
+ * @slack_hz: the amount of time (in jiffies) allowed for rounding
+ *
+ * Set the amount of time, in jiffies, that a certain timer has
+ * in terms of slack. By setting this value, the timer subsystem
+ * will schedule the actual timer somewhere between
+ * the time mod_timer() asks for, and that time plus the slack.
+ *
+ * By setting the slack to -1, a percentage of the delay is used
+ * instead, which is the default; a slack of 0 keeps the timer exact.
+ */
+void set_timer_slack(struct timer_list *timer, int slack_hz)
+{
+	timer->slack = slack_hz;
+}
+EXPORT_SYMBOL_GPL(set_timer_slack);
+
 /**
  * add_timer - start a timer
  * @timer: the timer to be added
@@ -751,9 +820,11 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	 * active. We are protected against the other CPU fiddling
 	 * with the timer by holding the timer base lock. This also
 	 * makes sure that a CPU on the way to idle can not evaluate
-	 * the timer wheel.
+	 * the timer wheel. The same goes for a CPU which stopped its
+	 * tick for a busy task.
 	 */
 	wake_up_idle_cpu(cpu);
+	tick_nohz_adaptive_kick(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 
@@ -908,6 +979,8 @@ static inline void __run_timers(struct tvec_base *base)
 			cascade(base, &base->tv5, INDEX(3));
 		++base->timer_jiffies;
 		list_replace_init(base->tv1.vec + index, &work_list);
+		if (!list_empty(head))
+			base->nr_expiries++;
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -915,6 +988,7 @@ static inline void __run_timers(struct tvec_base *base)
 			timer = list_first_entry(head, struct timer_list,entry);
 			fn = timer->function;
 			data = timer->data;
+			base->nr_expired++;
 
 			timer_stats_account_timer(timer);
 
@@ -966,6 +1040,24 @@ static inline void __run_timers(struct tvec_base *base)
 	spin_unlock_irq(&base->lock);
 }
 
+/**
+ * timer_wheel_stats - expiry statistics of the timer wheel of a cpu
+ * @cpu: the cpu in question
+ * @nr_expiries: returns the number of jiffies at which timers expired
+ * @nr_expired: returns the number of timers which expired
+ *
+ * The more timers expire together, the fewer timer interrupts it takes
+ * to run them; used by /proc/timer_list.
+ */
+void timer_wheel_stats(int cpu, unsigned long *nr_expiries,
+		       unsigned long *nr_expired)
+{
+	struct tvec_base *base = per_cpu(tvec_bases, cpu);
+
+	*nr_expiries = base->nr_expiries;
+	*nr_expired = base->nr_expired;
+}
+
 #ifdef CONFIG_NO_HZ
 /*
  * Find out when the next timer event is due to happen. This
@@ -14,6 +14,14 @@
  *   Theodore Ts'o <tytso@mit.edu>
  *
  * Made to use alloc_percpu by Christoph Lameter.
+ *
+ * Works are executed by pools of worker threads shared by all
+ * workqueues: every cpu has one pool for normal and one for realtime
+ * workqueues (struct global_cwq).  A pool keeps only as many workers
+ * running as are needed to keep the cpu busy: the scheduler tells it
+ * when a running worker goes to sleep, and another worker is woken up
+ * if works are pending.  Idle workers are retired after a while, new
+ * ones are forked when the last idle worker starts working.
  */
 
 #include <linux/module.h>
@@ -33,22 +41,140 @@
 #include <linux/kallsyms.h>
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
+#include <linux/idr.h>
+#include <linux/hash.h>
 #include <trace/workqueue.h>
 
+#include "workqueue_sched.h"
+
+enum {
+	/* worker flags */
+	WORKER_STARTED		= 1 << 0,	/* started */
+	WORKER_DIE		= 1 << 1,	/* die die die */
+	WORKER_IDLE		= 1 << 2,	/* is idle */
+	WORKER_PREP		= 1 << 3,	/* preparing to run works */
+	WORKER_UNBOUND		= 1 << 4,	/* not bound to the pool's cpu */
+	WORKER_REBIND		= 1 << 5,	/* has to bind to the pool's cpu */
+
+	WORKER_NOT_RUNNING	= WORKER_IDLE | WORKER_PREP | WORKER_UNBOUND |
+				  WORKER_REBIND,
+
+	/* global_cwq flags */
+	GCWQ_MANAGE_WORKERS	= 1 << 0,	/* need to manage workers */
+	GCWQ_MANAGING_WORKERS	= 1 << 1,	/* managing workers */
+	GCWQ_DISASSOCIATED	= 1 << 2,	/* cpu is offline */
+
+	NR_WORKER_POOLS		= 2,		/* normal and realtime */
+	RT_POOL_MIN_WORKERS	= 2,		/* see gcwq_populate() */
+
+	BUSY_WORKER_HASH_ORDER	= 4,		/* 16 pointers */
+	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
+
+	WORK_NR_COLORS		= 2,		/* flush colors */
+
+	MAX_IDLE_WORKERS_RATIO	= 4,		/* 1/4 of busy can be idle */
+	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* keep idle ones for 5 mins */
+
+	MAYDAY_INITIAL_TIMEOUT	= HZ / 100 >= 2 ? HZ / 100 : 2,
+						/* call for help after 10ms
+						   (min two ticks) */
+	MAYDAY_INTERVAL		= HZ / 10,	/* and then every 100ms */
+	CREATE_COOLDOWN		= HZ,		/* time to breath after fail */
+
+	WORKER_NICE_LEVEL	= -5,
+	WQ_MAX_ACTIVE		= 512,		/* workqueue_set_max_active() */
+};
+
 /*
- * The per-CPU workqueue (if single thread, we always use the first
- * possible cpu).
+ * Structure fields follow one of the following exclusion rules.
+ *
+ * I: Set during initialization and read-only afterwards.
+ *
+ * L: gcwq->lock protected.  Access with gcwq->lock held.
+ *
+ * X: During normal operation, modification requires gcwq->lock and
+ *    should be done only from the local cpu.  Either disabling
+ *    preemption on the local cpu or grabbing gcwq->lock is enough for
+ *    read access.
+ *
+ * F: wq->flush_mutex protected.
+ *
+ * W: workqueue_lock protected.
  */
-struct cpu_workqueue_struct {
 
-	spinlock_t lock;
+struct global_cwq;
 
-	struct list_head worklist;
-	wait_queue_head_t more_work;
-	struct work_struct *current_work;
+/*
+ * The poor guys doing the actual heavy lifting.  A worker is either
+ * idle on gcwq->idle_list, busy on gcwq->busy_hash or managing the
+ * pool.
+ */
+struct worker {
+	struct list_head	entry;		/* L: on idle list while idle */
+	struct hlist_node	hentry;		/* L: on busy hash while busy */
+	struct list_head	node;		/* L: on gcwq->workers */
+
+	struct work_struct	*current_work;	/* L: work being processed */
+	struct cpu_workqueue_struct *current_cwq; /* L: current_work's cwq */
+	struct list_head	scheduled;	/* L: scheduled works */
+	struct list_head	barriers;	/* L: flushers of current_work */
+	struct task_struct	*task;		/* I: worker task */
+	struct global_cwq	*gcwq;		/* I: the associated gcwq */
+	unsigned long		last_active;	/* L: last active timestamp */
+	unsigned int		flags;		/* X: flags */
+	int			id;		/* I: worker id */
+};
 
-	struct workqueue_struct *wq;
-	struct task_struct *thread;
+/*
+ * A pool of workers serving all workqueues of one kind on one cpu.
+ * Works of all those workqueues are queued on ->worklist in the order
+ * they became active.
+ */
+struct global_cwq {
+	spinlock_t		lock;		/* the gcwq lock */
+	struct list_head	worklist;	/* L: list of pending works */
+	unsigned int		cpu;		/* I: the associated cpu */
+	int			rt;		/* I: realtime pool */
+	unsigned int		flags;		/* L: GCWQ_* flags */
+
+	/*
+	 * Number of workers which are executing works and are not
+	 * sleeping.  Only modified on the local cpu, see
+	 * wq_worker_sleeping().
+	 */
+	atomic_t		nr_running;	/* X: nr of running workers */
+
+	int			nr_workers;	/* L: total number of workers */
+	int			nr_idle;	/* L: currently idle ones */
+
+	struct list_head	idle_list;	/* X: list of idle workers */
+	struct hlist_head	busy_hash[BUSY_WORKER_HASH_SIZE];
+						/* L: hash of busy workers */
+	struct list_head	workers;	/* L: all started workers */
+	struct list_head	barriers;	/* L: flushers of pending works */
+
+	struct timer_list	idle_timer;	/* L: worker idle timeout */
+	struct timer_list	mayday_timer;	/* L: SOS timer for workers */
+
+	struct ida		worker_ida;	/* L: for worker IDs */
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The per-CPU part of a workqueue (if single thread, we always use the
+ * first possible cpu).  Works are counted here while in flight, and
+ * works beyond ->max_active wait on ->delayed_works until they may go
+ * to the pool.
+ */
+struct cpu_workqueue_struct {
+	struct global_cwq	*gcwq;		/* I: the associated gcwq */
+	struct workqueue_struct	*wq;		/* I: the owning workqueue */
+	int			work_color;	/* L: color of new works */
+	int			flush_color;	/* L: flushing color, -1 if none */
+	int			nr_in_flight[WORK_NR_COLORS];
+						/* L: nr of works in flight */
+	int			nr_active;	/* L: nr of active works */
+	int			max_active;	/* L: max active works */
+	struct list_head	delayed_works;	/* L: delayed works */
 } ____cacheline_aligned;
 
 /*
@@ -56,33 +182,44 @@ struct cpu_workqueue_struct {
  * per-CPU workqueues:
  */
 struct workqueue_struct {
-	struct cpu_workqueue_struct *cpu_wq;
-	struct list_head list;
-	const char *name;
-	int singlethread;
-	int freezeable;		/* Freeze threads during suspend */
-	int rt;
+	struct cpu_workqueue_struct *cpu_wq;	/* I: cwq's */
+	struct list_head	list;		/* W: list of all workqueues */
+	const char		*name;		/* I: workqueue name */
+	int			singlethread;
+	int			freezeable;	/* Freeze works during suspend */
+	int			rt;
+	int			saved_max_active; /* W: saved cwq max_active */
+
+	struct mutex		flush_mutex;	/* serializes flushers */
+	atomic_t		nr_cwqs_to_flush; /* F: flush in progress */
+	struct completion	flush_done;	/* F: last cwq flushed */
+
+	cpumask_var_t		mayday_mask;	/* cpus requesting rescue */
+	struct worker		*rescuer;	/* I: rescue worker */
 #ifdef CONFIG_LOCKDEP
-	struct lockdep_map lockdep_map;
+	struct lockdep_map	lockdep_map;
 #endif
 };
 
 /* Serializes the accesses to the list of workqueues. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
+static bool workqueue_freezing;		/* W: have wqs started freezing? */
+
+static DEFINE_PER_CPU(struct global_cwq, global_cwq);
+static DEFINE_PER_CPU(struct global_cwq, global_cwq_rt);
 
 static int singlethread_cpu __read_mostly;
 static const struct cpumask *cpu_singlethread_map __read_mostly;
-/*
- * _cpu_down() first removes CPU from cpu_online_map, then CPU_DEAD
- * flushes cwq->worklist. This means that flush_workqueue/wait_on_work
- * which comes in between can't use for_each_online_cpu(). We could
- * use cpu_possible_map, the cpumask below is more a documentation
- * than optimization.
- */
-static cpumask_var_t cpu_populated_map __read_mostly;
 
-/* If it's single threaded, it isn't in the list of workqueues. */
+static int worker_thread(void *__worker);
+
+static struct global_cwq *get_gcwq(unsigned int cpu, int rt)
+{
+	return rt ? &per_cpu(global_cwq_rt, cpu) : &per_cpu(global_cwq, cpu);
+}
+
+/* If it's single threaded, it's served by the pool of one cpu only. */
 static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 {
 	return wq->singlethread;
@@ -91,7 +228,7 @@ static inline int is_wq_single_threaded(struct workqueue_struct *wq)
 static const struct cpumask *wq_cpu_map(struct workqueue_struct *wq)
 {
 	return is_wq_single_threaded(wq)
-		? cpu_singlethread_map : cpu_populated_map;
+		? cpu_singlethread_map : cpu_possible_mask;
 }
 
 static
@@ -107,15 +244,13 @@ struct cpu_workqueue_struct *wq_per_cpu(struct workqueue_struct *wq, int cpu)
  * - Must *only* be called if the pending flag is set
  */
 static inline void set_wq_data(struct work_struct *work,
-				struct cpu_workqueue_struct *cwq)
+				struct cpu_workqueue_struct *cwq,
+				unsigned long extra_flags)
 {
-	unsigned long new;
-
 	BUG_ON(!work_pending(work));
 
-	new = (unsigned long) cwq | (1UL << WORK_STRUCT_PENDING);
-	new |= WORK_STRUCT_FLAG_MASK & *work_data_bits(work);
-	atomic_long_set(&work->data, new);
+	atomic_long_set(&work->data, (unsigned long)cwq |
+			(1UL << WORK_STRUCT_PENDING) | extra_flags);
 }
 
 static inline
@@ -124,31 +259,348 @@ struct cpu_workqueue_struct *get_wq_data(struct work_struct *work)
 	return (void *) (atomic_long_read(&work->data) & WORK_STRUCT_WQ_DATA_MASK);
 }
 
+static inline int get_work_color(struct work_struct *work)
+{
+	return (atomic_long_read(&work->data) >> WORK_STRUCT_COLOR) & 1;
+}
+
+/*
+ * Policy functions.  These define the policies on how the worker pool
+ * is managed.  Unless noted otherwise, these functions assume that
+ * they're being called with gcwq->lock held.
+ */
+
+static bool __need_more_worker(struct global_cwq *gcwq)
+{
+	return !atomic_read(&gcwq->nr_running) ||
+		(gcwq->flags & GCWQ_DISASSOCIATED);
+}
+
+/*
+ * Need to wake up a worker?  Called from anything but currently
+ * running workers.
+ */
+static bool need_more_worker(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->worklist) && __need_more_worker(gcwq);
+}
+
+/* Can I start working?  Called from busy but !running workers. */
+static bool may_start_working(struct global_cwq *gcwq)
+{
+	return gcwq->nr_idle;
+}
+
+/* Do I need to keep working?  Called from currently running workers. */
+static bool keep_working(struct global_cwq *gcwq)
+{
+	return !list_empty(&gcwq->worklist) &&
+		(atomic_read(&gcwq->nr_running) <= 1 ||
+		 (gcwq->flags & GCWQ_DISASSOCIATED));
+}
+
+/* Do we need a new worker?  Called from manager. */
+static bool need_to_create_worker(struct global_cwq *gcwq)
+{
+	return need_more_worker(gcwq) && !may_start_working(gcwq);
+}
+
+/* Do I need to be the manager? */
+static bool need_to_manage_workers(struct global_cwq *gcwq)
+{
+	return need_to_create_worker(gcwq) ||
+		(gcwq->flags & GCWQ_MANAGE_WORKERS);
+}
+
+/* Do we have too many workers and should some go away? */
+static bool too_many_workers(struct global_cwq *gcwq)
+{
+	bool managing = gcwq->flags & GCWQ_MANAGING_WORKERS;
+	int nr_idle = gcwq->nr_idle + managing; /* manager is considered idle */
+	int nr_busy = gcwq->nr_workers - nr_idle;
+
+	return nr_idle > 2 && (nr_idle - 2) * MAX_IDLE_WORKERS_RATIO >= nr_busy;
+}
+
+/*
+ * Wake up functions.
+ */
+
+/* Return the first idle worker.  Safe with preemption disabled */
+static struct worker *first_worker(struct global_cwq *gcwq)
+{
+	if (unlikely(list_empty(&gcwq->idle_list)))
+		return NULL;
+
+	return list_first_entry(&gcwq->idle_list, struct worker, entry);
+}
+
+/* Wake up the first idle worker of @gcwq, if any. */
+static void wake_up_worker(struct global_cwq *gcwq)
+{
+	struct worker *worker = first_worker(gcwq);
+
+	if (likely(worker))
+		wake_up_process(worker->task);
+}
+
+/**
+ * wq_worker_waking_up - a worker is waking up
+ * @task: task waking up
+ * @cpu: CPU @task is waking up to
+ *
+ * This function is called during try_to_wake_up() when a worker is
+ * being awoken.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ */
+void wq_worker_waking_up(struct task_struct *task, unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task);
+
+	if (likely(!(worker->flags & WORKER_NOT_RUNNING)) &&
+	    worker->gcwq->cpu == cpu)
+		atomic_inc(&worker->gcwq->nr_running);
+}
+
+/**
+ * wq_worker_sleeping - a worker is going to sleep
+ * @task: task going to sleep
+ * @cpu: CPU in question, must be the current CPU number
+ *
+ * This function is called during schedule() when a busy worker is
+ * going to sleep.  Worker on the same cpu can be woken up by
+ * returning pointer to its task.
+ *
+ * CONTEXT:
+ * spin_lock_irq(rq->lock)
+ *
+ * RETURNS:
+ * Worker task on @cpu to wake up, %NULL if none.
+ */
+struct task_struct *wq_worker_sleeping(struct task_struct *task,
+				       unsigned int cpu)
+{
+	struct worker *worker = kthread_data(task), *to_wakeup;
+	struct global_cwq *gcwq = worker->gcwq;
+	struct list_head *first;
+
+	if (unlikely(worker->flags & WORKER_NOT_RUNNING) || gcwq->cpu != cpu)
+		return NULL;
+
+	/*
+	 * The counterpart of the following dec_and_test, implied mb,
+	 * worklist not empty test sequence is in insert_work().
+	 * Please read comment there.
+	 */
+	if (!atomic_dec_and_test(&gcwq->nr_running) ||
+	    list_empty(&gcwq->worklist))
+		return NULL;
+
+	/*
+	 * While the cpu is online, workers are added to and removed from
+	 * the idle list only on this cpu, and we're in the middle of
+	 * schedule() here, so the list can be peeked without gcwq->lock.
+	 * A worker which hasn't bound itself to the cpu yet may be
+	 * somewhere else; it is woken up through gcwq->lock instead.
+	 */
+	first = ACCESS_ONCE(gcwq->idle_list.next);
+	if (first == &gcwq->idle_list)
+		return NULL;
+
+	to_wakeup = list_entry(first, struct worker, entry);
+	if ((to_wakeup->flags & WORKER_UNBOUND) ||
+	    task_cpu(to_wakeup->task) != cpu)
+		return NULL;
+
+	return to_wakeup->task;
+}
+
+/**
+ * worker_set_flags - set worker flags and adjust nr_running accordingly
+ * @worker: self
+ * @flags: flags to set
+ * @wakeup: wakeup an idle worker if necessary
+ *
+ * Set @flags in @worker->flags and adjust nr_running accordingly.  If
+ * nr_running becomes zero and @wakeup is %true, an idle worker is
+ * woken up.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock)
+ */
+static inline void worker_set_flags(struct worker *worker, unsigned int flags,
+				    bool wakeup)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	WARN_ON_ONCE(worker->task != current);
+
+	/*
+	 * If transitioning into NOT_RUNNING, adjust nr_running and
+	 * wake up an idle worker as necessary if requested by
+	 * @wakeup.
+	 */
+	if ((flags & WORKER_NOT_RUNNING) &&
+	    !(worker->flags & WORKER_NOT_RUNNING)) {
+		if (wakeup) {
+			if (atomic_dec_and_test(&gcwq->nr_running) &&
+			    !list_empty(&gcwq->worklist))
+				wake_up_worker(gcwq);
+		} else
+			atomic_dec(&gcwq->nr_running);
+	}
+
+	worker->flags |= flags;
+}
+
+/**
+ * worker_clr_flags - clear worker flags and adjust nr_running accordingly
+ * @worker: self
+ * @flags: flags to clear
+ *
+ * Clear @flags in @worker->flags and adjust nr_running accordingly.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock)
+ */
+static inline void worker_clr_flags(struct worker *worker, unsigned int flags)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	unsigned int oflags = worker->flags;
+
+	WARN_ON_ONCE(worker->task != current);
+
+	worker->flags &= ~flags;
+
+	/* if transitioning out of NOT_RUNNING, increment nr_running */
+	if ((flags & WORKER_NOT_RUNNING) && (oflags & WORKER_NOT_RUNNING))
+		if (!(worker->flags & WORKER_NOT_RUNNING))
+			atomic_inc(&gcwq->nr_running);
+}
+
+/**
+ * busy_worker_head - return the busy hash head for a work
+ * @gcwq: gcwq of interest
+ * @work: work to be hashed
+ *
+ * Return hash head of @gcwq for @work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static struct hlist_head *busy_worker_head(struct global_cwq *gcwq,
+					   struct work_struct *work)
+{
+	return &gcwq->busy_hash[hash_ptr(work, BUSY_WORKER_HASH_ORDER)];
+}
+
+/**
+ * __find_worker_executing_work - find worker which is executing a work
+ * @gcwq: gcwq of interest
+ * @bwh: hash head as returned by busy_worker_head()
+ * @work: work to find worker for
+ *
+ * Find a worker which is executing @work on @gcwq.  @bwh should be
+ * the hash head obtained by calling busy_worker_head() with the same
+ * work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ *
+ * RETURNS:
+ * Pointer to worker which is executing @work if found, NULL
+ * otherwise.
+ */
+static struct worker *__find_worker_executing_work(struct global_cwq *gcwq,
+						   struct hlist_head *bwh,
+						   struct work_struct *work)
+{
+	struct worker *worker;
+	struct hlist_node *tmp;
+
+	hlist_for_each_entry(worker, tmp, bwh, hentry)
+		if (worker->current_work == work)
+			return worker;
+	return NULL;
+}
+
+static struct worker *find_worker_executing_work(struct global_cwq *gcwq,
+						 struct work_struct *work)
+{
+	return __find_worker_executing_work(gcwq, busy_worker_head(gcwq, work),
+					    work);
+}
+
 DEFINE_TRACE(workqueue_insertion);
 
+/**
+ * insert_work - insert a work into a list
+ * @cwq: cwq @work belongs to
+ * @work: work to insert
+ * @head: insertion point
+ * @extra_flags: extra WORK_STRUCT_* flags to set
+ *
+ * Insert @work which belongs to @cwq after @head and wake up a worker
+ * if the pool has none running.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
 static void insert_work(struct cpu_workqueue_struct *cwq,
-			struct work_struct *work, struct list_head *head)
+			struct work_struct *work, struct list_head *head,
+			unsigned long extra_flags)
 {
-	trace_workqueue_insertion(cwq->thread, work);
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct worker *worker = first_worker(gcwq);
+
+	if (worker)
+		trace_workqueue_insertion(worker->task, work);
 
-	set_wq_data(work, cwq);
+	set_wq_data(work, cwq, extra_flags);
 	/*
 	 * Ensure that we get the right work->data if we see the
 	 * result of list_add() below, see try_to_grab_pending().
 	 */
 	smp_wmb();
 	list_add_tail(&work->entry, head);
-	wake_up(&cwq->more_work);
+
+	/*
+	 * Ensure either wq_worker_sleeping() sees the above
+	 * list_add_tail() or we see zero nr_running to avoid workers
+	 * lying around lazily while there are works to be processed.
+	 */
+	smp_mb();
+
+	if (__need_more_worker(gcwq))
+		wake_up_worker(gcwq);
 }
 
 static void __queue_work(struct cpu_workqueue_struct *cwq,
 			 struct work_struct *work)
 {
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct list_head *worklist;
+	unsigned long work_flags;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cwq->lock, flags);
-	insert_work(cwq, work, &cwq->worklist);
-	spin_unlock_irqrestore(&cwq->lock, flags);
+	spin_lock_irqsave(&gcwq->lock, flags);
+
+	cwq->nr_in_flight[cwq->work_color]++;
+	work_flags = (unsigned long)cwq->work_color << WORK_STRUCT_COLOR;
+
+	if (likely(cwq->nr_active < cwq->max_active)) {
+		cwq->nr_active++;
+		worklist = &gcwq->worklist;
+	} else {
+		work_flags |= 1UL << WORK_STRUCT_DELAYED;
+		worklist = &cwq->delayed_works;
+	}
+
+	insert_work(cwq, work, worklist, work_flags);
+
+	spin_unlock_irqrestore(&gcwq->lock, flags);
 }
 
 /**
@@ -247,7 +699,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		timer_stats_timer_set_start_info(&dwork->timer);
 
 		/* This stores cwq for the moment, for the timer_fn */
-		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id()));
+		set_wq_data(work, wq_per_cpu(wq, raw_smp_processor_id()), 0);
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
 		timer->function = delayed_work_timer_fn;
@@ -262,125 +714,851 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 }
 EXPORT_SYMBOL_GPL(queue_delayed_work_on);
 
-DEFINE_TRACE(workqueue_execution);
+/**
+ * worker_enter_idle - enter idle state
+ * @worker: worker which is entering idle state
+ *
+ * @worker is entering idle state.  Update stats and idle timer if
+ * necessary.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void worker_enter_idle(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	BUG_ON(worker->flags & WORKER_IDLE);
+	BUG_ON(!list_empty(&worker->entry));
+
+	/* can't use worker_set_flags(), also called from start_worker() */
+	worker->flags |= WORKER_IDLE;
+	gcwq->nr_idle++;
+	worker->last_active = jiffies;
+
+	/* idle_list is LIFO */
+	list_add(&worker->entry, &gcwq->idle_list);
+
+	if (too_many_workers(gcwq) && !timer_pending(&gcwq->idle_timer))
+		mod_timer(&gcwq->idle_timer, jiffies + IDLE_WORKER_TIMEOUT);
+}
+
+/**
+ * worker_leave_idle - leave idle state
+ * @worker: worker which is leaving idle state
+ *
+ * @worker is leaving idle state.  Update stats.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void worker_leave_idle(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	BUG_ON(!(worker->flags & WORKER_IDLE));
+	worker_clr_flags(worker, WORKER_IDLE);
+	gcwq->nr_idle--;
+	list_del_init(&worker->entry);
+}
 
-static void run_workqueue(struct cpu_workqueue_struct *cwq)
+/**
+ * worker_maybe_bind_and_lock - bind worker to its cpu if possible and lock gcwq
+ * @worker: self
+ *
+ * Works which are queued while the cpu is online must be executed on
+ * that cpu, so a worker has to be bound to its cpu before it executes
+ * any.  kthread_bind() can't be used as the cpu may go down or come
+ * up under us, and set_cpus_allowed_ptr() is best effort.  Retry until
+ * either the worker runs on the cpu or the cpu is gone.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock but returns with gcwq->lock
+ * held.
+ *
+ * RETURNS:
+ * %true if the associated gcwq is online (@worker is successfully
+ * bound), %false if offline.
+ */
+static bool worker_maybe_bind_and_lock(struct worker *worker)
+__acquires(&gcwq->lock)
 {
-	spin_lock_irq(&cwq->lock);
-	while (!list_empty(&cwq->worklist)) {
-		struct work_struct *work = list_entry(cwq->worklist.next,
-						struct work_struct, entry);
-		work_func_t f = work->func;
-#ifdef CONFIG_LOCKDEP
+	struct global_cwq *gcwq = worker->gcwq;
+	struct task_struct *task = worker->task;
+
+	while (true) {
 		/*
-		 * It is permissible to free the struct work_struct
-		 * from inside the function that is called from it,
-		 * this we need to take into account for lockdep too.
-		 * To avoid bogus "held lock freed" warnings as well
-		 * as problems when looking into work->lockdep_map,
-		 * make a copy and use that here.
+		 * The following call may fail, succeed or succeed
+		 * without actually migrating the task to the cpu if
+		 * it races with cpu hotunplug operation.  Verify
+		 * against GCWQ_DISASSOCIATED.
 		 */
-		struct lockdep_map lockdep_map = work->lockdep_map;
-#endif
-		trace_workqueue_execution(cwq->thread, work);
-		cwq->current_work = work;
-		list_del_init(cwq->worklist.next);
-		spin_unlock_irq(&cwq->lock);
-
-		BUG_ON(get_wq_data(work) != cwq);
-		work_clear_pending(work);
-		lock_map_acquire(&cwq->wq->lockdep_map);
-		lock_map_acquire(&lockdep_map);
-		f(work);
-		lock_map_release(&lockdep_map);
-		lock_map_release(&cwq->wq->lockdep_map);
-
-		if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
-			printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
-					"%s/0x%08x/%d\n",
-					current->comm, preempt_count(),
-				       	task_pid_nr(current));
-			printk(KERN_ERR "    last function: ");
-			print_symbol("%s\n", (unsigned long)f);
-			debug_show_held_locks(current);
-			dump_stack();
+		if (!(gcwq->flags & GCWQ_DISASSOCIATED))
+			set_cpus_allowed_ptr(task, cpumask_of(gcwq->cpu));
+
+		spin_lock_irq(&gcwq->lock);
+		if (gcwq->flags & GCWQ_DISASSOCIATED)
+			return false;
+		if (task_cpu(task) == gcwq->cpu &&
+		    cpumask_equal(&current->cpus_allowed,
+				  cpumask_of(gcwq->cpu)))
+			return true;
+		spin_unlock_irq(&gcwq->lock);
+
+		/*
+		 * The cpu is going down but CPU_DEAD hasn't been
+		 * processed yet, or it has just come up.  Don't spin:
+		 * a realtime worker could starve the hotplug thread.
+		 */
+		schedule_timeout_uninterruptible(1);
+	}
+}
+
+/**
+ * worker_rebind - bind a worker to the cpu of its gcwq
+ * @worker: self
+ *
+ * @worker has just been started or its cpu came back online.  Bind it
+ * to the cpu unless the cpu went away again in the meantime.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which is released and regrabbed.
+ */
+static void worker_rebind(struct worker *worker)
+__releases(&gcwq->lock)
+__acquires(&gcwq->lock)
+{
+	spin_unlock_irq(&worker->gcwq->lock);
+
+	if (worker_maybe_bind_and_lock(worker) &&
+	    (worker->flags & WORKER_REBIND)) {
+		current->flags |= PF_THREAD_BOUND;
+		worker_clr_flags(worker, WORKER_UNBOUND | WORKER_REBIND);
+	}
+}
+
+static struct worker *alloc_worker(void)
+{
+	struct worker *worker;
+
+	worker = kzalloc(sizeof(*worker), GFP_KERNEL);
+	if (worker) {
+		INIT_LIST_HEAD(&worker->entry);
+		INIT_LIST_HEAD(&worker->node);
+		INIT_LIST_HEAD(&worker->scheduled);
+		INIT_LIST_HEAD(&worker->barriers);
+		/* on creation a worker is in !idle && prep state */
+		worker->flags = WORKER_PREP;
+	}
+	return worker;
+}
+
+DEFINE_TRACE(workqueue_creation);
+
+/**
+ * create_worker - create a new workqueue worker
+ * @gcwq: gcwq the new worker will belong to
+ *
+ * Create a new worker which is attached to @gcwq.  The new worker
+ * binds itself to the cpu of @gcwq when it first runs.
+ *
+ * CONTEXT:
+ * Might sleep.  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * Pointer to the newly created worker.
+ */
+static struct worker *create_worker(struct global_cwq *gcwq)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	struct worker *worker = NULL;
+	int id = -1;
+
+	spin_lock_irq(&gcwq->lock);
+	while (ida_get_new(&gcwq->worker_ida, &id)) {
+		spin_unlock_irq(&gcwq->lock);
+		if (!ida_pre_get(&gcwq->worker_ida, GFP_KERNEL))
+			goto fail;
+		spin_lock_irq(&gcwq->lock);
+	}
+	spin_unlock_irq(&gcwq->lock);
+
+	worker = alloc_worker();
+	if (!worker)
+		goto fail;
+
+	worker->gcwq = gcwq;
+	worker->id = id;
+
+	worker->task = kthread_create(worker_thread, worker, "kworker/%u:%d%s",
+				      gcwq->cpu, id, gcwq->rt ? "R" : "");
+	if (IS_ERR(worker->task))
+		goto fail;
+
+	if (gcwq->rt)
+		sched_setscheduler_nocheck(worker->task, SCHED_FIFO, &param);
+	else
+		set_user_nice(worker->task, WORKER_NICE_LEVEL);
+
+	/* see start_worker() */
+	worker->flags |= WORKER_UNBOUND;
+
+	trace_workqueue_creation(worker->task, gcwq->cpu);
+
+	return worker;
+fail:
+	if (id >= 0) {
+		spin_lock_irq(&gcwq->lock);
+		ida_remove(&gcwq->worker_ida, id);
+		spin_unlock_irq(&gcwq->lock);
+	}
+	kfree(worker);
+	return NULL;
+}
+
+/**
+ * start_worker - start a newly created worker
+ * @worker: worker to start
+ *
+ * Make the gcwq aware of @worker and start it.  A worker of an online
+ * cpu binds itself to the cpu before it executes any work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void start_worker(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+
+	if (!(gcwq->flags & GCWQ_DISASSOCIATED))
+		worker->flags |= WORKER_REBIND;
+	worker->flags |= WORKER_STARTED;
+	gcwq->nr_workers++;
+	list_add_tail(&worker->node, &gcwq->workers);
+	worker_enter_idle(worker);
+	wake_up_process(worker->task);
+}
+
+DEFINE_TRACE(workqueue_destruction);
+
+/**
+ * destroy_worker - destroy a workqueue worker
+ * @worker: worker to be destroyed
+ *
+ * Destroy @worker and adjust @gcwq stats accordingly.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which is released and regrabbed.
+ */
+static void destroy_worker(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	int id = worker->id;
+
+	/* sanity check frenzy */
+	BUG_ON(worker->current_work);
+	BUG_ON(!list_empty(&worker->scheduled));
+
+	if (worker->flags & WORKER_STARTED)
+		gcwq->nr_workers--;
+	if (worker->flags & WORKER_IDLE)
+		gcwq->nr_idle--;
+
+	list_del_init(&worker->entry);
+	list_del_init(&worker->node);
+	worker->flags |= WORKER_DIE;
+
+	spin_unlock_irq(&gcwq->lock);
+
+	trace_workqueue_destruction(worker->task);
+	kthread_stop(worker->task);
+	kfree(worker);
+
+	spin_lock_irq(&gcwq->lock);
+	ida_remove(&gcwq->worker_ida, id);
+}
+
+static void idle_worker_timeout(unsigned long __gcwq)
+{
+	struct global_cwq *gcwq = (void *)__gcwq;
+
+	spin_lock_irq(&gcwq->lock);
+
+	if (too_many_workers(gcwq)) {
+		struct worker *worker;
+		unsigned long expires;
+
+		/* idle_list is kept in LIFO order, check the last one */
+		worker = list_entry(gcwq->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+
+		if (time_before(jiffies, expires))
+			mod_timer(&gcwq->idle_timer, expires);
+		else {
+			/* it's been idle for too long, wake up manager */
+			gcwq->flags |= GCWQ_MANAGE_WORKERS;
+			wake_up_worker(gcwq);
 		}
+	}
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
+static void send_mayday(struct work_struct *work)
+{
+	struct cpu_workqueue_struct *cwq = get_wq_data(work);
+	struct workqueue_struct *wq = cwq->wq;
+
+	/* mayday mayday mayday */
+	if (!cpumask_test_and_set_cpu(cwq->gcwq->cpu, wq->mayday_mask))
+		wake_up_process(wq->rescuer->task);
+}
+
+static void gcwq_mayday_timeout(unsigned long __gcwq)
+{
+	struct global_cwq *gcwq = (void *)__gcwq;
+	struct work_struct *work;
 
-		spin_lock_irq(&cwq->lock);
-		cwq->current_work = NULL;
+	spin_lock_irq(&gcwq->lock);
+
+	if (need_to_create_worker(gcwq)) {
+		/*
+		 * We've been trying to create a new worker but
+		 * haven't been successful.  We might be hitting an
+		 * allocation deadlock.  Send distress signals to
+		 * rescuers.
+		 */
+		list_for_each_entry(work, &gcwq->worklist, entry)
+			send_mayday(work);
 	}
-	spin_unlock_irq(&cwq->lock);
+
+	spin_unlock_irq(&gcwq->lock);
+
+	mod_timer(&gcwq->mayday_timer, jiffies + MAYDAY_INTERVAL);
 }
 
-static int worker_thread(void *__cwq)
+/**
+ * maybe_create_worker - create a new worker if necessary
+ * @gcwq: gcwq to create a new worker for
+ *
+ * Create a new worker for @gcwq if necessary.  @gcwq is guaranteed to
+ * have at least one idle worker on return from this function.  If
+ * creating a new worker takes longer than MAYDAY_INITIAL_TIMEOUT,
+ * the rescuers of the workqueues with works pending on @gcwq are
+ * called in to execute them, so that a worker creation which itself
+ * depends on those works can't deadlock.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Called only from manager.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true
+ * otherwise.
+ */
+static bool maybe_create_worker(struct global_cwq *gcwq)
+__releases(&gcwq->lock)
+__acquires(&gcwq->lock)
 {
-	struct cpu_workqueue_struct *cwq = __cwq;
-	DEFINE_WAIT(wait);
+	if (!need_to_create_worker(gcwq))
+		return false;
+restart:
+	spin_unlock_irq(&gcwq->lock);
+
+	/* if we don't make progress in MAYDAY_INITIAL_TIMEOUT, call for help */
+	mod_timer(&gcwq->mayday_timer, jiffies + MAYDAY_INITIAL_TIMEOUT);
+
+	while (true) {
+		struct worker *worker;
+
+		worker = create_worker(gcwq);
+		if (worker) {
+			del_timer_sync(&gcwq->mayday_timer);
+			spin_lock_irq(&gcwq->lock);
+			start_worker(worker);
+			BUG_ON(need_to_create_worker(gcwq));
+			return true;
+		}
 
-	if (cwq->wq->freezeable)
-		set_freezable();
+		if (!need_to_create_worker(gcwq))
+			break;
 
-	set_user_nice(current, -5);
+		__set_current_state(TASK_INTERRUPTIBLE);
+		schedule_timeout(CREATE_COOLDOWN);
 
-	for (;;) {
-		prepare_to_wait(&cwq->more_work, &wait, TASK_INTERRUPTIBLE);
-		if (!freezing(current) &&
-		    !kthread_should_stop() &&
-		    list_empty(&cwq->worklist))
-			schedule();
-		finish_wait(&cwq->more_work, &wait);
+		if (!need_to_create_worker(gcwq))
+			break;
+	}
 
-		try_to_freeze();
+	del_timer_sync(&gcwq->mayday_timer);
+	spin_lock_irq(&gcwq->lock);
+	if (need_to_create_worker(gcwq))
+		goto restart;
+	return true;
+}
 
-		if (kthread_should_stop())
+/**
+ * maybe_destroy_workers - destroy workers which have been idle for a while
+ * @gcwq: gcwq to destroy workers for
+ *
+ * Destroy @gcwq workers which have been idle for longer than
+ * IDLE_WORKER_TIMEOUT.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Called only from manager.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true
+ * otherwise.
+ */
+static bool maybe_destroy_workers(struct global_cwq *gcwq)
+{
+	bool ret = false;
+
+	while (too_many_workers(gcwq)) {
+		struct worker *worker;
+		unsigned long expires;
+
+		worker = list_entry(gcwq->idle_list.prev, struct worker, entry);
+		expires = worker->last_active + IDLE_WORKER_TIMEOUT;
+
+		if (time_before(jiffies, expires)) {
+			mod_timer(&gcwq->idle_timer, expires);
 			break;
+		}
 
-		run_workqueue(cwq);
+		destroy_worker(worker);
+		ret = true;
 	}
 
-	return 0;
+	return ret;
+}
+
+/**
+ * manage_workers - manage worker pool
+ * @worker: self
+ *
+ * Assume the manager role and manage gcwq worker pool @worker belongs
+ * to.  At any given time, there can be only zero or one manager per
+ * gcwq.  The exclusion is handled automatically by this function.
+ *
+ * The caller can safely start processing works on false return.  On
+ * true return, it's guaranteed that need_to_create_worker() is false
+ * and may_start_working() is true.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * false if no action was taken and gcwq->lock stayed locked, true if
+ * some action was taken.
+ */
+static bool manage_workers(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	bool ret = false;
+
+	if (gcwq->flags & GCWQ_MANAGING_WORKERS)
+		return ret;
+
+	gcwq->flags &= ~GCWQ_MANAGE_WORKERS;
+	gcwq->flags |= GCWQ_MANAGING_WORKERS;
+
+	/*
+	 * Destroy and then create so that may_start_working() is true
+	 * on return.
+	 */
+	ret |= maybe_destroy_workers(gcwq);
+	ret |= maybe_create_worker(gcwq);
+
+	gcwq->flags &= ~GCWQ_MANAGING_WORKERS;
+
+	return ret;
 }
 
-struct wq_barrier {
-	struct work_struct	work;
-	struct completion	done;
-};
+/*
+ * Structure used to wait for a work to finish: the barrier is queued
+ * on gcwq->barriers while the work is pending and moved to the
+ * executing worker when it starts.
+ */
+struct wq_barrier {
+	struct work_struct	*work;
+	struct list_head	entry;
+	struct completion	done;
+};
+
+static void insert_wq_barrier(struct wq_barrier *barr,
+			struct work_struct *work, struct list_head *head)
+{
+	barr->work = work;
+	init_completion(&barr->done);
+	list_add_tail(&barr->entry, head);
+}
+
+/*
+ * Complete the barriers on @head which wait for @work, or all of them
+ * if @work is NULL.
+ */
+static void complete_wq_barriers(struct list_head *head,
+				 struct work_struct *work)
+{
+	struct wq_barrier *barr, *n;
+
+	list_for_each_entry_safe(barr, n, head, entry) {
+		if (work && barr->work != work)
+			continue;
+		list_del_init(&barr->entry);
+		complete(&barr->done);
+	}
+}
+
+/**
+ * cwq_activate_first_delayed - activate the first delayed work of a cwq
+ * @cwq: cwq whose first delayed work is to be activated
+ *
+ * Move the first work held back by max_active to the worklist of the
+ * pool and wake up a worker if necessary.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct work_struct *work = list_first_entry(&cwq->delayed_works,
+						    struct work_struct, entry);
+
+	clear_bit(WORK_STRUCT_DELAYED, work_data_bits(work));
+	list_move_tail(&work->entry, &gcwq->worklist);
+	cwq->nr_active++;
+
+	if (need_more_worker(gcwq))
+		wake_up_worker(gcwq);
+}
+
+/**
+ * cwq_dec_nr_in_flight - decrement cwq's nr_in_flight
+ * @cwq: cwq of interest
+ * @color: color of work which left the queue
+ * @delayed: for a delayed work
+ *
+ * A work either has completed or is removed from pending queue,
+ * decrement nr_in_flight of its cwq and handle workqueue flushing.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
+				 bool delayed)
+{
+	cwq->nr_in_flight[color]--;
+
+	if (!delayed) {
+		cwq->nr_active--;
+		if (!list_empty(&cwq->delayed_works) &&
+		    cwq->nr_active < cwq->max_active)
+			cwq_activate_first_delayed(cwq);
+	}
+
+	/* is flush in progress and are we the last of the flush color? */
+	if (likely(cwq->flush_color != color) || cwq->nr_in_flight[color])
+		return;
+
+	cwq->flush_color = -1;
+	if (atomic_dec_and_test(&cwq->wq->nr_cwqs_to_flush))
+		complete(&cwq->wq->flush_done);
+}
+
+DEFINE_TRACE(workqueue_execution);
+
+/**
+ * process_one_work - process single work
+ * @worker: self
+ * @work: work to process
+ *
+ * Process @work.  This function contains all the logics necessary to
+ * process a single work including synchronization against and
+ * interaction with other workers on the same cpu, queueing and
+ * flushing.  As long as context requirement is met, any worker can
+ * call this function to process a work.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which is released and regrabbed.
+ */
+static void process_one_work(struct worker *worker, struct work_struct *work)
+__releases(&gcwq->lock)
+__acquires(&gcwq->lock)
+{
+	struct cpu_workqueue_struct *cwq = get_wq_data(work);
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct hlist_head *bwh = busy_worker_head(gcwq, work);
+	work_func_t f = work->func;
+	struct worker *collision;
+	int work_color;
+#ifdef CONFIG_LOCKDEP
+	/*
+	 * It is permissible to free the struct work_struct
+	 * from inside the function that is called from it,
+	 * this we need to take into account for lockdep too.
+	 * To avoid bogus "held lock freed" warnings as well
+	 * as problems when looking into work->lockdep_map,
+	 * make a copy and use that here.
+	 */
+	struct lockdep_map lockdep_map = work->lockdep_map;
+#endif
+	/*
+	 * A single work shouldn't be executed concurrently by
+	 * multiple workers on a single cpu.  Check whether anyone is
+	 * already processing the work.  If so, defer the work to the
+	 * currently executing one.
+	 */
+	collision = __find_worker_executing_work(gcwq, bwh, work);
+	if (unlikely(collision)) {
+		list_move_tail(&work->entry, &collision->scheduled);
+		return;
+	}
+
+	/* claim and process */
+	trace_workqueue_execution(worker->task, work);
+	hlist_add_head(&worker->hentry, bwh);
+	worker->current_work = work;
+	worker->current_cwq = cwq;
+	work_color = get_work_color(work);
+	list_del_init(&work->entry);
+
+	/* flushers of @work now wait for it to finish */
+	if (unlikely(!list_empty(&gcwq->barriers))) {
+		struct wq_barrier *barr, *n;
+
+		list_for_each_entry_safe(barr, n, &gcwq->barriers, entry)
+			if (barr->work == work)
+				list_move_tail(&barr->entry,
+					       &worker->barriers);
+	}
+
+	/*
+	 * Without concurrency management, which is the case after the
+	 * cpu went down, each pending work gets a worker of its own.
+	 */
+	if (unlikely(gcwq->flags & GCWQ_DISASSOCIATED) &&
+	    need_more_worker(gcwq))
+		wake_up_worker(gcwq);
+
+	spin_unlock_irq(&gcwq->lock);
+
+	BUG_ON(get_wq_data(work) != cwq);
+	work_clear_pending(work);
+	lock_map_acquire(&cwq->wq->lockdep_map);
+	lock_map_acquire(&lockdep_map);
+	f(work);
+	lock_map_release(&lockdep_map);
+	lock_map_release(&cwq->wq->lockdep_map);
+
+	if (unlikely(in_atomic() || lockdep_depth(current) > 0)) {
+		printk(KERN_ERR "BUG: workqueue leaked lock or atomic: "
+				"%s/0x%08x/%d\n",
+				current->comm, preempt_count(),
+			       	task_pid_nr(current));
+		printk(KERN_ERR "    last function: ");
+		print_symbol("%s\n", (unsigned long)f);
+		debug_show_held_locks(current);
+		dump_stack();
+	}
+
+	spin_lock_irq(&gcwq->lock);
+
+	/* we're done with it, release */
+	hlist_del_init(&worker->hentry);
+	worker->current_work = NULL;
+	worker->current_cwq = NULL;
+	complete_wq_barriers(&worker->barriers, NULL);
+	cwq_dec_nr_in_flight(cwq, work_color, false);
+}
+
+/**
+ * process_scheduled_works - process scheduled works
+ * @worker: self
+ *
+ * Process all scheduled works.  Please note that the scheduled list
+ * may change while processing a work, so this function repeatedly
+ * fetches a work from the top and executes it.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock) which may be released and regrabbed
+ * multiple times.
+ */
+static void process_scheduled_works(struct worker *worker)
+{
+	while (!list_empty(&worker->scheduled)) {
+		struct work_struct *work = list_first_entry(&worker->scheduled,
+						struct work_struct, entry);
+		process_one_work(worker, work);
+	}
+}
+
+/**
+ * worker_thread - the worker thread function
+ * @__worker: self
+ *
+ * The gcwq worker thread function.  There's a single dynamic pool of
+ * these per each cpu and kind.  These workers process all works
+ * regardless of their specific target workqueue.  The only exception
+ * is works which belong to workqueues with a rescuer which will be
+ * explained in rescuer_thread().
+ */
+static int worker_thread(void *__worker)
+{
+	struct worker *worker = __worker;
+	struct global_cwq *gcwq = worker->gcwq;
+
+	/* tell the scheduler that this is a workqueue worker */
+	current->flags |= PF_WQ_WORKER;
+woke_up:
+	spin_lock_irq(&gcwq->lock);
+
+	/* DIE can be set only while we're idle, checking here is enough */
+	if (unlikely(worker->flags & WORKER_DIE)) {
+		spin_unlock_irq(&gcwq->lock);
+		current->flags &= ~PF_WQ_WORKER;
+
+		/* wait for destroy_worker() to stop us */
+		set_current_state(TASK_INTERRUPTIBLE);
+		while (!kthread_should_stop()) {
+			schedule();
+			set_current_state(TASK_INTERRUPTIBLE);
+		}
+		__set_current_state(TASK_RUNNING);
+		return 0;
+	}
+
+	worker_leave_idle(worker);
+recheck:
+	if (unlikely(worker->flags & WORKER_REBIND))
+		worker_rebind(worker);
+
+	/* no more worker necessary? */
+	if (!need_more_worker(gcwq))
+		goto sleep;
+
+	/* do we need to manage? */
+	if (unlikely(!may_start_working(gcwq)) && manage_workers(worker))
+		goto recheck;
+
+	/*
+	 * ->scheduled list can only be filled while a worker is
+	 * preparing to process a work or actually processing it.
+	 * Make sure nobody diddled with it while I was sleeping.
+	 */
+	BUG_ON(!list_empty(&worker->scheduled));
+
+	/*
+	 * When control reaches this point, we're guaranteed to have
+	 * at least one idle worker or that someone else has already
+	 * assumed the manager role.
+	 */
+	worker_clr_flags(worker, WORKER_PREP);
+
+	do {
+		struct work_struct *work =
+			list_first_entry(&gcwq->worklist,
+					 struct work_struct, entry);
+
+		process_one_work(worker, work);
+		if (unlikely(!list_empty(&worker->scheduled)))
+			process_scheduled_works(worker);
+	} while (keep_working(gcwq));
+
+	worker_set_flags(worker, WORKER_PREP, false);
+sleep:
+	/* the cpu came back while we were busy, bind before going idle */
+	if (unlikely(worker->flags & WORKER_REBIND)) {
+		worker_rebind(worker);
+		goto recheck;
+	}
+
+	if (unlikely(need_to_manage_workers(gcwq)) && manage_workers(worker))
+		goto recheck;
 
-static void wq_barrier_func(struct work_struct *work)
-{
-	struct wq_barrier *barr = container_of(work, struct wq_barrier, work);
-	complete(&barr->done);
+	/*
+	 * gcwq->lock is held and there's no work to process and no
+	 * need to manage, sleep.  Workers are woken up only while
+	 * holding gcwq->lock or from local cpu, so setting the
+	 * current state before releasing gcwq->lock is enough to
+	 * prevent losing any event.
+	 */
+	worker_enter_idle(worker);
+	__set_current_state(TASK_INTERRUPTIBLE);
+	spin_unlock_irq(&gcwq->lock);
+	schedule();
+	goto woke_up;
 }
 
-static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
-			struct wq_barrier *barr, struct list_head *head)
+/**
+ * rescuer_thread - the rescuer thread function
+ * @__wq: the associated workqueue
+ *
+ * Workqueue rescuer thread function.  There's one rescuer for each
+ * workqueue.
+ *
+ * Regular work processing on a gcwq may block trying to create a new
+ * worker which uses GFP_KERNEL allocation which has slight chance of
+ * developing into deadlock if some works currently on the same queue
+ * need to be processed to satisfy the GFP_KERNEL allocation.  This is
+ * the problem rescuer solves.
+ *
+ * When such condition is possible, the gcwq summons rescuers of all
+ * workqueues which have works queued on the gcwq and let them process
+ * those works so that forward progress can be guaranteed.
+ *
+ * This should happen rarely.
+ */
+static int rescuer_thread(void *__wq)
 {
-	INIT_WORK(&barr->work, wq_barrier_func);
-	__set_bit(WORK_STRUCT_PENDING, work_data_bits(&barr->work));
+	struct workqueue_struct *wq = __wq;
+	struct worker *rescuer = wq->rescuer;
+	struct list_head *scheduled = &rescuer->scheduled;
+	unsigned int cpu;
+
+	if (!wq->rt)
+		set_user_nice(current, WORKER_NICE_LEVEL);
+repeat:
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	if (kthread_should_stop()) {
+		__set_current_state(TASK_RUNNING);
+		return 0;
+	}
 
-	init_completion(&barr->done);
+	/* see whether any cpu is asking for help */
+	for_each_cpu(cpu, wq->mayday_mask) {
+		struct cpu_workqueue_struct *cwq = wq_per_cpu(wq, cpu);
+		struct global_cwq *gcwq = cwq->gcwq;
+		struct work_struct *work, *n;
 
-	insert_work(cwq, &barr->work, head);
-}
+		__set_current_state(TASK_RUNNING);
+		cpumask_clear_cpu(cpu, wq->mayday_mask);
 
-static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
-{
-	int active = 0;
-	struct wq_barrier barr;
+		/* migrate to the target cpu if possible */
+		rescuer->gcwq = gcwq;
+		worker_maybe_bind_and_lock(rescuer);
 
-	WARN_ON(cwq->thread == current);
+		/*
+		 * Slurp in all works issued via this workqueue and
+		 * process'em.
+		 */
+		BUG_ON(!list_empty(&rescuer->scheduled));
+		list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
+			if (get_wq_data(work) == cwq)
+				list_move_tail(&work->entry, scheduled);
 
-	spin_lock_irq(&cwq->lock);
-	if (!list_empty(&cwq->worklist) || cwq->current_work != NULL) {
-		insert_wq_barrier(cwq, &barr, &cwq->worklist);
-		active = 1;
+		process_scheduled_works(rescuer);
+		spin_unlock_irq(&gcwq->lock);
 	}
-	spin_unlock_irq(&cwq->lock);
-
-	if (active)
-		wait_for_completion(&barr.done);
 
-	return active;
+	schedule();
+	goto repeat;
 }
 
 /**
@@ -391,10 +1569,8 @@ static int flush_cpu_workqueue(struct cpu_workqueue_struct *cwq)
  * This is typically used in driver shutdown handlers.
  *
  * We sleep until all works which were queued on entry have been handled,
- * but we are not livelocked by new incoming ones.
- *
- * This function used to run the workqueues itself.  Now we just wait for the
- * helper threads to do it.
+ * but we are not livelocked by new incoming ones: works queued from now
+ * on get the other flush color.
  */
 void flush_workqueue(struct workqueue_struct *wq)
 {
@@ -404,8 +1580,34 @@ void flush_workqueue(struct workqueue_struct *wq)
 	might_sleep();
 	lock_map_acquire(&wq->lockdep_map);
 	lock_map_release(&wq->lockdep_map);
-	for_each_cpu(cpu, cpu_map)
-		flush_cpu_workqueue(per_cpu_ptr(wq->cpu_wq, cpu));
+
+	mutex_lock(&wq->flush_mutex);
+
+	INIT_COMPLETION(wq->flush_done);
+	atomic_set(&wq->nr_cwqs_to_flush, 1);
+
+	for_each_cpu(cpu, cpu_map) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+		struct global_cwq *gcwq = cwq->gcwq;
+
+		spin_lock_irq(&gcwq->lock);
+
+		BUG_ON(cwq->flush_color != -1);
+		BUG_ON(cwq->nr_in_flight[cwq->work_color ^ 1]);
+
+		if (cwq->nr_in_flight[cwq->work_color]) {
+			cwq->flush_color = cwq->work_color;
+			cwq->work_color ^= 1;
+			atomic_inc(&wq->nr_cwqs_to_flush);
+		}
+
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	if (!atomic_dec_and_test(&wq->nr_cwqs_to_flush))
+		wait_for_completion(&wq->flush_done);
+
+	mutex_unlock(&wq->flush_mutex);
 }
 EXPORT_SYMBOL_GPL(flush_workqueue);
 
@@ -422,19 +1624,20 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
 int flush_work(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq;
-	struct list_head *prev;
+	struct global_cwq *gcwq;
+	struct worker *worker;
 	struct wq_barrier barr;
 
 	might_sleep();
 	cwq = get_wq_data(work);
 	if (!cwq)
 		return 0;
+	gcwq = cwq->gcwq;
 
 	lock_map_acquire(&cwq->wq->lockdep_map);
 	lock_map_release(&cwq->wq->lockdep_map);
 
-	prev = NULL;
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
@@ -442,21 +1645,21 @@ int flush_work(struct work_struct *work)
 		 */
 		smp_rmb();
 		if (unlikely(cwq != get_wq_data(work)))
-			goto out;
-		prev = &work->entry;
+			goto already_gone;
+		insert_wq_barrier(&barr, work, &gcwq->barriers);
 	} else {
-		if (cwq->current_work != work)
-			goto out;
-		prev = &cwq->worklist;
+		worker = find_worker_executing_work(gcwq, work);
+		if (!worker)
+			goto already_gone;
+		insert_wq_barrier(&barr, work, &worker->barriers);
 	}
-	insert_wq_barrier(cwq, &barr, prev->next);
-out:
-	spin_unlock_irq(&cwq->lock);
-	if (!prev)
-		return 0;
+	spin_unlock_irq(&gcwq->lock);
 
 	wait_for_completion(&barr.done);
 	return 1;
+already_gone:
+	spin_unlock_irq(&gcwq->lock);
+	return 0;
 }
 EXPORT_SYMBOL_GPL(flush_work);
 
@@ -467,6 +1670,7 @@ EXPORT_SYMBOL_GPL(flush_work);
 static int try_to_grab_pending(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq;
+	struct global_cwq *gcwq;
 	int ret = -1;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING, work_data_bits(work)))
@@ -480,8 +1684,9 @@ static int try_to_grab_pending(struct work_struct *work)
 	cwq = get_wq_data(work);
 	if (!cwq)
 		return ret;
+	gcwq = cwq->gcwq;
 
-	spin_lock_irq(&cwq->lock);
+	spin_lock_irq(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * This work is queued, but perhaps we locked the wrong cwq.
@@ -491,26 +1696,32 @@ static int try_to_grab_pending(struct work_struct *work)
 		smp_rmb();
 		if (cwq == get_wq_data(work)) {
 			list_del_init(&work->entry);
+			/* it'll never start, don't leave flushers waiting */
+			complete_wq_barriers(&gcwq->barriers, work);
+			cwq_dec_nr_in_flight(cwq, get_work_color(work),
+				test_bit(WORK_STRUCT_DELAYED,
+					 work_data_bits(work)) != 0);
 			ret = 1;
 		}
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 
 	return ret;
 }
 
-static void wait_on_cpu_work(struct cpu_workqueue_struct *cwq,
-				struct work_struct *work)
+static void wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 {
+	struct worker *worker;
 	struct wq_barrier barr;
 	int running = 0;
 
-	spin_lock_irq(&cwq->lock);
-	if (unlikely(cwq->current_work == work)) {
-		insert_wq_barrier(cwq, &barr, cwq->worklist.next);
+	spin_lock_irq(&gcwq->lock);
+	worker = find_worker_executing_work(gcwq, work);
+	if (unlikely(worker)) {
+		insert_wq_barrier(&barr, work, &worker->barriers);
 		running = 1;
 	}
-	spin_unlock_irq(&cwq->lock);
+	spin_unlock_irq(&gcwq->lock);
 
 	if (unlikely(running))
 		wait_for_completion(&barr.done);
@@ -536,7 +1747,7 @@ static void wait_on_work(struct work_struct *work)
 	cpu_map = wq_cpu_map(wq);
 
 	for_each_cpu(cpu, cpu_map)
-		wait_on_cpu_work(per_cpu_ptr(wq->cpu_wq, cpu), work);
+		wait_on_cpu_work(per_cpu_ptr(wq->cpu_wq, cpu)->gcwq, work);
 }
 
 static int __cancel_work_timer(struct work_struct *work,
@@ -724,73 +1935,27 @@ int keventd_up(void)
 	return keventd_wq != NULL;
 }
 
+/*
+ * keventd works are executed by the shared workers, which execute the
+ * works of all other workqueues too, or by the rescuer of keventd.
+ */
 int current_is_keventd(void)
 {
-	struct cpu_workqueue_struct *cwq;
-	int cpu = raw_smp_processor_id(); /* preempt-safe: keventd is per-cpu */
-	int ret = 0;
-
 	BUG_ON(!keventd_wq);
 
-	cwq = per_cpu_ptr(keventd_wq->cpu_wq, cpu);
-	if (current == cwq->thread)
-		ret = 1;
-
-	return ret;
-
-}
-
-static struct cpu_workqueue_struct *
-init_cpu_workqueue(struct workqueue_struct *wq, int cpu)
-{
-	struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-
-	cwq->wq = wq;
-	spin_lock_init(&cwq->lock);
-	INIT_LIST_HEAD(&cwq->worklist);
-	init_waitqueue_head(&cwq->more_work);
-
-	return cwq;
-}
-
-DEFINE_TRACE(workqueue_creation);
-
-static int create_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
-{
-	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
-	struct workqueue_struct *wq = cwq->wq;
-	const char *fmt = is_wq_single_threaded(wq) ? "%s" : "%s/%d";
-	struct task_struct *p;
-
-	p = kthread_create(worker_thread, cwq, fmt, wq->name, cpu);
-	/*
-	 * Nobody can add the work_struct to this cwq,
-	 *	if (caller is __create_workqueue)
-	 *		nobody should see this wq
-	 *	else // caller is CPU_UP_PREPARE
-	 *		cpu is not on cpu_online_map
-	 * so we can abort safely.
-	 */
-	if (IS_ERR(p))
-		return PTR_ERR(p);
-	if (cwq->wq->rt)
-		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
-	cwq->thread = p;
-
-	trace_workqueue_creation(cwq->thread, cpu);
-
-	return 0;
+	return (current->flags & PF_WQ_WORKER) ||
+		current == keventd_wq->rescuer->task;
 }
 
-static void start_workqueue_thread(struct cpu_workqueue_struct *cwq, int cpu)
+/* Set max_active of @cwq and activate the delayed works it allows. */
+static void cwq_set_max_active(struct cpu_workqueue_struct *cwq,
+			       int max_active)
 {
-	struct task_struct *p = cwq->thread;
+	cwq->max_active = max_active;
 
-	if (p != NULL) {
-		if (cpu >= 0)
-			kthread_bind(p, cpu);
-		wake_up_process(p);
-	}
+	while (!list_empty(&cwq->delayed_works) &&
+	       cwq->nr_active < cwq->max_active)
+		cwq_activate_first_delayed(cwq);
 }
 
 struct workqueue_struct *__create_workqueue_key(const char *name,
@@ -800,94 +1965,106 @@ struct workqueue_struct *__create_workqueue_key(const char *name,
 						struct lock_class_key *key,
 						const char *lock_name)
 {
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
 	struct workqueue_struct *wq;
-	struct cpu_workqueue_struct *cwq;
-	int err = 0, cpu;
+	struct worker *rescuer;
+	int cpu;
 
 	wq = kzalloc(sizeof(*wq), GFP_KERNEL);
 	if (!wq)
 		return NULL;
 
 	wq->cpu_wq = alloc_percpu(struct cpu_workqueue_struct);
-	if (!wq->cpu_wq) {
-		kfree(wq);
-		return NULL;
-	}
+	if (!wq->cpu_wq)
+		goto err;
+	if (!alloc_cpumask_var(&wq->mayday_mask, GFP_KERNEL))
+		goto err;
+	cpumask_clear(wq->mayday_mask);
 
 	wq->name = name;
 	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
 	wq->singlethread = singlethread;
 	wq->freezeable = freezeable;
 	wq->rt = rt;
+	wq->saved_max_active = 1;
+	mutex_init(&wq->flush_mutex);
+	atomic_set(&wq->nr_cwqs_to_flush, 0);
+	init_completion(&wq->flush_done);
 	INIT_LIST_HEAD(&wq->list);
 
-	if (singlethread) {
-		cwq = init_cpu_workqueue(wq, singlethread_cpu);
-		err = create_workqueue_thread(cwq, singlethread_cpu);
-		start_workqueue_thread(cwq, -1);
-	} else {
-		cpu_maps_update_begin();
-		/*
-		 * We must place this wq on list even if the code below fails.
-		 * cpu_down(cpu) can remove cpu from cpu_populated_map before
-		 * destroy_workqueue() takes the lock, in that case we leak
-		 * cwq[cpu]->thread.
-		 */
-		spin_lock(&workqueue_lock);
-		list_add(&wq->list, &workqueues);
-		spin_unlock(&workqueue_lock);
-		/*
-		 * We must initialize cwqs for each possible cpu even if we
-		 * are going to call destroy_workqueue() finally. Otherwise
-		 * cpu_up() can hit the uninitialized cwq once we drop the
-		 * lock.
-		 */
-		for_each_possible_cpu(cpu) {
-			cwq = init_cpu_workqueue(wq, cpu);
-			if (err || !cpu_online(cpu))
-				continue;
-			err = create_workqueue_thread(cwq, cpu);
-			start_workqueue_thread(cwq, cpu);
-		}
-		cpu_maps_update_done();
+	/*
+	 * Initialize the cwqs of all possible cpus: a cpu which comes up
+	 * later uses them without any further setup.
+	 */
+	for_each_possible_cpu(cpu) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+
+		cwq->gcwq = get_gcwq(cpu, rt);
+		cwq->wq = wq;
+		cwq->flush_color = -1;
+		cwq->max_active = wq->saved_max_active;
+		INIT_LIST_HEAD(&cwq->delayed_works);
 	}
 
-	if (err) {
-		destroy_workqueue(wq);
-		wq = NULL;
-	}
+	/*
+	 * Every workqueue gets a rescuer, which executes its works when
+	 * the pool can't fork a new worker, see rescuer_thread().
+	 */
+	rescuer = alloc_worker();
+	if (!rescuer)
+		goto err;
+	wq->rescuer = rescuer;
+
+	rescuer->task = kthread_create(rescuer_thread, wq, "%s", name);
+	if (IS_ERR(rescuer->task))
+		goto err;
+	if (rt)
+		sched_setscheduler_nocheck(rescuer->task, SCHED_FIFO, &param);
+	wake_up_process(rescuer->task);
+
+	/*
+	 * workqueue_lock protects global freeze state and workqueues
+	 * list.  Grab it, set max_active accordingly and add the new
+	 * workqueue to workqueues list.
+	 */
+	spin_lock(&workqueue_lock);
+
+	if (workqueue_freezing && freezeable)
+		for_each_possible_cpu(cpu)
+			per_cpu_ptr(wq->cpu_wq, cpu)->max_active = 0;
+
+	list_add(&wq->list, &workqueues);
+
+	spin_unlock(&workqueue_lock);
+
 	return wq;
+err:
+	free_percpu(wq->cpu_wq);
+	free_cpumask_var(wq->mayday_mask);
+	kfree(wq->rescuer);
+	kfree(wq);
+	return NULL;
 }
 EXPORT_SYMBOL_GPL(__create_workqueue_key);
 
-DEFINE_TRACE(workqueue_destruction);
-
-static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
+/* Are any works of @wq still queued or executing? */
+static bool wq_busy(struct workqueue_struct *wq)
 {
-	/*
-	 * Our caller is either destroy_workqueue() or CPU_POST_DEAD,
-	 * cpu_add_remove_lock protects cwq->thread.
-	 */
-	if (cwq->thread == NULL)
-		return;
+	const struct cpumask *cpu_map = wq_cpu_map(wq);
+	bool busy = false;
+	int cpu, i;
 
-	lock_map_acquire(&cwq->wq->lockdep_map);
-	lock_map_release(&cwq->wq->lockdep_map);
+	for_each_cpu(cpu, cpu_map) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+		struct global_cwq *gcwq = cwq->gcwq;
 
-	flush_cpu_workqueue(cwq);
-	/*
-	 * If the caller is CPU_POST_DEAD and cwq->worklist was not empty,
-	 * a concurrent flush_workqueue() can insert a barrier after us.
-	 * However, in that case run_workqueue() won't return and check
-	 * kthread_should_stop() until it flushes all work_struct's.
-	 * When ->worklist becomes empty it is safe to exit because no
-	 * more work_structs can be queued on this cwq: flush_workqueue
-	 * checks list_empty(), and a "normal" queue_work() can't use
-	 * a dead CPU.
-	 */
-	trace_workqueue_destruction(cwq->thread);
-	kthread_stop(cwq->thread);
-	cwq->thread = NULL;
+		spin_lock_irq(&gcwq->lock);
+		for (i = 0; i < WORK_NR_COLORS; i++)
+			busy |= cwq->nr_in_flight[i] != 0;
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	return busy;
 }
 
 /**
@@ -898,71 +2075,198 @@ static void cleanup_workqueue_thread(struct cpu_workqueue_struct *cwq)
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	const struct cpumask *cpu_map = wq_cpu_map(wq);
-	int cpu;
+	/* works requeued while being flushed have to run as well */
+	do {
+		flush_workqueue(wq);
+	} while (wq_busy(wq));
 
-	cpu_maps_update_begin();
+	/*
+	 * wq list is used to freeze wq, remove from list after
+	 * flushing is complete in case freeze races us.
+	 */
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
 
-	for_each_cpu(cpu, cpu_map)
-		cleanup_workqueue_thread(per_cpu_ptr(wq->cpu_wq, cpu));
- 	cpu_maps_update_done();
+	kthread_stop(wq->rescuer->task);
 
 	free_percpu(wq->cpu_wq);
+	free_cpumask_var(wq->mayday_mask);
+	kfree(wq->rescuer);
 	kfree(wq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
+/**
+ * workqueue_set_max_active - adjust max_active of a workqueue
+ * @wq: target workqueue
+ * @max_active: new max_active value.
+ *
+ * Up to @max_active works of @wq queued on one cpu may be in execution
+ * at the same time, the next one starting when an earlier one blocks.
+ * A workqueue starts out with one, which executes the works of each
+ * cpu strictly one after the other, in queueing order.
+ *
+ * CONTEXT:
+ * Don't call from IRQ context.
+ */
+void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
+{
+	int cpu;
+
+	max_active = clamp_val(max_active, 1, WQ_MAX_ACTIVE);
+
+	spin_lock(&workqueue_lock);
+
+	wq->saved_max_active = max_active;
+
+	for_each_possible_cpu(cpu) {
+		struct cpu_workqueue_struct *cwq = per_cpu_ptr(wq->cpu_wq, cpu);
+		struct global_cwq *gcwq = cwq->gcwq;
+
+		spin_lock_irq(&gcwq->lock);
+
+		if (!(wq->freezeable && workqueue_freezing))
+			cwq_set_max_active(cwq, max_active);
+
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	spin_unlock(&workqueue_lock);
+}
+EXPORT_SYMBOL_GPL(workqueue_set_max_active);
+
+/*
+ * CPU hotplug.
+ *
+ * The workers of a cpu stay bound to it until it is gone: stop_machine
+ * relies on them to take the cpu down.  At CPU_DEAD the scheduler has
+ * moved them to other cpus; the pool is then marked disassociated and
+ * works left on it are executed by its workers wherever they run, each
+ * work getting a worker of its own.  When the cpu comes back, idle
+ * workers bind themselves right away, busy ones when they run out of
+ * works.
+ */
+
+/**
+ * gcwq_populate - make sure a gcwq has its initial workers
+ * @gcwq: gcwq of interest
+ *
+ * A pool must be able to start executing works without forking: the
+ * realtime pool serves stop_machine, whose works keep all other cpus
+ * busy, so it keeps two workers around, one to take the work and one
+ * to remain idle.
+ *
+ * CONTEXT:
+ * Might sleep.  Does GFP_KERNEL allocations.
+ *
+ * RETURNS:
+ * 0 on success, -ENOMEM if a worker couldn't be created.
+ */
+static int gcwq_populate(struct global_cwq *gcwq)
+{
+	int nr = gcwq->rt ? RT_POOL_MIN_WORKERS : 1;
+
+	while (gcwq->nr_workers < nr) {
+		struct worker *worker = create_worker(gcwq);
+
+		if (!worker)
+			return -ENOMEM;
+		spin_lock_irq(&gcwq->lock);
+		start_worker(worker);
+		spin_unlock_irq(&gcwq->lock);
+	}
+	return 0;
+}
+
+/* The cpu of @gcwq is online again, have its workers bind to it. */
+static void gcwq_associate(struct global_cwq *gcwq)
+{
+	struct worker *worker;
+
+	spin_lock_irq(&gcwq->lock);
+
+	gcwq->flags &= ~GCWQ_DISASSOCIATED;
+
+	list_for_each_entry(worker, &gcwq->workers, node)
+		if (worker->flags & WORKER_UNBOUND)
+			worker->flags |= WORKER_REBIND;
+
+	list_for_each_entry(worker, &gcwq->idle_list, entry)
+		wake_up_process(worker->task);
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/* The cpu of @gcwq is gone, stop concurrency management for its pool. */
+static void gcwq_disassociate(struct global_cwq *gcwq)
+{
+	struct worker *worker;
+
+	spin_lock_irq(&gcwq->lock);
+
+	gcwq->flags |= GCWQ_DISASSOCIATED;
+
+	list_for_each_entry(worker, &gcwq->workers, node)
+		worker->flags = (worker->flags | WORKER_UNBOUND) &
+				~WORKER_REBIND;
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/*
+ * Called after gcwq_disassociate() and a grace period: no scheduler
+ * hook is accounting the pool's workers any more, forget about the
+ * running ones and get the pending works going.
+ */
+static void gcwq_zap_nr_running(struct global_cwq *gcwq)
+{
+	spin_lock_irq(&gcwq->lock);
+	atomic_set(&gcwq->nr_running, 0);
+	wake_up_worker(gcwq);
+	spin_unlock_irq(&gcwq->lock);
+}
+
 static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 						unsigned long action,
 						void *hcpu)
 {
 	unsigned int cpu = (unsigned long)hcpu;
-	struct cpu_workqueue_struct *cwq;
-	struct workqueue_struct *wq;
-	int ret = NOTIFY_OK;
+	int rt;
 
 	action &= ~CPU_TASKS_FROZEN;
 
 	switch (action) {
 	case CPU_UP_PREPARE:
-		cpumask_set_cpu(cpu, cpu_populated_map);
-	}
-undo:
-	list_for_each_entry(wq, &workqueues, list) {
-		cwq = per_cpu_ptr(wq->cpu_wq, cpu);
-
-		switch (action) {
-		case CPU_UP_PREPARE:
-			if (!create_workqueue_thread(cwq, cpu))
-				break;
-			printk(KERN_ERR "workqueue [%s] for %i failed\n",
-				wq->name, cpu);
-			action = CPU_UP_CANCELED;
-			ret = NOTIFY_BAD;
-			goto undo;
-
-		case CPU_ONLINE:
-			start_workqueue_thread(cwq, cpu);
-			break;
-
-		case CPU_UP_CANCELED:
-			start_workqueue_thread(cwq, -1);
-		case CPU_POST_DEAD:
-			cleanup_workqueue_thread(cwq);
-			break;
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++) {
+			if (!gcwq_populate(get_gcwq(cpu, rt)))
+				continue;
+			printk(KERN_ERR "workqueue: no workers for cpu %u\n",
+			       cpu);
+			return NOTIFY_BAD;
 		}
-	}
+		break;
 
-	switch (action) {
-	case CPU_UP_CANCELED:
-	case CPU_POST_DEAD:
-		cpumask_clear_cpu(cpu, cpu_populated_map);
+	case CPU_ONLINE:
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++)
+			gcwq_associate(get_gcwq(cpu, rt));
+		break;
+
+	case CPU_DEAD:
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++)
+			gcwq_disassociate(get_gcwq(cpu, rt));
+		/*
+		 * The workers were migrated before we got here and may
+		 * be inside the scheduler hooks on other cpus.  Wait
+		 * until those have seen WORKER_UNBOUND.
+		 */
+		synchronize_sched();
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++)
+			gcwq_zap_nr_running(get_gcwq(cpu, rt));
+		break;
 	}
 
-	return ret;
+	return NOTIFY_OK;
 }
 
 #ifdef CONFIG_SMP
@@ -1012,14 +2316,174 @@ long work_on_cpu(unsigned int cpu, long (*fn)(void *), void *arg)
 EXPORT_SYMBOL_GPL(work_on_cpu);
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_FREEZER
+
+/**
+ * freeze_workqueues_begin - begin freezing workqueues
+ *
+ * Start freezing workqueues.  After this function returns, all
+ * freezeable workqueues will queue new works to their delayed_works
+ * list instead of the pool's worklist.
+ *
+ * CONTEXT:
+ * Grabs and releases workqueue_lock and gcwq->lock's.
+ */
+void freeze_workqueues_begin(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	spin_lock(&workqueue_lock);
+
+	BUG_ON(workqueue_freezing);
+	workqueue_freezing = true;
+
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!wq->freezeable)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			struct cpu_workqueue_struct *cwq =
+				per_cpu_ptr(wq->cpu_wq, cpu);
+			struct global_cwq *gcwq = cwq->gcwq;
+
+			spin_lock_irq(&gcwq->lock);
+			cwq->max_active = 0;
+			spin_unlock_irq(&gcwq->lock);
+		}
+	}
+
+	spin_unlock(&workqueue_lock);
+}
+
+/**
+ * freeze_workqueues_busy - are freezeable workqueues still busy?
+ *
+ * Check whether freezing is complete.  This function must be called
+ * between freeze_workqueues_begin() and thaw_workqueues().
+ *
+ * CONTEXT:
+ * Grabs and releases workqueue_lock.
+ *
+ * RETURNS:
+ * %true if some freezeable workqueues are still busy.  %false if
+ * freezing is complete.
+ */
+bool freeze_workqueues_busy(void)
+{
+	struct workqueue_struct *wq;
+	bool busy = false;
+	int cpu;
+
+	spin_lock(&workqueue_lock);
+
+	BUG_ON(!workqueue_freezing);
+
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!wq->freezeable)
+			continue;
+
+		/*
+		 * nr_active is monotonically decreasing.  It's safe
+		 * to peek without lock.
+		 */
+		for_each_possible_cpu(cpu)
+			if (per_cpu_ptr(wq->cpu_wq, cpu)->nr_active) {
+				busy = true;
+				goto out_unlock;
+			}
+	}
+out_unlock:
+	spin_unlock(&workqueue_lock);
+	return busy;
+}
+
+/**
+ * thaw_workqueues - thaw workqueues
+ *
+ * Thaw workqueues.  Normal queueing is restored and all collected
+ * frozen works are transferred to their respective pool's worklist.
+ *
+ * CONTEXT:
+ * Grabs and releases workqueue_lock and gcwq->lock's.
+ */
+void thaw_workqueues(void)
+{
+	struct workqueue_struct *wq;
+	int cpu;
+
+	spin_lock(&workqueue_lock);
+
+	if (!workqueue_freezing)
+		goto out_unlock;
+
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!wq->freezeable)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			struct cpu_workqueue_struct *cwq =
+				per_cpu_ptr(wq->cpu_wq, cpu);
+			struct global_cwq *gcwq = cwq->gcwq;
+
+			spin_lock_irq(&gcwq->lock);
+			cwq_set_max_active(cwq, wq->saved_max_active);
+			spin_unlock_irq(&gcwq->lock);
+		}
+	}
+
+	workqueue_freezing = false;
+out_unlock:
+	spin_unlock(&workqueue_lock);
+}
+#endif /* CONFIG_FREEZER */
+
 void __init init_workqueues(void)
 {
-	alloc_cpumask_var(&cpu_populated_map, GFP_KERNEL);
+	unsigned int cpu;
+	int rt, i;
 
-	cpumask_copy(cpu_populated_map, cpu_online_mask);
 	singlethread_cpu = cpumask_first(cpu_possible_mask);
 	cpu_singlethread_map = cpumask_of(singlethread_cpu);
-	hotcpu_notifier(workqueue_cpu_callback, 0);
+	/* after migration_call() has moved the tasks off a dead cpu */
+	hotcpu_notifier(workqueue_cpu_callback, 5);
+
+	/* initialize gcwqs */
+	for_each_possible_cpu(cpu) {
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++) {
+			struct global_cwq *gcwq = get_gcwq(cpu, rt);
+
+			spin_lock_init(&gcwq->lock);
+			INIT_LIST_HEAD(&gcwq->worklist);
+			gcwq->cpu = cpu;
+			gcwq->rt = rt;
+			if (!cpu_online(cpu))
+				gcwq->flags |= GCWQ_DISASSOCIATED;
+
+			INIT_LIST_HEAD(&gcwq->idle_list);
+			for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+				INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+			INIT_LIST_HEAD(&gcwq->workers);
+			INIT_LIST_HEAD(&gcwq->barriers);
+
+			setup_timer(&gcwq->idle_timer, idle_worker_timeout,
+				    (unsigned long)gcwq);
+			setup_timer(&gcwq->mayday_timer, gcwq_mayday_timeout,
+				    (unsigned long)gcwq);
+
+			ida_init(&gcwq->worker_ida);
+		}
+	}
+
+	/* create the initial workers */
+	for_each_online_cpu(cpu)
+		for (rt = 0; rt < NR_WORKER_POOLS; rt++)
+			BUG_ON(gcwq_populate(get_gcwq(cpu, rt)));
+
+	/*
+	 * keventd stays at max_active 1: its users rely on their works
+	 * running one at a time per cpu, in queueing order.
+	 */
 	keventd_wq = create_workqueue("events");
 	BUG_ON(!keventd_wq);
 }
@@ -88,16 +88,21 @@ static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 	return root->gfp_mask & __GFP_BITS_MASK;
 }
 
+/*
+ * Node tag bits are changed with atomic bitops: radix_tree_tag_set_rcu()
+ * sets them without the tree lock, concurrently with locked updates to
+ * other bits in the same word.
+ */
 static inline void tag_set(struct radix_tree_node *node, unsigned int tag,
 		int offset)
 {
-	__set_bit(offset, node->tags[tag]);
+	set_bit(offset, node->tags[tag]);
 }
 
 static inline void tag_clear(struct radix_tree_node *node, unsigned int tag,
 		int offset)
 {
-	__clear_bit(offset, node->tags[tag]);
+	clear_bit(offset, node->tags[tag]);
 }
 
 static inline int tag_get(struct radix_tree_node *node, unsigned int tag,
@@ -179,10 +184,10 @@ static void radix_tree_node_rcu_free(struct rcu_head *head)
 	/*
 	 * must only free zeroed nodes into the slab. radix_tree_shrink
 	 * can leave us with a non-NULL entry in the first slot, so clear
-	 * that here to make sure.
+	 * that here to make sure. A lockless radix_tree_tag_set_rcu()
+	 * may also have set a tag in the node as it was being unlinked.
 	 */
-	tag_clear(node, 0, 0);
-	tag_clear(node, 1, 0);
+	memset(node->tags, 0, sizeof(node->tags));
 	node->slots[0] = NULL;
 	node->count = 0;
 
@@ -337,10 +342,17 @@ int radix_tree_insert(struct radix_tree_root *root,
 		return -EEXIST;
 
 	if (node) {
+		int tag;
+
+		/*
+		 * A radix_tree_tag_set_rcu() racing with the deletion of
+		 * the previous item can leave a tag on the empty slot.
+		 */
+		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++)
+			if (tag_get(node, tag, offset))
+				tag_clear(node, tag, offset);
 		node->count++;
 		rcu_assign_pointer(node->slots[offset], item);
-		BUG_ON(tag_get(node, 0, offset));
-		BUG_ON(tag_get(node, 1, offset));
 	} else {
 		rcu_assign_pointer(root->rnode, item);
 		BUG_ON(root_tag_get(root, 0));
@@ -495,6 +507,112 @@ void *radix_tree_tag_set(struct radix_tree_root *root,
 }
 EXPORT_SYMBOL(radix_tree_tag_set);
 
+/*
+ * Check that @item is at @index and that it and every node above it carry
+ * @tag.  Called under rcu_read_lock().
+ */
+static int radix_tree_tag_path_set(struct radix_tree_root *root,
+			unsigned long index, void *item, unsigned int tag)
+{
+	struct radix_tree_node *node;
+	unsigned int height, shift;
+	int offset;
+
+	if (!root_tag_get(root, tag))
+		return 0;
+
+	node = rcu_dereference(root->rnode);
+	if (!radix_tree_is_indirect_ptr(node))
+		return 0;
+	node = radix_tree_indirect_to_ptr(node);
+
+	height = node->height;
+	if (index > radix_tree_maxindex(height))
+		return 0;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+
+	for (;;) {
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (!tag_get(node, tag, offset))
+			return 0;
+		if (height == 1)
+			break;
+		node = rcu_dereference(node->slots[offset]);
+		if (node == NULL)
+			return 0;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	return rcu_dereference(node->slots[offset]) == item;
+}
+
+/**
+ *	radix_tree_tag_set_rcu - set a tag on an item without the tree lock
+ *	@root:		radix tree root
+ *	@index:		index key
+ *	@item:		the item expected at @index
+ *	@tag:		tag index
+ *
+ *	Set @tag on @item, which the caller believes to be at @index, when
+ *	every node above it already carries the tag.  That is the common
+ *	case when neighbouring items get tagged one after the other, and
+ *	then only the leaf bit needs setting, which is done with an atomic
+ *	bitop under rcu_read_lock() instead of the tree lock.
+ *
+ *	Returns 1 if the tag is set.  Returns 0 if an ancestor was untagged,
+ *	the tree changed shape, or @item is no longer at @index; the caller
+ *	must then take the tree lock and either radix_tree_tag_set() the
+ *	item, or radix_tree_tag_clear() @index if it no longer holds @item
+ *	and whatever it holds now should not be tagged, since a tag may
+ *	have been left behind on the slot.
+ *
+ *	This pairs with the recheck in radix_tree_tag_clear() and with
+ *	radix_tree_delete() emptying the slot before clearing its tags:
+ *	each side writes, issues a full barrier, then reads what the other
+ *	side writes, so at least one of them sees the other.
+ */
+int radix_tree_tag_set_rcu(struct radix_tree_root *root,
+			unsigned long index, void *item, unsigned int tag)
+{
+	struct radix_tree_node *node;
+	unsigned int height, shift;
+	int offset;
+
+	node = rcu_dereference(root->rnode);
+	if (!radix_tree_is_indirect_ptr(node) || !root_tag_get(root, tag))
+		return 0;
+	node = radix_tree_indirect_to_ptr(node);
+
+	height = node->height;
+	if (index > radix_tree_maxindex(height))
+		return 0;
+	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
+
+	while (height > 1) {
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		if (!tag_get(node, tag, offset))
+			return 0;
+		node = rcu_dereference(node->slots[offset]);
+		if (node == NULL)
+			return 0;
+		shift -= RADIX_TREE_MAP_SHIFT;
+		height--;
+	}
+
+	offset = index & RADIX_TREE_MAP_MASK;
+	if (rcu_dereference(node->slots[offset]) != item)
+		return 0;
+	if (tag_get(node, tag, offset))
+		return 1;
+
+	tag_set(node, tag, offset);
+	smp_mb();
+
+	return radix_tree_tag_path_set(root, index, item, tag);
+}
+EXPORT_SYMBOL(radix_tree_tag_set_rcu);
+
 /**
  *	radix_tree_tag_clear - clear a tag on a radix tree node
  *	@root:		radix tree root
@@ -518,6 +636,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
 	struct radix_tree_node *slot = NULL;
+	struct radix_tree_node *child;
 	unsigned int height, shift;
 
 	height = root->height;
@@ -543,21 +662,41 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		height--;
 	}
 
-	if (slot == NULL)
-		goto out;
-
+	/*
+	 * An empty slot can still carry a tag left by a lockless
+	 * radix_tree_tag_set_rcu() that lost a race with deletion, so
+	 * clear it anyway.
+	 */
+	child = NULL;
 	while (pathp->node) {
 		if (!tag_get(pathp->node, tag, pathp->offset))
 			goto out;
 		tag_clear(pathp->node, tag, pathp->offset);
+		/*
+		 * radix_tree_tag_set_rcu() only checks that the tags above
+		 * the leaf are set after setting its own bit, so look at
+		 * the node below again now that its tag here is gone.
+		 */
+		if (child) {
+			smp_mb();
+			if (any_tag_set(child, tag)) {
+				tag_set(pathp->node, tag, pathp->offset);
+				goto out;
+			}
+		}
 		if (any_tag_set(pathp->node, tag))
 			goto out;
+		child = pathp->node;
 		pathp--;
 	}
 
 	/* clear the root's tag bit */
-	if (root_tag_get(root, tag))
+	if (root_tag_get(root, tag)) {
 		root_tag_clear(root, tag);
+		smp_mb();
+		if (child && any_tag_set(child, tag))
+			root_tag_set(root, tag);
+	}
 
 out:
 	return slot;
@@ -618,7 +757,13 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 		if (height == 1) {
 			int ret = tag_get(node, tag, offset);
 
-			BUG_ON(ret && saw_unset_tag);
+			/*
+			 * Without the tree lock this can be seen for a moment:
+			 * radix_tree_tag_set_rcu() sets the leaf bit before it
+			 * rechecks the tags above, and radix_tree_tag_clear()
+			 * clears those before it rechecks the node below.
+			 */
+			WARN_ON(ret && saw_unset_tag);
 			return !!ret;
 		}
 		node = rcu_dereference(node->slots[offset]);
@@ -1130,8 +1275,12 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 		goto out;
 
 	/*
-	 * Clear all tags associated with the just-deleted item
+	 * Clear all tags associated with the just-deleted item. Empty the
+	 * slot first: a concurrent radix_tree_tag_set_rcu() then either
+	 * sees the slot empty and backs off, or its tag is seen here.
 	 */
+	pathp->node->slots[pathp->offset] = NULL;
+	smp_mb();
 	for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
 		if (tag_get(pathp->node, tag, pathp->offset))
 			radix_tree_tag_clear(root, index, tag);
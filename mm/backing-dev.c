@@ -7,6 +7,9 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/rculist.h>
 
 void default_unplug_io_fn(struct backing_dev_info *bdi, struct page *page)
 {
@@ -23,6 +26,20 @@ EXPORT_SYMBOL_GPL(default_backing_dev_info);
 
 static struct class *bdi_class;
 
+/*
+ * bdi_list holds the registered devices, each of which may have a flusher
+ * thread.  It is modified under bdi_mutex and walked either under bdi_mutex,
+ * when the walker needs to sleep, or under RCU.
+ */
+DEFINE_MUTEX(bdi_mutex);
+LIST_HEAD(bdi_list);
+
+/*
+ * Writeback is done by the per-device flusher threads now, there are no
+ * pdflush threads any more.  Kept for the read-only sysctl.
+ */
+int nr_pdflush_threads;
+
 #ifdef CONFIG_DEBUG_FS
 #include <linux/debugfs.h>
 #include <linux/seq_file.h>
@@ -214,6 +231,32 @@ int bdi_register(struct backing_dev_info *bdi, struct device *parent,
 	bdi->dev = dev;
 	bdi_debug_register(bdi, dev_name(dev));
 
+	mutex_lock(&bdi_mutex);
+	list_add_tail_rcu(&bdi->bdi_list, &bdi_list);
+	mutex_unlock(&bdi_mutex);
+
+	/*
+	 * Devices that write back dirty data get a flusher thread of their
+	 * own.  If it can't be started, the default flusher thread keeps
+	 * doing the work.
+	 */
+	if (bdi_cap_writeback_dirty(bdi)) {
+		struct task_struct *task;
+
+		task = kthread_run(bdi_writeback_thread, &bdi->wb, "flush-%s",
+				   dev_name(dev));
+		if (IS_ERR(task)) {
+			printk(KERN_ERR "bdi %s: failed to start flusher "
+			       "thread\n", dev_name(dev));
+		} else {
+			spin_lock(&inode_lock);
+			spin_lock_bh(&bdi->wb_lock);
+			bdi->wb.task = task;
+			spin_unlock_bh(&bdi->wb_lock);
+			spin_unlock(&inode_lock);
+		}
+	}
+
 exit:
 	return ret;
 }
@@ -225,9 +268,49 @@ int bdi_register_dev(struct backing_dev_info *bdi, dev_t dev)
 }
 EXPORT_SYMBOL(bdi_register_dev);
 
+/*
+ * Stop the flusher thread of @bdi.  Its dirty inodes move over to the
+ * default flusher thread, just like those of devices that never had a
+ * thread of their own.
+ */
+static void bdi_wb_shutdown(struct backing_dev_info *bdi)
+{
+	struct bdi_writeback *wb = &bdi->wb;
+	struct bdi_writeback *dwb = &default_backing_dev_info.wb;
+	struct task_struct *task;
+	struct bdi_work *work, *next;
+
+	mutex_lock(&bdi_mutex);
+	list_del_rcu(&bdi->bdi_list);
+	mutex_unlock(&bdi_mutex);
+	synchronize_rcu();
+
+	spin_lock(&inode_lock);
+	spin_lock_bh(&bdi->wb_lock);
+	task = wb->task;
+	wb->task = NULL;
+	spin_unlock_bh(&bdi->wb_lock);
+	if (wb != dwb) {
+		list_splice_init(&wb->b_dirty, &dwb->b_dirty);
+		list_splice_init(&wb->b_io, &dwb->b_io);
+		list_splice_init(&wb->b_more_io, &dwb->b_more_io);
+	}
+	spin_unlock(&inode_lock);
+
+	if (task)
+		kthread_stop(task);
+
+	/* Nobody can queue work for us any more */
+	list_for_each_entry_safe(work, next, &bdi->work_list, list) {
+		list_del(&work->list);
+		kfree(work);
+	}
+}
+
 void bdi_unregister(struct backing_dev_info *bdi)
 {
 	if (bdi->dev) {
+		bdi_wb_shutdown(bdi);
 		bdi_debug_unregister(bdi);
 		device_unregister(bdi->dev);
 		bdi->dev = NULL;
@@ -242,6 +325,16 @@ int bdi_init(struct backing_dev_info *bdi)
 
 	bdi->dev = NULL;
 
+	INIT_LIST_HEAD(&bdi->bdi_list);
+	spin_lock_init(&bdi->wb_lock);
+	INIT_LIST_HEAD(&bdi->work_list);
+
+	memset(&bdi->wb, 0, sizeof(bdi->wb));
+	bdi->wb.bdi = bdi;
+	INIT_LIST_HEAD(&bdi->wb.b_dirty);
+	INIT_LIST_HEAD(&bdi->wb.b_io);
+	INIT_LIST_HEAD(&bdi->wb.b_more_io);
+
 	bdi->min_ratio = 0;
 	bdi->max_ratio = 100;
 	bdi->max_prop_frac = PROP_FRAC_BASE;
@@ -278,6 +371,24 @@ void bdi_destroy(struct backing_dev_info *bdi)
 }
 EXPORT_SYMBOL(bdi_destroy);
 
+/*
+ * Wake every flusher thread, e.g. so that a changed
+ * dirty_writeback_interval takes effect.
+ */
+void bdi_kick_flushers(void)
+{
+	struct backing_dev_info *bdi;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
+		spin_lock_bh(&bdi->wb_lock);
+		if (bdi->wb.task)
+			wake_up_process(bdi->wb.task);
+		spin_unlock_bh(&bdi->wb_lock);
+	}
+	rcu_read_unlock();
+}
+
 static wait_queue_head_t congestion_wqh[2] = {
 		__WAIT_QUEUE_HEAD_INITIALIZER(congestion_wqh[0]),
 		__WAIT_QUEUE_HEAD_INITIALIZER(congestion_wqh[1])
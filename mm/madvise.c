@@ -92,7 +92,9 @@ success:
 	/*
 	 * vm_flags is protected by the mmap_sem held in write mode.
 	 */
+	vma_write_begin(mm);
 	vma->vm_flags = new_flags;
+	vma_write_end(mm);
 
 out:
 	if (error == -ENOMEM)
@@ -55,6 +55,7 @@
 #include <linux/kallsyms.h>
 #include <linux/swapops.h>
 #include <linux/elf.h>
+#include <linux/migrate.h>
 
 #include <asm/pgalloc.h>
 #include <asm/uaccess.h>
@@ -770,6 +771,7 @@ static unsigned long zap_pte_range(struct mmu_gather *tlb,
 	int anon_rss = 0;
 
 	pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
 	do {
 		pte_t ptent = *pte;
@@ -969,6 +971,7 @@ unsigned long unmap_vmas(struct mmu_gather **tlbp,
 	struct mm_struct *mm = vma->vm_mm;
 
 	mmu_notifier_invalidate_range_start(mm, start_addr, end_addr);
+	mem_cgroup_uncharge_start();
 	for ( ; vma && vma->vm_start < end_addr; vma = vma->vm_next) {
 		unsigned long end;
 
@@ -1019,23 +1022,32 @@ unsigned long unmap_vmas(struct mmu_gather **tlbp,
 				break;
 			}
 
+			zap_work = ZAP_BLOCK_SIZE;
+
+			/*
+			 * Keep gathering across blocks: the mmu_gather flushes
+			 * by itself when its page array fills up, so finishing
+			 * it here would only add TLB flushes. Only give it up
+			 * when we have to reschedule or drop i_mmap_lock.
+			 */
+			if (!need_resched() &&
+				!(i_mmap_lock && spin_needbreak(i_mmap_lock)))
+				continue;
+
 			tlb_finish_mmu(*tlbp, tlb_start, start);
 
-			if (need_resched() ||
-				(i_mmap_lock && spin_needbreak(i_mmap_lock))) {
-				if (i_mmap_lock) {
-					*tlbp = NULL;
-					goto out;
-				}
-				cond_resched();
+			if (i_mmap_lock) {
+				*tlbp = NULL;
+				goto out;
 			}
+			cond_resched();
 
 			*tlbp = tlb_gather_mmu(vma->vm_mm, fullmm);
 			tlb_start_valid = 0;
-			zap_work = ZAP_BLOCK_SIZE;
 		}
 	}
 out:
+	mem_cgroup_uncharge_end();
 	mmu_notifier_invalidate_range_end(mm, start_addr, end_addr);
 	return start;	/* which is now the end (or restart) address */
 }
@@ -2839,6 +2851,54 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A NUMA hinting fault: the pte was made inaccessible by task_numa_work()
+ * to find out where the page is used from. Give the pte its protection
+ * back, account the access to the faulting task and, if the page lives
+ * on another node, try to move it here.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+		unsigned long address, pte_t *page_table, pmd_t *pmd,
+		pte_t entry)
+{
+	struct page *page;
+	spinlock_t *ptl;
+	int this_nid;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	if (unlikely(!pte_same(*page_table, entry))) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+
+	entry = pte_mkyoung(pte_modify(entry, vma->vm_page_prot));
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, entry);
+
+	page = vm_normal_page(vma, address, entry);
+	if (page)
+		get_page(page);
+	pte_unmap_unlock(page_table, ptl);
+	if (!page)
+		return 0;
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	this_nid = numa_node_id();
+	if (page_to_nid(page) == this_nid) {
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+		current->numa_stats.faults_local++;
+		put_page(page);
+		return 0;
+	}
+
+	current->numa_stats.faults_remote++;
+	migrate_misplaced_page(page, this_nid);
+	return 0;
+}
+#endif
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -2877,6 +2937,12 @@ static inline int handle_pte_fault(struct mm_struct *mm,
 					pte, pmd, write_access, entry);
 	}
 
+#ifdef CONFIG_NUMA_BALANCING
+	if (pte_protnone(entry) &&
+	    (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		return do_numa_page(mm, vma, address, pte, pmd, entry);
+#endif
+
 	ptl = pte_lockptr(mm, pmd);
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
@@ -2937,6 +3003,194 @@ int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return handle_pte_fault(mm, vma, address, pte, pmd, write_access);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Bound on the depth of the lockless VMA tree walk: a concurrent
+ * rebalance may momentarily send us around in circles.
+ */
+#define SPECULATIVE_WALK_MAX	64
+
+/*
+ * find_vma() for the speculative fault path: no mmap_sem, no mmap_cache.
+ * Returns the VMA covering @address, or NULL if there is none or the walk
+ * gave up. The result is only meaningful once mm->vma_seq is rechecked.
+ */
+static struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+						   unsigned long address)
+{
+	struct rb_node *rb_node = rcu_dereference(mm->mm_rb.rb_node);
+	int depth = 0;
+
+	while (rb_node && depth++ < SPECULATIVE_WALK_MAX) {
+		struct vm_area_struct *vma;
+
+		vma = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (ACCESS_ONCE(vma->vm_end) <= address)
+			rb_node = rcu_dereference(rb_node->rb_right);
+		else if (ACCESS_ONCE(vma->vm_start) > address)
+			rb_node = rcu_dereference(rb_node->rb_left);
+		else
+			return vma;
+	}
+	return NULL;
+}
+
+/*
+ * Walk the page tables down to the pte of @address for the speculative
+ * fault path, without allocating any. Interrupts must be disabled, which
+ * keeps the tables from being freed under us. Returns the mapped pte, or
+ * NULL if a level is missing, and the pmd it was found through in @pmdval.
+ */
+static pte_t *pte_offset_map_speculative(struct mm_struct *mm,
+					 unsigned long address, pmd_t *pmdval)
+{
+	pgd_t *pgdp, pgd;
+	pud_t *pudp, pud;
+
+	pgdp = pgd_offset(mm, address);
+	pgd = *pgdp;
+	if (pgd_none(pgd) || unlikely(pgd_bad(pgd)))
+		return NULL;
+	pudp = pud_offset(&pgd, address);
+	pud = *pudp;
+	if (pud_none(pud) || unlikely(pud_bad(pud)))
+		return NULL;
+	*pmdval = *pmd_offset(&pud, address);
+	if (pmd_none(*pmdval) || unlikely(pmd_bad(*pmdval)))
+		return NULL;
+	/*
+	 * Use the pmd we read: the live one may be cleared by now, but the
+	 * page table it pointed to cannot be freed while irqs are off.
+	 */
+	return pte_offset_map(pmdval, address);
+}
+
+/*
+ * Try to handle a not-present fault on anonymous memory without taking
+ * mmap_sem, so that faulting threads do not queue up behind a writer
+ * doing mmap(), munmap() or brk() elsewhere in the address space.
+ *
+ * The VMA is looked up under RCU (vm_area_cachep is SLAB_DESTROY_BY_RCU)
+ * and copied to the stack; the copy is trusted only while mm->vma_seq is
+ * unchanged. The page tables are walked with interrupts disabled, which
+ * keeps them from being freed under us as the TLB shootdown preceding
+ * the free has to wait for this CPU, and the final vma_seq check is made
+ * under the pte lock, which unmapping of the range must take afterwards.
+ *
+ * Only the common case is handled: a pte_none fault in a private
+ * anonymous VMA that already has an anon_vma. Anything else, or any
+ * change to the VMAs seen while we were working, returns VM_FAULT_RETRY
+ * and the caller falls back to the mmap_sem protected path.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     int write_access)
+{
+	struct vm_area_struct *vma, pvma;
+	unsigned int seq;
+	pmd_t pmd;
+	pte_t *page_table, entry;
+	spinlock_t *ptl;
+	struct page *page;
+	int none;
+
+	seq = ACCESS_ONCE(mm->vma_seq.sequence);
+	smp_rmb();
+	if (seq & 1)
+		goto out;
+
+	rcu_read_lock();
+	vma = find_vma_speculative(mm, address);
+	if (vma)
+		pvma = *vma;
+	rcu_read_unlock();
+	if (!vma || read_seqcount_retry(&mm->vma_seq, seq))
+		goto out;
+
+	if (pvma.vm_mm != mm ||
+	    address < pvma.vm_start || address >= pvma.vm_end)
+		goto out;
+	if (pvma.vm_file || pvma.vm_ops || !pvma.anon_vma ||
+	    vma_policy(&pvma))
+		goto out;
+	if (pvma.vm_flags & (VM_SHARED | VM_LOCKED | VM_GROWSDOWN |
+			     VM_GROWSUP | VM_PFNMAP | VM_MIXEDMAP))
+		goto out;
+	if (write_access ? !(pvma.vm_flags & VM_WRITE) :
+	    !(pvma.vm_flags & (VM_READ | VM_EXEC | VM_WRITE)))
+		goto out;
+
+	/*
+	 * Never allocate page tables here, leave that to the slow path, and
+	 * see that the pte is still empty before we go and allocate the page.
+	 */
+	local_irq_disable();
+	page_table = pte_offset_map_speculative(mm, address, &pmd);
+	if (page_table) {
+		none = pte_none(*page_table);
+		pte_unmap(page_table);
+	}
+	local_irq_enable();
+	if (!page_table || !none)
+		goto out;
+
+	page = alloc_zeroed_user_highpage_movable(&pvma, address);
+	if (!page)
+		goto out;
+	__SetPageUptodate(page);
+
+	if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL))
+		goto out_free_page;
+
+	entry = mk_pte(page, pvma.vm_page_prot);
+	entry = maybe_mkwrite(pte_mkdirty(entry), &pvma);
+
+	/* The tables may have changed while we slept, walk them again */
+	local_irq_disable();
+	if (read_seqcount_retry(&mm->vma_seq, seq))
+		goto out_irq;
+	page_table = pte_offset_map_speculative(mm, address, &pmd);
+	if (!page_table)
+		goto out_irq;
+
+	/*
+	 * The holder of the pte lock may be waiting for us to take a TLB
+	 * flush IPI, so only try for it.
+	 */
+	ptl = pte_lockptr(mm, &pmd);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(page_table);
+		goto out_irq;
+	}
+	if (read_seqcount_retry(&mm->vma_seq, seq) || !pte_none(*page_table)) {
+		pte_unmap_unlock(page_table, ptl);
+		goto out_irq;
+	}
+	/* Teardown of this range now has to wait for the pte lock */
+	local_irq_enable();
+
+	count_vm_event(PGFAULT);
+	count_vm_event(PGSPECFAULT);
+
+	inc_mm_counter(mm, anon_rss);
+	page_add_new_anon_rmap(page, &pvma, address);
+	set_pte_at(mm, address, page_table, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(&pvma, address, entry);
+	pte_unmap_unlock(page_table, ptl);
+	return 0;
+
+out_irq:
+	local_irq_enable();
+	mem_cgroup_uncharge_page(page);
+out_free_page:
+	page_cache_release(page);
+out:
+	count_vm_event(PGSPECFAULT_RETRY);
+	return VM_FAULT_RETRY;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -538,7 +538,9 @@ static int policy_vma(struct vm_area_struct *vma, struct mempolicy *new)
 		err = vma->vm_ops->set_policy(vma, new);
 	if (!err) {
 		mpol_get(new);
+		vma_write_begin(vma->vm_mm);
 		vma->vm_policy = new;
+		vma_write_end(vma->vm_mm);
 		mpol_put(old);
 	}
 	return err;
@@ -1968,6 +1970,76 @@ void numa_default_policy(void)
 	do_set_mempolicy(MPOL_DEFAULT, 0, NULL);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing: every sysctl_numa_balancing_scan_period ms,
+ * one thread of each process makes the next sysctl_numa_balancing_scan_size
+ * MB of its address space inaccessible on the way back to user mode. The
+ * hinting faults that follow tell which node each sampled page is used
+ * from, and do_numa_page() migrates it there when that is not where it
+ * lives. Memory under an explicit policy, of the task or the vma, is
+ * left where the policy put it.
+ */
+int sysctl_numa_balancing = 1;
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+unsigned int sysctl_numa_balancing_scan_period = 1000;
+unsigned int sysctl_numa_balancing_scan_size = 256;
+unsigned int sysctl_numa_balancing_migrate_ratelimit = 128;
+
+void task_numa_work(void)
+{
+	struct mm_struct *mm = current->mm;
+	struct vm_area_struct *vma;
+	unsigned long now = jiffies;
+	unsigned long next, start, end, pages, updated = 0;
+
+	if (!mm || (current->flags & PF_EXITING))
+		return;
+	next = ACCESS_ONCE(mm->numa_next_scan);
+	if (time_before(now, next))
+		return;
+	/* Only one thread of the process does each pass */
+	if (cmpxchg(&mm->numa_next_scan, next, now +
+		    msecs_to_jiffies(sysctl_numa_balancing_scan_period)) != next)
+		return;
+	if (current->mempolicy)
+		return;
+
+	pages = (unsigned long)sysctl_numa_balancing_scan_size <<
+		(20 - PAGE_SHIFT);
+	if (!pages)
+		return;
+
+	down_read(&mm->mmap_sem);
+	start = mm->numa_scan_offset;
+	vma = find_vma(mm, start);
+	if (!vma) {
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma && pages; vma = vma->vm_next) {
+		if (!vma_migratable(vma) || vma_policy(vma) ||
+		    (vma->vm_flags & VM_MIXEDMAP))
+			continue;
+		/* PROT_NONE ranges would never take the hinting fault */
+		if (!(vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+			continue;
+
+		start = max(start, vma->vm_start);
+		end = min(vma->vm_end, start + (pages << PAGE_SHIFT));
+		pages -= (end - start) >> PAGE_SHIFT;
+		updated += change_prot_numa(vma, start, end);
+		start = end;
+		cond_resched();
+	}
+	/* Start over from the bottom once the top has been reached */
+	mm->numa_scan_offset = vma ? start : 0;
+	up_read(&mm->mmap_sem);
+
+	count_vm_events(NUMA_PTE_UPDATES, updated);
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Parse and format mempolicy from/to strings
  */
@@ -669,7 +669,7 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	}
 
 	/* Establish migration ptes or remove ptes */
-	try_to_unmap(page, 1);
+	try_to_unmap(page, TTU_MIGRATION);
 
 	if (!page_mapped(page))
 		rc = move_to_new_page(newpage, page);
@@ -778,6 +778,77 @@ out:
 	return nr_failed + retry;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Allow sysctl_numa_balancing_migrate_ratelimit MB per second to be
+ * migrated into each node, counted in 100ms windows, so that a burst of
+ * hinting faults cannot saturate the interconnect.
+ */
+static int numa_migrate_ratelimited(pg_data_t *pgdat)
+{
+	unsigned long limit;
+	int ret = 0;
+
+	limit = (sysctl_numa_balancing_migrate_ratelimit <<
+		 (20 - PAGE_SHIFT)) / 10;
+	spin_lock(&pgdat->numa_migrate_lock);
+	if (time_after(jiffies, pgdat->numa_migrate_next_window)) {
+		pgdat->numa_migrate_nr_pages = 0;
+		pgdat->numa_migrate_next_window = jiffies +
+						  msecs_to_jiffies(100);
+	}
+	if (pgdat->numa_migrate_nr_pages < limit)
+		pgdat->numa_migrate_nr_pages++;
+	else
+		ret = 1;
+	spin_unlock(&pgdat->numa_migrate_lock);
+	return ret;
+}
+
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					     unsigned long node, int **result)
+{
+	return alloc_pages_node((int)node,
+				GFP_HIGHUSER_MOVABLE | GFP_THISNODE, 0);
+}
+
+/*
+ * Move a page that took a NUMA hinting fault from another node to @node.
+ * The caller holds a reference on the page, which is dropped. Returns 1
+ * if the page was migrated, 0 if it was left where it is.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+
+	/* Shared pages would just bounce between their users' nodes */
+	if (page_mapcount(page) != 1 ||
+	    numa_migrate_ratelimited(NODE_DATA(node))) {
+		put_page(page);
+		return 0;
+	}
+
+	if (isolate_lru_page(page)) {
+		put_page(page);
+		goto failed;
+	}
+	/* Isolation holds a reference of its own, migration needs ours gone */
+	put_page(page);
+
+	list_add(&page->lru, &migratepages);
+	if (migrate_pages(&migratepages, alloc_misplaced_dst_page, node))
+		goto failed;
+
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	current->numa_stats.pages_migrated++;
+	return 1;
+
+failed:
+	current->numa_stats.migrate_failed++;
+	return 0;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 #ifdef CONFIG_NUMA
 /*
  * Move a list of individual pages
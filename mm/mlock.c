@@ -422,7 +422,9 @@ success:
 	 * It's okay if try_to_unmap_one unmaps a page just after we
 	 * set VM_LOCKED, __mlock_vma_pages_range will bring it back.
 	 */
+	vma_write_begin(mm);
 	vma->vm_flags = newflags;
+	vma_write_end(mm);
 
 	if (lock) {
 		ret = __mlock_vma_pages_range(vma, start, end, 1);
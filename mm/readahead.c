@@ -16,6 +16,7 @@
 #include <linux/task_io_accounting_ops.h>
 #include <linux/pagevec.h>
 #include <linux/pagemap.h>
+#include <trace/readahead.h>
 
 /*
  * Initialise a struct file's readahead state.  Assumes that the caller has
@@ -29,6 +30,8 @@ file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
+DEFINE_TRACE(mm_readahead);
+
 #define list_to_page(head) (list_entry((head)->prev, struct page, lru))
 
 /*
@@ -332,6 +335,18 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * indicator. The flag won't be set on already cached pages, to avoid the
  * readahead-for-nothing fuss, saving pointless page cache lookups.
  *
+ * Besides the current stream, the state of the RA_STREAMS-1 streams active
+ * before it is kept in ra->streams[], most recent first. An access at the
+ * expected callback offset of any of them switches to that stream and
+ * continues its window where it left off, so threads pread()ing different
+ * regions of one fd, or a reader interleaving several streams, each keep
+ * a window sized for their own stream. A small random read is remembered
+ * in the least recently used slot not taken by an active stream, so that a
+ * read following right after it is recognised as the start of a stream
+ * even when other reads came in between. Streams pushed out of the table
+ * by a new stream with readahead pages left ahead of their reader account
+ * those pages as wasted.
+ *
  * prev_pos tracks the last visited byte in the _previous_ read request.
  * It should be maintained by the caller, and will be used for detecting
  * small random reads. Note that the readahead algorithm checks loosely
@@ -347,6 +362,121 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+static inline int ra_expected_offset(pgoff_t start, unsigned int size,
+				     unsigned int async_size, pgoff_t offset)
+{
+	return offset == start + size - async_size || offset == start + size;
+}
+
+/*
+ * Find the stream whose expected callback offset is @offset: 0 for the
+ * current one, i + 1 for ra->streams[i], or -1 if none.
+ */
+static int ra_find_stream(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream *s;
+	int i;
+
+	if (!offset)
+		return -1;
+	if (ra_expected_offset(ra->start, ra->size, ra->async_size, offset))
+		return 0;
+	for (i = 0; i < RA_STREAMS - 1; i++) {
+		s = &ra->streams[i];
+		if (s->size &&
+		    ra_expected_offset(s->start, s->size, s->async_size, offset))
+			return i + 1;
+	}
+	return -1;
+}
+
+/*
+ * Account the pages a stream read ahead of its reader, up to EOF, when it
+ * is dropped from the table.
+ */
+static void ra_drop_stream(struct address_space *mapping,
+			   struct file_ra_stream *s)
+{
+	pgoff_t end = s->start + s->size;
+	pgoff_t eof;
+
+	if (!s->async_size)
+		return;
+	eof = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >>
+							PAGE_CACHE_SHIFT;
+	if (end > eof)
+		end = eof;
+	if (end > s->start + s->size - s->async_size)
+		count_vm_events(READAHEAD_WASTED,
+				end - (s->start + s->size - s->async_size));
+}
+
+/*
+ * Make ra->streams[i - 1] the current stream, and the current one the
+ * most recent of the others.
+ */
+static void ra_switch_stream(struct file_ra_state *ra, int i)
+{
+	struct file_ra_stream tmp;
+
+	if (!i)
+		return;
+	tmp = ra->streams[i - 1];
+	for (i--; i > 0; i--)
+		ra->streams[i] = ra->streams[i - 1];
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+	ra->start = tmp.start;
+	ra->size = tmp.size;
+	ra->async_size = tmp.async_size;
+}
+
+/*
+ * A new stream starts at @offset: keep the current one in the table,
+ * unless @offset is within its window, i.e. it is the same stream
+ * restarting after a seek or a miss.
+ */
+static void ra_new_stream(struct address_space *mapping,
+			  struct file_ra_state *ra, pgoff_t offset)
+{
+	int i;
+
+	count_vm_event(READAHEAD_STREAM);
+	if (!ra->size || (offset >= ra->start && offset <= ra->start + ra->size))
+		return;
+
+	ra_drop_stream(mapping, &ra->streams[RA_STREAMS - 2]);
+	for (i = RA_STREAMS - 2; i > 0; i--)
+		ra->streams[i] = ra->streams[i - 1];
+	ra->streams[0].start = ra->start;
+	ra->streams[0].size = ra->size;
+	ra->streams[0].async_size = ra->async_size;
+}
+
+/*
+ * Remember a small random read where a read continuing it will find it.
+ * It takes the least recently used slot that is unused or holds no
+ * readahead pages ahead of its reader, such as an earlier small read;
+ * active streams are never pushed out for it.
+ */
+static void ra_note_read(struct file_ra_state *ra, pgoff_t offset,
+			 unsigned long req_size)
+{
+	struct file_ra_stream *s;
+	int i;
+
+	for (i = RA_STREAMS - 2; i >= 0; i--) {
+		s = &ra->streams[i];
+		if (!s->size || !s->async_size) {
+			s->start = offset;
+			s->size = req_size;
+			s->async_size = 0;
+			return;
+		}
+	}
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -359,13 +489,16 @@ ondemand_readahead(struct address_space *mapping,
 	int	max = ra->ra_pages;	/* max readahead pages */
 	pgoff_t prev_offset;
 	int	sequential;
+	int	stream;
+	unsigned long actual;
 
 	/*
-	 * It's the expected callback offset, assume sequential access.
-	 * Ramp up sizes, and push forward the readahead window.
+	 * It's the expected callback offset of a stream, assume sequential
+	 * access. Ramp up sizes, and push forward its readahead window.
 	 */
-	if (offset && (offset == (ra->start + ra->size - ra->async_size) ||
-			offset == (ra->start + ra->size))) {
+	stream = ra_find_stream(ra, offset);
+	if (stream >= 0) {
+		ra_switch_stream(ra, stream);
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -377,9 +510,10 @@ ondemand_readahead(struct address_space *mapping,
 
 	/*
 	 * Standalone, small read.
-	 * Read as is, and do not pollute the readahead state.
+	 * Read as is, and only note it as a possible start of a stream.
 	 */
 	if (!hit_readahead_marker && !sequential) {
+		ra_note_read(ra, offset, req_size);
 		return __do_page_cache_readahead(mapping, filp,
 						offset, req_size, 0);
 	}
@@ -400,6 +534,7 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_new_stream(mapping, ra, offset);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size = get_next_ra_size(ra, max);
@@ -414,12 +549,17 @@ ondemand_readahead(struct address_space *mapping,
 	 * 	- oversize random read
 	 * Start readahead for it.
 	 */
+	ra_new_stream(mapping, ra, offset);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
 
 readit:
-	return ra_submit(ra, mapping, filp);
+	actual = ra_submit(ra, mapping, filp);
+	count_vm_events(READAHEAD_PAGES, actual);
+	trace_mm_readahead(mapping, offset, req_size, ra, stream,
+			   hit_readahead_marker, actual);
+	return actual;
 }
 
 /**
@@ -444,6 +584,8 @@ void page_cache_sync_readahead(struct address_space *mapping,
 	if (!ra->ra_pages)
 		return;
 
+	count_vm_event(READAHEAD_MISS);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, false, offset, req_size);
 }
@@ -481,6 +623,7 @@ page_cache_async_readahead(struct address_space *mapping,
 		return;
 
 	ClearPageReadahead(page);
+	count_vm_event(READAHEAD_HIT);
 
 	/*
 	 * Defer asynchronous read-ahead on IO congestion.
@@ -750,13 +750,129 @@ void page_remove_rmap(struct page *page)
 	}
 }
 
+#ifdef CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH
+/*
+ * mm->tlb_flush_batched packs two 16-bit counts: deferred unmaps of the mm
+ * in the low half, and the value of that count when a flush of the whole
+ * mm last completed in the high half.
+ */
+#define TLB_FLUSH_BATCHED_SHIFT	16
+#define TLB_FLUSH_BATCHED_MASK	((1 << TLB_FLUSH_BATCHED_SHIFT) - 1)
+
+/*
+ * Flush the TLB entries left behind by try_to_unmap(TTU_BATCH_FLUSH) on
+ * every cpu that may hold them. Must be called before the unmapped pages
+ * are freed or their contents are relied upon.
+ */
+void try_to_unmap_flush(void)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+
+	if (!tlb_ubc->flush_required)
+		return;
+
+	flush_tlb_batched(&tlb_ubc->cpumask);
+	count_vm_event(TLB_BATCH_FLUSH);
+	cpumask_clear(&tlb_ubc->cpumask);
+	tlb_ubc->flush_required = false;
+	tlb_ubc->writable = false;
+}
+
+/*
+ * As try_to_unmap_flush(), but only if one of the cleared ptes was dirty:
+ * writeback must not start while a stale TLB entry can still modify the page.
+ */
+void try_to_unmap_flush_dirty(void)
+{
+	if (current->tlb_ubc.writable)
+		try_to_unmap_flush();
+}
+
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+	struct tlbflush_unmap_batch *tlb_ubc = &current->tlb_ubc;
+	int old, batched;
+
+	cpumask_or(&tlb_ubc->cpumask, &tlb_ubc->cpumask, mm_cpumask(mm));
+	tlb_ubc->flush_required = true;
+	if (writable)
+		tlb_ubc->writable = true;
+
+	/*
+	 * Let a racing munmap, mprotect or mremap of this mm know that it
+	 * cannot rely on its own flush alone: the pte cleared here is gone
+	 * but may still be cached until try_to_unmap_flush() is called.
+	 * The ptl is held, so this is ordered against their pte walk.
+	 */
+	do {
+		old = atomic_read(&mm->tlb_flush_batched);
+		batched = old + 1;
+		/* wrap both halves around, keeping a flush pending */
+		if ((old & TLB_FLUSH_BATCHED_MASK) == TLB_FLUSH_BATCHED_MASK)
+			batched = 1;
+	} while (atomic_cmpxchg(&mm->tlb_flush_batched, old, batched) != old);
+	count_vm_event(TLB_DEFERRED_UNMAP);
+}
+
+/*
+ * Deferring is only worth it if the mm is live on some other cpu; a flush
+ * of only the local TLB is cheap enough to do immediately.
+ */
+static bool should_defer_flush(struct mm_struct *mm, int flags)
+{
+	bool should_defer = false;
+
+	if (!(flags & TTU_BATCH_FLUSH))
+		return false;
+
+	if (cpumask_any_but(mm_cpumask(mm), get_cpu()) < nr_cpu_ids)
+		should_defer = true;
+	put_cpu();
+
+	return should_defer;
+}
+
+/*
+ * Called with the ptl of a page table of @mm held, before its ptes are
+ * changed or zapped: if reclaim has cleared ptes of @mm without flushing
+ * yet, flush now, so that the caller's own flush of its range is not
+ * mistaken to cover those as well.
+ */
+void flush_tlb_batched_pending(struct mm_struct *mm)
+{
+	int batched = atomic_read(&mm->tlb_flush_batched);
+	int pending = batched & TLB_FLUSH_BATCHED_MASK;
+	int flushed = batched >> TLB_FLUSH_BATCHED_SHIFT;
+
+	if (pending != flushed) {
+		flush_tlb_mm(mm);
+		/*
+		 * If a new deferred unmap raced in, the cmpxchg fails and
+		 * the next caller flushes again.
+		 */
+		atomic_cmpxchg(&mm->tlb_flush_batched, batched,
+			       pending | (pending << TLB_FLUSH_BATCHED_SHIFT));
+	}
+}
+#else
+static void set_tlb_ubc_flush_pending(struct mm_struct *mm, bool writable)
+{
+}
+
+static bool should_defer_flush(struct mm_struct *mm, int flags)
+{
+	return false;
+}
+#endif /* CONFIG_ARCH_WANT_BATCHED_UNMAP_TLB_FLUSH */
+
 /*
  * Subfunctions of try_to_unmap: try_to_unmap_one called
  * repeatedly from either try_to_unmap_anon or try_to_unmap_file.
  */
 static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
-				int migration)
+				int flags)
 {
+	int migration = flags & TTU_MIGRATION;
 	struct mm_struct *mm = vma->vm_mm;
 	unsigned long address;
 	pte_t *pte;
@@ -790,7 +906,17 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
-	pteval = ptep_clear_flush_notify(vma, address, pte);
+	if (should_defer_flush(mm, flags)) {
+		/*
+		 * Clear the pte but leave the TLB flush to the caller's
+		 * try_to_unmap_flush(), so that a whole batch of pages
+		 * costs one IPI round instead of one per page.
+		 */
+		pteval = ptep_get_and_clear(mm, address, pte);
+		mmu_notifier_invalidate_page(mm, address);
+		set_tlb_ubc_flush_pending(mm, pte_dirty(pteval));
+	} else
+		pteval = ptep_clear_flush_notify(vma, address, pte);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
@@ -983,7 +1109,7 @@ static int try_to_mlock_page(struct page *page, struct vm_area_struct *vma)
  * rmap method
  * @page: the page to unmap/unlock
  * @unlock:  request for unlock rather than unmap [unlikely]
- * @migration:  unmapping for migration - ignored if @unlock
+ * @flags:  TTU_ flags for try_to_unmap_one() - ignored if @unlock
  *
  * Find all the mappings of a page using the mapping pointer and the vma chains
  * contained in the anon_vma struct it points to.
@@ -995,7 +1121,7 @@ static int try_to_mlock_page(struct page *page, struct vm_area_struct *vma)
  * vm_flags for that VMA.  That should be OK, because that vma shouldn't be
  * 'LOCKED.
  */
-static int try_to_unmap_anon(struct page *page, int unlock, int migration)
+static int try_to_unmap_anon(struct page *page, int unlock, int flags)
 {
 	struct anon_vma *anon_vma;
 	struct vm_area_struct *vma;
@@ -1016,7 +1142,7 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
 				continue;  /* must visit all unlocked vmas */
 			ret = SWAP_MLOCK;  /* saw at least one mlocked vma */
 		} else {
-			ret = try_to_unmap_one(page, vma, migration);
+			ret = try_to_unmap_one(page, vma, flags);
 			if (ret == SWAP_FAIL || !page_mapped(page))
 				break;
 		}
@@ -1041,7 +1167,7 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
  * try_to_unmap_file - unmap/unlock file page using the object-based rmap method
  * @page: the page to unmap/unlock
  * @unlock:  request for unlock rather than unmap [unlikely]
- * @migration:  unmapping for migration - ignored if @unlock
+ * @flags:  TTU_ flags for try_to_unmap_one() - ignored if @unlock
  *
  * Find all the mappings of a page using the mapping pointer and the vma chains
  * contained in the address_space struct it points to.
@@ -1053,8 +1179,9 @@ static int try_to_unmap_anon(struct page *page, int unlock, int migration)
  * vm_flags for that VMA.  That should be OK, because that vma shouldn't be
  * 'LOCKED.
  */
-static int try_to_unmap_file(struct page *page, int unlock, int migration)
+static int try_to_unmap_file(struct page *page, int unlock, int flags)
 {
+	int migration = flags & TTU_MIGRATION;
 	struct address_space *mapping = page->mapping;
 	pgoff_t pgoff = page->index << (PAGE_CACHE_SHIFT - PAGE_SHIFT);
 	struct vm_area_struct *vma;
@@ -1077,7 +1204,7 @@ static int try_to_unmap_file(struct page *page, int unlock, int migration)
 				continue;	/* must visit all vmas */
 			ret = SWAP_MLOCK;
 		} else {
-			ret = try_to_unmap_one(page, vma, migration);
+			ret = try_to_unmap_one(page, vma, flags);
 			if (ret == SWAP_FAIL || !page_mapped(page))
 				goto out;
 		}
@@ -1176,7 +1303,8 @@ out:
 /**
  * try_to_unmap - try to remove all page table mappings to a page
  * @page: the page to get unmapped
- * @migration: migration flag
+ * @flags: TTU_MIGRATION to leave migration entries behind, TTU_BATCH_FLUSH
+ *	to leave the TLB flush to try_to_unmap_flush()
  *
  * Tries to remove all the page table entries which are mapping this
  * page, used in the pageout path.  Caller must hold the page lock.
@@ -1187,16 +1315,16 @@ out:
  * SWAP_FAIL	- the page is unswappable
  * SWAP_MLOCK	- page is mlocked.
  */
-int try_to_unmap(struct page *page, int migration)
+int try_to_unmap(struct page *page, int flags)
 {
 	int ret;
 
 	BUG_ON(!PageLocked(page));
 
 	if (PageAnon(page))
-		ret = try_to_unmap_anon(page, 0, migration);
+		ret = try_to_unmap_anon(page, 0, flags);
 	else
-		ret = try_to_unmap_file(page, 0, migration);
+		ret = try_to_unmap_file(page, 0, flags);
 	if (ret != SWAP_MLOCK && !page_mapped(page))
 		ret = SWAP_SUCCESS;
 	return ret;
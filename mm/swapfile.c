@@ -29,6 +29,10 @@
 #include <linux/capability.h>
 #include <linux/syscalls.h>
 #include <linux/memcontrol.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
+#include <linux/workqueue.h>
+#include <linux/zswap.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -374,17 +378,23 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to n slots, all from the same swap device, into slots[].
+ * scan_swap_map() hands out consecutive offsets within the device's
+ * current cluster, so a batch normally forms one contiguous run on disk.
+ * Returns the number of slots allocated.
+ */
+static int get_swap_pages(int n, swp_entry_t slots[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int nr = 0;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info + type;
@@ -401,18 +411,24 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
-		offset = scan_swap_map(si);
-		if (offset) {
-			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+		/* scan_swap_map() may drop swap_lock: recheck each time */
+		while (nr < n && nr_swap_pages > 0 &&
+		       (si->flags & SWP_WRITEOK)) {
+			nr_swap_pages--;
+			offset = scan_swap_map(si);
+			if (!offset) {
+				nr_swap_pages++;
+				break;
+			}
+			slots[nr++] = swp_entry(type, offset);
 		}
+		if (nr)
+			break;
 		next = swap_list.next;
 	}
-
-	nr_swap_pages++;
 noswap:
 	spin_unlock(&swap_lock);
-	return (swp_entry_t) {0};
+	return nr;
 }
 
 swp_entry_t get_swap_page_of_type(int type)
@@ -435,7 +451,7 @@ swp_entry_t get_swap_page_of_type(int type)
 	return (swp_entry_t) {0};
 }
 
-static struct swap_info_struct * swap_info_get(swp_entry_t entry)
+static struct swap_info_struct *swap_info_check(swp_entry_t entry)
 {
 	struct swap_info_struct * p;
 	unsigned long offset, type;
@@ -453,7 +469,6 @@ static struct swap_info_struct * swap_info_get(swp_entry_t entry)
 		goto bad_offset;
 	if (!p->swap_map[offset])
 		goto bad_free;
-	spin_lock(&swap_lock);
 	return p;
 
 bad_free:
@@ -489,11 +504,241 @@ static int swap_entry_free(struct swap_info_struct *p, swp_entry_t ent)
 			nr_swap_pages++;
 			p->inuse_pages--;
 			mem_cgroup_uncharge_swap(ent);
+			zswap_invalidate_page(p - swap_info, offset);
 		}
 	}
 	return count;
 }
 
+/*
+ * Per-cpu swap slot caches.
+ *
+ * Reclaim on many cpus at once used to serialise on swap_lock for every
+ * single page it swapped out, and again for every swap reference it
+ * dropped.  Instead, each cpu takes a batch of slots from one device in
+ * one go, and allocates from that contiguous run without touching
+ * swap_lock until it is used up; and swap_free() queues the references it
+ * drops, returning them to the swap map in one batch.
+ *
+ * Cached slots are fully allocated as far as the swap map is concerned
+ * (count 1, not yet in the swap cache), just as if get_swap_page() had
+ * been called earlier: a racing read_swap_cache_async() is dealt with by
+ * add_to_swap() as before.  Queued frees just hold their reference a
+ * little longer: at most SWAP_SLOTS_RET_DELAY, after which a work item
+ * returns them even if the cpu queued nothing more, and page_swapcount()
+ * returns those of all cpus before it reports a page as shared.  Both only
+ * happen while the device is SWP_WRITEOK, and sys_swapoff() drains every
+ * cache after clearing it, before try_to_unuse() needs the counts to drop.
+ *
+ * Lock order: alloc_lock, then lock, then swap_lock.  alloc_lock is held
+ * across the refill, which may sleep in scan_swap_map().
+ */
+#define SWAP_SLOTS_CACHE_SIZE	64
+#define SWAP_SLOTS_RET_DELAY	(HZ / 10)
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* serialises refill and drain */
+	spinlock_t	lock;		/* protects the fields below */
+	int		cur;		/* next slot to hand out */
+	int		nr;		/* number of slots in slots[] */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	int		n_ret;		/* number of queued frees */
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+	struct delayed_work ret_work;	/* returns old queued frees */
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swap_slots);
+
+/*
+ * Only cache slots while there is plenty of swap left, so that slots
+ * sitting idle in other cpus' caches cannot make us fail early.
+ */
+static inline int swap_slots_cache_active(void)
+{
+	return nr_swap_pages > (long)num_online_cpus() *
+				SWAP_SLOTS_CACHE_SIZE * 2;
+}
+
+/* Called with cache->lock and swap_lock held */
+static void __free_swap_slots_ret(struct swap_slots_cache *cache)
+{
+	swp_entry_t entry;
+	int i;
+
+	for (i = 0; i < cache->n_ret; i++) {
+		entry = cache->slots_ret[i];
+		swap_entry_free(swap_info + swp_type(entry), entry);
+	}
+	cache->n_ret = 0;
+}
+
+/* Returns 1 if there were queued frees */
+static int free_swap_slots_ret(struct swap_slots_cache *cache)
+{
+	int ret;
+
+	spin_lock(&cache->lock);
+	spin_lock(&swap_lock);
+	ret = cache->n_ret != 0;
+	__free_swap_slots_ret(cache);
+	spin_unlock(&swap_lock);
+	spin_unlock(&cache->lock);
+	return ret;
+}
+
+/*
+ * Return the frees queued on this cpu to the swap map, so that counts
+ * looked at next by this task (e.g. reuse_swap_page() after swap_free()
+ * in do_swap_page()) are up to date.
+ */
+static void flush_swap_slots_ret(void)
+{
+	struct swap_slots_cache *cache;
+
+	cache = &get_cpu_var(swap_slots);
+	if (cache->n_ret)
+		free_swap_slots_ret(cache);
+	put_cpu_var(swap_slots);
+}
+
+/*
+ * Return the frees queued on every cpu, for when a count has to be exact.
+ * Returns 1 if any were queued.
+ */
+static int flush_all_swap_slots_ret(void)
+{
+	struct swap_slots_cache *cache;
+	int cpu, ret = 0;
+
+	for_each_online_cpu(cpu) {
+		cache = &per_cpu(swap_slots, cpu);
+		if (cache->n_ret)
+			ret |= free_swap_slots_ret(cache);
+	}
+	return ret;
+}
+
+/* Don't leave frees queued on a cpu which stopped swapping */
+static void swap_slots_ret_work(struct work_struct *work)
+{
+	struct swap_slots_cache *cache =
+		container_of(work, struct swap_slots_cache, ret_work.work);
+
+	free_swap_slots_ret(cache);
+}
+
+static void __drain_swap_slots(struct swap_slots_cache *cache)
+{
+	swp_entry_t entry;
+
+	mutex_lock(&cache->alloc_lock);
+	spin_lock(&cache->lock);
+	spin_lock(&swap_lock);
+	while (cache->cur < cache->nr) {
+		entry = cache->slots[cache->cur++];
+		swap_entry_free(swap_info + swp_type(entry), entry);
+	}
+	cache->cur = cache->nr = 0;
+	__free_swap_slots_ret(cache);
+	spin_unlock(&swap_lock);
+	spin_unlock(&cache->lock);
+	mutex_unlock(&cache->alloc_lock);
+}
+
+/*
+ * Give back all cached slots and queued frees.  Caches cannot take up
+ * slots of a device which is not SWP_WRITEOK again afterwards.
+ */
+static void drain_swap_slots(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		__drain_swap_slots(&per_cpu(swap_slots, cpu));
+}
+
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nb,
+					     unsigned long action, void *hcpu)
+{
+	int cpu = (unsigned long)hcpu;
+
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		__drain_swap_slots(&per_cpu(swap_slots, cpu));
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	struct swap_slots_cache *cache;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		cache = &per_cpu(swap_slots, cpu);
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->lock);
+		INIT_DELAYED_WORK(&cache->ret_work, swap_slots_ret_work);
+	}
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	return 0;
+}
+__initcall(swap_slots_init);
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry;
+	int nr;
+
+	entry.val = 0;
+	cache = &get_cpu_var(swap_slots);
+	spin_lock(&cache->lock);
+	if (cache->cur < cache->nr)
+		entry = cache->slots[cache->cur++];
+	spin_unlock(&cache->lock);
+	put_cpu_var(swap_slots);
+	if (entry.val)
+		return entry;
+
+	if (!swap_slots_cache_active()) {
+		get_swap_pages(1, &entry);
+		return entry;
+	}
+
+	/*
+	 * Refill.  We may have moved to another cpu by now, which does not
+	 * matter: the slots go into the cache we looked at.  Nobody reads
+	 * slots[] while cur == nr, so it is filled without cache->lock.
+	 */
+	mutex_lock(&cache->alloc_lock);
+	spin_lock(&cache->lock);
+	if (cache->cur < cache->nr)
+		entry = cache->slots[cache->cur++];
+	spin_unlock(&cache->lock);
+	if (!entry.val) {
+		nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE, cache->slots);
+		if (nr) {
+			entry = cache->slots[0];
+			spin_lock(&cache->lock);
+			cache->cur = 1;
+			cache->nr = nr;
+			spin_unlock(&cache->lock);
+		}
+	}
+	mutex_unlock(&cache->alloc_lock);
+	return entry;
+}
+
+static struct swap_info_struct * swap_info_get(swp_entry_t entry)
+{
+	struct swap_info_struct * p;
+
+	flush_swap_slots_ret();
+	p = swap_info_check(entry);
+	if (p)
+		spin_lock(&swap_lock);
+	return p;
+}
+
 /*
  * Caller has made sure that the swapdevice corresponding to entry
  * is still around or has not been recycled.
@@ -501,9 +746,31 @@ static int swap_entry_free(struct swap_info_struct *p, swp_entry_t ent)
 void swap_free(swp_entry_t entry)
 {
 	struct swap_info_struct * p;
+	struct swap_slots_cache *cache;
+
+	p = swap_info_check(entry);
+	if (!p)
+		return;
+
+	cache = &get_cpu_var(swap_slots);
+	spin_lock(&cache->lock);
+	if (p->flags & SWP_WRITEOK) {
+		if (!cache->n_ret)
+			schedule_delayed_work(&cache->ret_work,
+					      SWAP_SLOTS_RET_DELAY);
+		cache->slots_ret[cache->n_ret++] = entry;
+		if (cache->n_ret == SWAP_SLOTS_CACHE_SIZE) {
+			spin_lock(&swap_lock);
+			__free_swap_slots_ret(cache);
+			spin_unlock(&swap_lock);
+		}
+		entry.val = 0;
+	}
+	spin_unlock(&cache->lock);
+	put_cpu_var(swap_slots);
 
-	p = swap_info_get(entry);
-	if (p) {
+	if (entry.val) {
+		spin_lock(&swap_lock);
 		swap_entry_free(p, entry);
 		spin_unlock(&swap_lock);
 	}
@@ -524,6 +791,13 @@ static inline int page_swapcount(struct page *page)
 		/* Subtract the 1 for the swap cache itself */
 		count = p->swap_map[swp_offset(entry)] - 1;
 		spin_unlock(&swap_lock);
+
+		/* Other cpus may still hold dropped references queued */
+		if (count > 0 && flush_all_swap_slots_ret()) {
+			spin_lock(&swap_lock);
+			count = p->swap_map[swp_offset(entry)] - 1;
+			spin_unlock(&swap_lock);
+		}
 	}
 	return count;
 }
@@ -1447,6 +1721,9 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* give back slots of this device held in the per-cpu caches */
+	drain_swap_slots();
+
 	current->flags |= PF_SWAPOFF;
 	err = try_to_unuse(type);
 	current->flags &= ~PF_SWAPOFF;
@@ -1479,6 +1756,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	up_write(&swap_unplug_sem);
 
 	destroy_swap_extents(p);
+	zswap_invalidate_area(type);
 	mutex_lock(&swapon_mutex);
 	spin_lock(&swap_lock);
 	drain_mmlist();
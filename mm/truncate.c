@@ -178,6 +178,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	next = start;
 	while (next <= end &&
 	       pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+		mem_cgroup_uncharge_start();
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
 			pgoff_t page_index = page->index;
@@ -204,6 +205,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			truncate_complete_page(mapping, page);
 			unlock_page(page);
 		}
+		mem_cgroup_uncharge_end();
 		pagevec_release(&pvec);
 		cond_resched();
 	}
@@ -231,6 +233,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			pagevec_release(&pvec);
 			break;
 		}
+		mem_cgroup_uncharge_start();
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
 
@@ -249,6 +252,7 @@ void truncate_inode_pages_range(struct address_space *mapping,
 			truncate_complete_page(mapping, page);
 			unlock_page(page);
 		}
+		mem_cgroup_uncharge_end();
 		pagevec_release(&pvec);
 	}
 }
@@ -278,6 +282,7 @@ unsigned long __invalidate_mapping_pages(struct address_space *mapping,
 	pagevec_init(&pvec, 0);
 	while (next <= end &&
 			pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+		mem_cgroup_uncharge_start();
 		for (i = 0; i < pagevec_count(&pvec); i++) {
 			struct page *page = pvec.pages[i];
 			pgoff_t index;
@@ -308,6 +313,7 @@ unlock:
 			if (next > end)
 				break;
 		}
+		mem_cgroup_uncharge_end();
 		pagevec_release(&pvec);
 		if (likely(!be_atomic))
 			cond_resched();
@@ -0,0 +1,214 @@
+/*
+ * vmap/vunmap scalability benchmark
+ *
+ * Loading the module starts one thread per online CPU (or nr_threads of
+ * them), each of which maps its own nr_pages pages into kernel virtual
+ * space, touches the mapping and unmaps it again, iterations times. The
+ * run is done once with vm_map_ram()/vm_unmap_ram(), which serves small
+ * requests from per-cpu vmap blocks, and once with vmap()/vunmap(), which
+ * always goes to the global vmap area tree. The wall time and the cost
+ * per map/unmap pair are printed for both; a rising cost with the number
+ * of threads shows contention on the global vmap locks and TLB flushes.
+ *
+ * Example: modprobe vmap_bench nr_threads=8 nr_pages=16 iterations=50000
+ */
+
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+
+static int bench_threads;
+module_param_named(nr_threads, bench_threads, int, 0444);
+MODULE_PARM_DESC(nr_threads, "Number of threads (default: online CPUs)");
+
+static int nr_pages = 4;
+module_param(nr_pages, int, 0444);
+MODULE_PARM_DESC(nr_pages, "Pages mapped per operation");
+
+static int iterations = 100000;
+module_param(iterations, int, 0444);
+MODULE_PARM_DESC(iterations, "Map/unmap pairs per thread");
+
+enum { BENCH_VM_MAP_RAM, BENCH_VMAP };
+
+static const char *bench_name[] = { "vm_map_ram", "vmap" };
+
+struct bench_thread {
+	struct task_struct *task;
+	struct page **pages;
+	int mode;
+	int failed;
+};
+
+static DECLARE_WAIT_QUEUE_HEAD(bench_start_wait);
+static DECLARE_COMPLETION(bench_done);
+static atomic_t bench_running;
+static int bench_go;
+
+static int bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	void *addr;
+	int i;
+
+	wait_event(bench_start_wait, bench_go || kthread_should_stop());
+	if (!bench_go)
+		return 0;
+
+	for (i = 0; i < iterations; i++) {
+		if (bt->mode == BENCH_VM_MAP_RAM)
+			addr = vm_map_ram(bt->pages, nr_pages, -1, PAGE_KERNEL);
+		else
+			addr = vmap(bt->pages, nr_pages, VM_MAP, PAGE_KERNEL);
+		if (!addr) {
+			bt->failed = 1;
+			break;
+		}
+
+		*(volatile char *)addr = 0;
+
+		if (bt->mode == BENCH_VM_MAP_RAM)
+			vm_unmap_ram(addr, nr_pages);
+		else
+			vunmap(addr);
+
+		if (need_resched())
+			cond_resched();
+	}
+
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+
+	/* stay around until the result has been collected */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static void bench_run(struct bench_thread *bt, int mode)
+{
+	unsigned long long ns, ops;
+	ktime_t start;
+	int cpu = -1;
+	int i, failed = 0;
+
+	bench_go = 0;
+	INIT_COMPLETION(bench_done);
+	atomic_set(&bench_running, bench_threads);
+
+	for (i = 0; i < bench_threads; i++) {
+		bt[i].mode = mode;
+		bt[i].failed = 0;
+		bt[i].task = kthread_create(bench_thread_fn, &bt[i],
+					    "vmap_bench/%d", i);
+		if (IS_ERR(bt[i].task)) {
+			printk(KERN_ERR "vmap_bench: cannot start thread\n");
+			while (--i >= 0)
+				kthread_stop(bt[i].task);
+			return;
+		}
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(bt[i].task, cpu);
+		wake_up_process(bt[i].task);
+	}
+
+	start = ktime_get();
+	bench_go = 1;
+	wake_up_all(&bench_start_wait);
+	wait_for_completion(&bench_done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	for (i = 0; i < bench_threads; i++) {
+		failed |= bt[i].failed;
+		kthread_stop(bt[i].task);
+	}
+
+	if (failed) {
+		printk(KERN_ERR "vmap_bench: %s: mapping failed\n",
+		       bench_name[mode]);
+		return;
+	}
+
+	ops = (unsigned long long)bench_threads * iterations;
+	printk(KERN_INFO "vmap_bench: %s: %d threads, %d pages: "
+	       "%llu ops in %llu ms, %llu ns per map+unmap per thread\n",
+	       bench_name[mode], bench_threads, nr_pages, ops,
+	       div_u64(ns, NSEC_PER_MSEC),
+	       div64_u64(ns * bench_threads, ops));
+}
+
+static void bench_free(struct bench_thread *bt)
+{
+	int i, j;
+
+	for (i = 0; i < bench_threads; i++) {
+		if (!bt[i].pages)
+			continue;
+		for (j = 0; j < nr_pages; j++)
+			if (bt[i].pages[j])
+				__free_page(bt[i].pages[j]);
+		kfree(bt[i].pages);
+	}
+	kfree(bt);
+}
+
+static int __init vmap_bench_init(void)
+{
+	struct bench_thread *bt;
+	int i, j;
+
+	if (bench_threads <= 0)
+		bench_threads = num_online_cpus();
+	if (nr_pages <= 0 || iterations <= 0)
+		return -EINVAL;
+
+	bt = kcalloc(bench_threads, sizeof(*bt), GFP_KERNEL);
+	if (!bt)
+		return -ENOMEM;
+
+	for (i = 0; i < bench_threads; i++) {
+		bt[i].pages = kcalloc(nr_pages, sizeof(struct page *),
+				      GFP_KERNEL);
+		if (!bt[i].pages)
+			goto nomem;
+		for (j = 0; j < nr_pages; j++) {
+			bt[i].pages[j] = alloc_page(GFP_KERNEL);
+			if (!bt[i].pages[j])
+				goto nomem;
+		}
+	}
+
+	bench_run(bt, BENCH_VM_MAP_RAM);
+	bench_run(bt, BENCH_VMAP);
+
+	bench_free(bt);
+	return 0;
+
+nomem:
+	bench_free(bt);
+	return -ENOMEM;
+}
+
+static void __exit vmap_bench_exit(void)
+{
+}
+
+module_init(vmap_bench_init);
+module_exit(vmap_bench_exit);
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("vmap/vunmap scalability benchmark");
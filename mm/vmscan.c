@@ -40,6 +40,8 @@
 #include <linux/memcontrol.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
+#include <linux/ktime.h>
+#include <trace/vmscan.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -130,6 +132,20 @@ struct scan_control {
 int vm_swappiness = 60;
 long vm_total_pages;	/* The total number of pages which the VM controls */
 
+/*
+ * The maximum number of tasks doing direct reclaim on a zone at the same
+ * time. Further reclaimers wait until a slot frees up or the zone has been
+ * refilled by the tasks ahead of them. 0 means no limit.
+ */
+int vm_max_zone_concurrent_reclaimers = 8;
+
+/* Number of kswapd threads per node, see kswapd_threads= */
+static int kswapd_threads = 1;
+
+DEFINE_TRACE(mm_vmscan_direct_reclaim_begin);
+DEFINE_TRACE(mm_vmscan_direct_reclaim_end);
+DEFINE_TRACE(mm_vmscan_reclaim_throttle);
+
 static LIST_HEAD(shrinker_list);
 static DECLARE_RWSEM(shrinker_rwsem);
 
@@ -666,7 +682,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * processes. Try to unmap it here.
 		 */
 		if (page_mapped(page) && mapping) {
-			switch (try_to_unmap(page, 0)) {
+			switch (try_to_unmap(page, TTU_BATCH_FLUSH)) {
 			case SWAP_FAIL:
 				goto activate_locked;
 			case SWAP_AGAIN:
@@ -686,6 +702,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			if (!sc->may_writepage)
 				goto keep_locked;
 
+			/*
+			 * A stale TLB entry left by the batched unmap above
+			 * could still dirty the page behind writeback's back.
+			 */
+			try_to_unmap_flush_dirty();
+
 			/* Page is dirty, try to write it out here */
 			switch (pageout(page, mapping, sync_writeback)) {
 			case PAGE_KEEP:
@@ -765,6 +787,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 free_it:
 		nr_reclaimed++;
 		if (!pagevec_add(&freed_pvec, page)) {
+			try_to_unmap_flush();
 			__pagevec_free(&freed_pvec);
 			pagevec_reinit(&freed_pvec);
 		}
@@ -790,6 +813,8 @@ keep:
 		list_add(&page->lru, &ret_pages);
 		VM_BUG_ON(PageLRU(page) || PageUnevictable(page));
 	}
+	/* no page may be reused while another cpu can still reach it */
+	try_to_unmap_flush();
 	list_splice(&ret_pages, page_list);
 	if (pagevec_count(&freed_pvec))
 		__pagevec_free(&freed_pvec);
@@ -1525,6 +1550,71 @@ static void shrink_zone(int priority, struct zone *zone,
 	throttle_vm_writeout(sc->gfp_mask);
 }
 
+/* zone_reclaim_acquire() results */
+enum {
+	ZONE_RECLAIM_ACQUIRED,	/* got a slot, reclaim from the zone */
+	ZONE_RECLAIM_REFILLED,	/* throttled, and the zone is ok now */
+	ZONE_RECLAIM_KILLED,	/* throttled, and a fatal signal came in */
+};
+
+/*
+ * Get a direct reclaim slot on @zone, queueing behind the reclaimers which
+ * already hold one if vm_max_zone_concurrent_reclaimers is reached. Piling
+ * more tasks onto the same LRU only adds lru_lock contention and makes each
+ * of them isolate pages the others could have freed.
+ *
+ * Returns ZONE_RECLAIM_ACQUIRED if the caller holds a slot and must drop it
+ * with zone_reclaim_release(), ZONE_RECLAIM_REFILLED if the zone got above
+ * its low watermark while we waited, so reclaiming from it is not needed,
+ * or ZONE_RECLAIM_KILLED if we are being killed.
+ */
+static int zone_reclaim_acquire(struct zone *zone, struct scan_control *sc)
+{
+	DEFINE_WAIT(wait);
+	int max = vm_max_zone_concurrent_reclaimers;
+	ktime_t start;
+	int ret;
+
+	if (atomic_inc_return(&zone->concurrent_reclaimers) <= max || !max)
+		return ZONE_RECLAIM_ACQUIRED;
+	atomic_dec(&zone->concurrent_reclaimers);
+
+	start = ktime_get();
+	for (;;) {
+		prepare_to_wait_exclusive(&zone->reclaim_wait, &wait,
+					  TASK_KILLABLE);
+		if (atomic_read(&zone->concurrent_reclaimers) >= max)
+			schedule_timeout(HZ/10);
+		finish_wait(&zone->reclaim_wait, &wait);
+
+		if (fatal_signal_pending(current)) {
+			ret = ZONE_RECLAIM_KILLED;
+			break;
+		}
+		if (zone_watermark_ok(zone, sc->order, zone->pages_low, 0, 0)) {
+			ret = ZONE_RECLAIM_REFILLED;
+			break;
+		}
+		if (atomic_inc_return(&zone->concurrent_reclaimers) <= max) {
+			ret = ZONE_RECLAIM_ACQUIRED;
+			break;
+		}
+		atomic_dec(&zone->concurrent_reclaimers);
+	}
+	trace_mm_vmscan_reclaim_throttle(zone,
+			ktime_to_ns(ktime_sub(ktime_get(), start)),
+			ret != ZONE_RECLAIM_ACQUIRED);
+	return ret;
+}
+
+static void zone_reclaim_release(struct zone *zone)
+{
+	atomic_dec(&zone->concurrent_reclaimers);
+	smp_mb__after_atomic_dec();
+	if (waitqueue_active(&zone->reclaim_wait))
+		wake_up(&zone->reclaim_wait);
+}
+
 /*
  * This is the direct reclaim path, for page-allocating processes.  We only
  * try to reclaim pages from zones which will satisfy the caller's allocation
@@ -1538,8 +1628,11 @@ static void shrink_zone(int priority, struct zone *zone,
  *
  * If a zone is deemed to be full of pinned pages then just give it a light
  * scan then give up on it.
+ *
+ * Returns -EINTR if a fatal signal came in while we were waiting for a
+ * reclaim slot, 0 otherwise.
  */
-static void shrink_zones(int priority, struct zonelist *zonelist,
+static int shrink_zones(int priority, struct zonelist *zonelist,
 					struct scan_control *sc)
 {
 	enum zone_type high_zoneidx = gfp_zone(sc->gfp_mask);
@@ -1564,6 +1657,23 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 						priority != DEF_PRIORITY)
 				continue;	/* Let kswapd poll it */
 			sc->all_unreclaimable = 0;
+
+			switch (zone_reclaim_acquire(zone, sc)) {
+			case ZONE_RECLAIM_KILLED:
+				return -EINTR;
+			case ZONE_RECLAIM_REFILLED:
+				/*
+				 * The reclaimers ahead of us got the zone
+				 * above its low watermark: report progress
+				 * so the allocator retries instead of going
+				 * OOM.
+				 */
+				sc->nr_reclaimed += sc->swap_cluster_max;
+				continue;
+			}
+			shrink_zone(priority, zone, sc);
+			zone_reclaim_release(zone);
+			continue;
 		} else {
 			/*
 			 * Ignore cpuset limitation here. We just want to reduce
@@ -1576,6 +1686,7 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
 
 		shrink_zone(priority, zone, sc);
 	}
+	return 0;
 }
 
 /*
@@ -1586,10 +1697,10 @@ static void shrink_zones(int priority, struct zonelist *zonelist,
  *
  * If the caller is !__GFP_FS then the probability of a failure is reasonably
  * high - the zone may be full of dirty or under-writeback pages, which this
- * caller can't do much about.  We kick pdflush and take explicit naps in the
- * hope that some of these pages can be written.  But if the allocating task
- * holds filesystem locks which prevent writeout this might not work, and the
- * allocation attempt will fail.
+ * caller can't do much about.  We kick the flusher threads and take explicit
+ * naps in the hope that some of these pages can be written.  But if the
+ * allocating task holds filesystem locks which prevent writeout this might not
+ * work, and the allocation attempt will fail.
  *
  * returns:	0, if no pages reclaimed
  * 		else, the number of pages reclaimed
@@ -1627,7 +1738,11 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		sc->nr_scanned = 0;
 		if (!priority)
 			disable_swap_token();
-		shrink_zones(priority, zonelist, sc);
+		if (shrink_zones(priority, zonelist, sc)) {
+			/* Killed while throttled: no progress, do not retry */
+			ret = 0;
+			goto out;
+		}
 		/*
 		 * Don't shrink slabs when reclaiming memory from
 		 * over limit cgroups
@@ -1654,7 +1769,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		 */
 		if (total_scanned > sc->swap_cluster_max +
 					sc->swap_cluster_max / 2) {
-			wakeup_pdflush(laptop_mode ? 0 : total_scanned);
+			wakeup_flusher_threads(laptop_mode ? 0 : total_scanned);
 			sc->may_writepage = 1;
 		}
 
@@ -1695,6 +1810,8 @@ out:
 unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				gfp_t gfp_mask, nodemask_t *nodemask)
 {
+	unsigned long nr_reclaimed;
+	ktime_t start;
 	struct scan_control sc = {
 		.gfp_mask = gfp_mask,
 		.may_writepage = !laptop_mode,
@@ -1708,7 +1825,14 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 		.nodemask = nodemask,
 	};
 
-	return do_try_to_free_pages(zonelist, &sc);
+	trace_mm_vmscan_direct_reclaim_begin(order, gfp_mask);
+	start = ktime_get();
+
+	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
+
+	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
+	return nr_reclaimed;
 }
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
@@ -1736,11 +1860,45 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
 	zonelist = NODE_DATA(numa_node_id())->node_zonelists;
 	return do_try_to_free_pages(zonelist, &sc);
 }
+
+/*
+ * Reclaim from the pages @mem has in @zone only. Used by kswapd to push
+ * groups back towards their soft limit in the zone it is balancing.
+ */
+unsigned long mem_cgroup_shrink_node_zone(struct mem_cgroup *mem,
+					  gfp_t gfp_mask, bool noswap,
+					  unsigned int swappiness,
+					  struct zone *zone)
+{
+	struct scan_control sc = {
+		.may_writepage = !laptop_mode,
+		.may_unmap = 1,
+		.may_swap = !noswap,
+		.swap_cluster_max = SWAP_CLUSTER_MAX,
+		.swappiness = swappiness,
+		.order = 0,
+		.mem_cgroup = mem,
+		.isolate_pages = mem_cgroup_isolate_pages,
+	};
+
+	sc.gfp_mask = (gfp_mask & GFP_RECLAIM_MASK) |
+			(GFP_HIGHUSER_MOVABLE & ~GFP_RECLAIM_MASK);
+	/*
+	 * NOTE: Although we can get the priority field, using it
+	 * here is not a good idea, since it limits the pages we can scan.
+	 * if we don't reclaim here, the shrink_zone from balance_pgdat
+	 * will pick up pages from other mem cgroup's as well. We hack
+	 * the priority and make it zero.
+	 */
+	shrink_zone(0, zone, &sc);
+	return sc.nr_reclaimed;
+}
 #endif
 
 /*
- * For kswapd, balance_pgdat() will work across all this node's zones until
- * they are all at pages_high.
+ * For kswapd, balance_pgdat() will work across the zones of this node in
+ * zone_mask (all of them unless kswapd_threads= split them up between
+ * several threads) until they are all at pages_high.
  *
  * Returns the number of pages which were actually freed.
  *
@@ -1759,7 +1917,8 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *mem_cont,
  * the page allocator fallback scheme to ensure that aging of pages is balanced
  * across the zones.
  */
-static unsigned long balance_pgdat(pg_data_t *pgdat, int order)
+static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
+				   unsigned int zone_mask)
 {
 	int all_zones_ok;
 	int priority;
@@ -1808,7 +1967,7 @@ loop_again:
 		for (i = pgdat->nr_zones - 1; i >= 0; i--) {
 			struct zone *zone = pgdat->node_zones + i;
 
-			if (!populated_zone(zone))
+			if (!populated_zone(zone) || !(zone_mask & (1 << i)))
 				continue;
 
 			if (zone_is_all_unreclaimable(zone) &&
@@ -1835,7 +1994,8 @@ loop_again:
 		for (i = 0; i <= end_zone; i++) {
 			struct zone *zone = pgdat->node_zones + i;
 
-			lru_pages += zone_lru_pages(zone);
+			if (zone_mask & (1 << i))
+				lru_pages += zone_lru_pages(zone);
 		}
 
 		/*
@@ -1851,7 +2011,7 @@ loop_again:
 			struct zone *zone = pgdat->node_zones + i;
 			int nr_slab;
 
-			if (!populated_zone(zone))
+			if (!populated_zone(zone) || !(zone_mask & (1 << i)))
 				continue;
 
 			if (zone_is_all_unreclaimable(zone) &&
@@ -1864,6 +2024,11 @@ loop_again:
 			temp_priority[i] = priority;
 			sc.nr_scanned = 0;
 			note_zone_scanning_priority(zone, priority);
+			/*
+			 * Call soft limit reclaim before calling shrink_zone.
+			 * For now we ignore the return value
+			 */
+			mem_cgroup_soft_limit_reclaim(zone, order, sc.gfp_mask);
 			/*
 			 * We put equal pressure on every zone, unless one
 			 * zone has way too many pages free already.
@@ -1918,7 +2083,8 @@ out:
 	for (i = 0; i < pgdat->nr_zones; i++) {
 		struct zone *zone = pgdat->node_zones + i;
 
-		zone->prev_priority = temp_priority[i];
+		if (zone_mask & (1 << i))
+			zone->prev_priority = temp_priority[i];
 	}
 	if (!all_zones_ok) {
 		cond_resched();
@@ -1961,10 +2127,10 @@ out:
  * If there are applications that are active memory-allocators
  * (most normal use), this basically shouldn't matter.
  */
-static int kswapd(void *p)
+static int kswapd_loop(pg_data_t *pgdat, wait_queue_head_t *kswapd_wait,
+		       int *max_order, unsigned int *zone_mask)
 {
 	unsigned long order;
-	pg_data_t *pgdat = (pg_data_t*)p;
 	struct task_struct *tsk = current;
 	DEFINE_WAIT(wait);
 	struct reclaim_state reclaim_state = {
@@ -1997,9 +2163,9 @@ static int kswapd(void *p)
 	for ( ; ; ) {
 		unsigned long new_order;
 
-		prepare_to_wait(&pgdat->kswapd_wait, &wait, TASK_INTERRUPTIBLE);
-		new_order = pgdat->kswapd_max_order;
-		pgdat->kswapd_max_order = 0;
+		prepare_to_wait(kswapd_wait, &wait, TASK_INTERRUPTIBLE);
+		new_order = *max_order;
+		*max_order = 0;
 		if (order < new_order) {
 			/*
 			 * Don't sleep if someone wants a larger 'order'
@@ -2010,26 +2176,60 @@ static int kswapd(void *p)
 			if (!freezing(current))
 				schedule();
 
-			order = pgdat->kswapd_max_order;
+			order = *max_order;
 		}
-		finish_wait(&pgdat->kswapd_wait, &wait);
+		finish_wait(kswapd_wait, &wait);
 
 		if (!try_to_freeze()) {
 			/* We can speed up thawing tasks if we don't call
 			 * balance_pgdat after returning from the refrigerator
 			 */
-			balance_pgdat(pgdat, order);
+			balance_pgdat(pgdat, order, ACCESS_ONCE(*zone_mask));
 		}
 	}
 	return 0;
 }
 
+static int kswapd(void *p)
+{
+	pg_data_t *pgdat = p;
+
+	return kswapd_loop(pgdat, &pgdat->kswapd_wait,
+			   &pgdat->kswapd_max_order, &pgdat->kswapd_zone_mask);
+}
+
+static int kswapd_helper(void *p)
+{
+	struct kswapd_helper *helper = p;
+
+	return kswapd_loop(helper->pgdat, &helper->wait,
+			   &helper->max_order, &helper->zone_mask);
+}
+
+/* The kswapd helper which balances @zone, NULL if kswapd does it */
+static struct kswapd_helper *zone_kswapd_helper(struct zone *zone)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+	unsigned int bit = 1 << zone_idx(zone);
+	int i;
+
+	if (pgdat->kswapd_zone_mask & bit)
+		return NULL;
+	for (i = 0; i < MAX_KSWAPD_HELPERS; i++)
+		if (pgdat->kswapd_helper[i].zone_mask & bit)
+			return &pgdat->kswapd_helper[i];
+	return NULL;
+}
+
 /*
  * A zone is low on free memory, so wake its kswapd task to service it.
  */
 void wakeup_kswapd(struct zone *zone, int order)
 {
 	pg_data_t *pgdat;
+	struct kswapd_helper *helper;
+	wait_queue_head_t *wait;
+	int *max_order;
 
 	if (!populated_zone(zone))
 		return;
@@ -2037,13 +2237,21 @@ void wakeup_kswapd(struct zone *zone, int order)
 	pgdat = zone->zone_pgdat;
 	if (zone_watermark_ok(zone, order, zone->pages_low, 0, 0))
 		return;
-	if (pgdat->kswapd_max_order < order)
-		pgdat->kswapd_max_order = order;
+	helper = zone_kswapd_helper(zone);
+	if (helper) {
+		wait = &helper->wait;
+		max_order = &helper->max_order;
+	} else {
+		wait = &pgdat->kswapd_wait;
+		max_order = &pgdat->kswapd_max_order;
+	}
+	if (*max_order < order)
+		*max_order = order;
 	if (!cpuset_zone_allowed_hardwall(zone, GFP_KERNEL))
 		return;
-	if (!waitqueue_active(&pgdat->kswapd_wait))
+	if (!waitqueue_active(wait))
 		return;
-	wake_up_interruptible(&pgdat->kswapd_wait);
+	wake_up_interruptible(wait);
 }
 
 unsigned long global_lru_pages(void)
@@ -2212,9 +2420,16 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
 
 			mask = cpumask_of_node(pgdat->node_id);
 
-			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
+			if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids) {
+				int i;
+
 				/* One of our CPUs online: restore mask */
 				set_cpus_allowed_ptr(pgdat->kswapd, mask);
+				for (i = 0; i < MAX_KSWAPD_HELPERS; i++)
+					if (pgdat->kswapd_helper[i].task)
+						set_cpus_allowed_ptr(
+						pgdat->kswapd_helper[i].task, mask);
+			}
 		}
 	}
 	return NOTIFY_OK;
@@ -2224,10 +2439,60 @@ static int __devinit cpu_callback(struct notifier_block *nfb,
  * This kswapd start function will be called by init and node-hot-add.
  * On node-hot-add, kswapd will moved to proper cpus if cpus are hot-added.
  */
+/*
+ * Split the populated zones of @pgdat between kswapd and up to
+ * kswapd_threads - 1 helpers, round robin from the highest zone down, so
+ * that each zone is balanced by one thread only and the threads do not
+ * contend on the same LRU lists. A node has at most as many threads as
+ * populated zones. The helpers are a best effort: failing to start one
+ * leaves its zones to kswapd.
+ */
+static void kswapd_start_helpers(pg_data_t *pgdat)
+{
+	unsigned int mask[MAX_KSWAPD_HELPERS + 1] = { 0, };
+	int nr_threads, nr_zones = 0;
+	int i, t;
+
+	for (i = pgdat->nr_zones - 1; i >= 0; i--)
+		if (populated_zone(pgdat->node_zones + i))
+			nr_zones++;
+	nr_threads = min(kswapd_threads, nr_zones);
+	if (nr_threads <= 1)
+		return;
+
+	for (i = pgdat->nr_zones - 1, t = 0; i >= 0; i--) {
+		if (!populated_zone(pgdat->node_zones + i))
+			continue;
+		mask[t] |= 1 << i;
+		t = (t + 1) % nr_threads;
+	}
+
+	for (t = 1; t < nr_threads; t++) {
+		struct kswapd_helper *helper = &pgdat->kswapd_helper[t - 1];
+		struct task_struct *p;
+
+		if (helper->task)
+			continue;
+		helper->pgdat = pgdat;
+		init_waitqueue_head(&helper->wait);
+		helper->max_order = 0;
+		helper->zone_mask = mask[t];
+		p = kthread_run(kswapd_helper, helper, "kswapd%d:%d",
+				pgdat->node_id, t);
+		if (IS_ERR(p)) {
+			printk(KERN_WARNING "Failed to start kswapd helper %d "
+				"on node %d\n", t, pgdat->node_id);
+			helper->zone_mask = 0;
+			break;
+		}
+		helper->task = p;
+		pgdat->kswapd_zone_mask &= ~mask[t];
+	}
+}
+
 int kswapd_run(int nid)
 {
 	pg_data_t *pgdat = NODE_DATA(nid);
-	int ret = 0;
 
 	if (pgdat->kswapd)
 		return 0;
@@ -2237,10 +2502,21 @@ int kswapd_run(int nid)
 		/* failure at boot is fatal */
 		BUG_ON(system_state == SYSTEM_BOOTING);
 		printk("Failed to start kswapd on node %d\n",nid);
-		ret = -1;
+		return -1;
 	}
-	return ret;
+
+	kswapd_start_helpers(pgdat);
+	return 0;
+}
+
+static int __init kswapd_threads_setup(char *str)
+{
+	int n = simple_strtol(str, NULL, 0);
+
+	kswapd_threads = clamp(n, 1, MAX_KSWAPD_HELPERS + 1);
+	return 1;
 }
+__setup("kswapd_threads=", kswapd_threads_setup);
 
 static int __init kswapd_init(void)
 {
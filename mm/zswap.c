@@ -0,0 +1,476 @@
+/*
+ * mm/zswap.c - compressed cache for swap pages
+ *
+ * Pages on their way out to swap are compressed with LZO and kept in
+ * memory, in a set of slab caches sized in steps of PAGE_SIZE/32, instead
+ * of being written to the swap device.  Reading them back in is then a
+ * decompression rather than a disk seek.  Only when the pool has reached
+ * its size limit, or a page does not compress well enough to be worth
+ * keeping, does swap_writepage() go on to write the page to disk.
+ *
+ * Compressed pages are indexed per swap device by offset, and live exactly
+ * as long as their swap slot: swap_entry_free() drops them when the slot's
+ * count reaches zero.
+ *
+ * Tunables and statistics are in /sys/kernel/mm/zswap/, see
+ * Documentation/vm/zswap.txt.
+ */
+
+#include <linux/mm.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/highmem.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/math64.h>
+#include <linux/lzo.h>
+#include <linux/zswap.h>
+
+/*
+ * Compressed pages are stored in objects of ZSWAP_NR_CLASSES sizes, in
+ * steps of ZSWAP_CLASS_STEP.  Pages that do not fit the largest class,
+ * i.e. that compress to more than 3/4 of their size, go to disk.
+ */
+#define ZSWAP_CLASS_STEP	(PAGE_SIZE / 32)
+#define ZSWAP_NR_CLASSES	24
+#define ZSWAP_MAX_LENGTH	(ZSWAP_NR_CLASSES * ZSWAP_CLASS_STEP)
+
+struct zswap_class {
+	struct kmem_cache *cache;
+	char name[16];
+};
+
+static struct zswap_class zswap_classes[ZSWAP_NR_CLASSES];
+static struct kmem_cache *zswap_entry_cache;
+
+struct zswap_entry {
+	struct rb_node	rb_node;
+	pgoff_t		offset;
+	unsigned int	length;		/* compressed length */
+	unsigned int	class;		/* index into zswap_classes[] */
+	void		*data;
+};
+
+struct zswap_tree {
+	struct rb_root	root;
+	spinlock_t	lock;
+};
+
+static struct zswap_tree zswap_trees[MAX_SWAPFILES];
+
+/* Per-cpu LZO work memory and compression buffer */
+struct zswap_pcpu {
+	void		*workmem;
+	unsigned char	*buf;
+};
+
+static DEFINE_PER_CPU(struct zswap_pcpu, zswap_pcpu);
+
+static int zswap_enabled __read_mostly = 1;
+static unsigned int zswap_max_pool_percent __read_mostly = 20;
+
+/* Bytes of objects in the pool, and pages stored in them */
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_stored_pages = ATOMIC_LONG_INIT(0);
+
+static atomic_long_t zswap_stores = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_loads = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_load_misses = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_pool_full = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_compress_poor = ATOMIC_LONG_INIT(0);
+static atomic_long_t zswap_reject_alloc_fail = ATOMIC_LONG_INIT(0);
+
+static inline unsigned int zswap_class_size(unsigned int class)
+{
+	return (class + 1) * ZSWAP_CLASS_STEP;
+}
+
+static inline int zswap_pool_full(void)
+{
+	unsigned long max_pages;
+
+	max_pages = totalram_pages * zswap_max_pool_percent / 100;
+	return (atomic_long_read(&zswap_pool_bytes) >> PAGE_SHIFT) >= max_pages;
+}
+
+static struct zswap_entry *zswap_search(struct rb_root *root, pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rb_node);
+		if (offset < entry->offset)
+			node = node->rb_left;
+		else if (offset > entry->offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+static void zswap_insert(struct rb_root *root, struct zswap_entry *new)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct zswap_entry, rb_node);
+		if (new->offset < entry->offset)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, link);
+	rb_insert_color(&new->rb_node, root);
+}
+
+static void zswap_free_entry(struct zswap_entry *entry)
+{
+	kmem_cache_free(zswap_classes[entry->class].cache, entry->data);
+	atomic_long_sub(zswap_class_size(entry->class), &zswap_pool_bytes);
+	atomic_long_dec(&zswap_stored_pages);
+	kmem_cache_free(zswap_entry_cache, entry);
+}
+
+/* Called with tree->lock held */
+static void __zswap_erase(struct zswap_tree *tree, pgoff_t offset)
+{
+	struct zswap_entry *entry;
+
+	entry = zswap_search(&tree->root, offset);
+	if (entry) {
+		rb_erase(&entry->rb_node, &tree->root);
+		zswap_free_entry(entry);
+	}
+}
+
+/**
+ * zswap_store - compress a swap cache page into the pool
+ * @page: locked swap cache page about to be written out
+ *
+ * Returns 0 if the page was stored, in which case it need not be written
+ * to the swap device, or a negative error if it has to be.
+ */
+int zswap_store(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	pgoff_t offset = swp_offset(swp);
+	struct zswap_entry *entry;
+	struct zswap_pcpu *pcpu;
+	unsigned int class;
+	size_t len;
+	void *src;
+	int ret;
+
+	/*
+	 * Whatever happens below, an older copy of this slot is stale now:
+	 * the page may have been redirtied since it was last stored.
+	 */
+	spin_lock(&tree->lock);
+	__zswap_erase(tree, offset);
+	spin_unlock(&tree->lock);
+
+	if (!zswap_enabled)
+		return -EPERM;
+	if (zswap_pool_full()) {
+		atomic_long_inc(&zswap_reject_pool_full);
+		return -ENOSPC;
+	}
+
+	entry = kmem_cache_alloc(zswap_entry_cache,
+				 GFP_NOWAIT | __GFP_NOWARN | __GFP_NOMEMALLOC);
+	if (!entry) {
+		atomic_long_inc(&zswap_reject_alloc_fail);
+		return -ENOMEM;
+	}
+
+	pcpu = &get_cpu_var(zswap_pcpu);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, pcpu->buf, &len, pcpu->workmem);
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK || len > ZSWAP_MAX_LENGTH) {
+		put_cpu_var(zswap_pcpu);
+		atomic_long_inc(&zswap_reject_compress_poor);
+		ret = -E2BIG;
+		goto free_entry;
+	}
+
+	class = (len - 1) / ZSWAP_CLASS_STEP;
+	entry->data = kmem_cache_alloc(zswap_classes[class].cache,
+				GFP_NOWAIT | __GFP_NOWARN | __GFP_NOMEMALLOC);
+	if (!entry->data) {
+		put_cpu_var(zswap_pcpu);
+		atomic_long_inc(&zswap_reject_alloc_fail);
+		ret = -ENOMEM;
+		goto free_entry;
+	}
+	memcpy(entry->data, pcpu->buf, len);
+	put_cpu_var(zswap_pcpu);
+
+	entry->offset = offset;
+	entry->length = len;
+	entry->class = class;
+	atomic_long_add(zswap_class_size(class), &zswap_pool_bytes);
+	atomic_long_inc(&zswap_stored_pages);
+	atomic_long_inc(&zswap_stores);
+
+	/* The page is locked in the swap cache: nobody else stores here */
+	spin_lock(&tree->lock);
+	zswap_insert(&tree->root, entry);
+	spin_unlock(&tree->lock);
+	return 0;
+
+free_entry:
+	kmem_cache_free(zswap_entry_cache, entry);
+	return ret;
+}
+
+/**
+ * zswap_load - fill a swap cache page from the pool
+ * @page: locked, not uptodate swap cache page
+ *
+ * Returns 0 if the page was found and decompressed, or -ENOENT if it has
+ * to be read from the swap device.
+ */
+int zswap_load(struct page *page)
+{
+	swp_entry_t swp = { .val = page_private(page) };
+	struct zswap_tree *tree = &zswap_trees[swp_type(swp)];
+	struct zswap_entry *entry;
+	size_t len = PAGE_SIZE;
+	void *dst;
+	int ret;
+
+	spin_lock(&tree->lock);
+	entry = zswap_search(&tree->root, swp_offset(swp));
+	spin_unlock(&tree->lock);
+	if (!entry) {
+		atomic_long_inc(&zswap_load_misses);
+		return -ENOENT;
+	}
+
+	/*
+	 * The entry cannot go away under us: the slot is referenced by the
+	 * swap cache page we hold locked, so it is neither freed nor stored
+	 * to again until we are done.
+	 */
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &len);
+	kunmap_atomic(dst, KM_USER0);
+	BUG_ON(ret != LZO_E_OK || len != PAGE_SIZE);
+
+	atomic_long_inc(&zswap_loads);
+	return 0;
+}
+
+/*
+ * Called from swap_entry_free() with swap_lock held when a slot is freed.
+ */
+void zswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+
+	spin_lock(&tree->lock);
+	__zswap_erase(tree, offset);
+	spin_unlock(&tree->lock);
+}
+
+/*
+ * Called at swapoff, once all slots of the device are free.
+ */
+void zswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = &zswap_trees[type];
+	struct zswap_entry *entry;
+	struct rb_node *node;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->root))) {
+		entry = rb_entry(node, struct zswap_entry, rb_node);
+		rb_erase(node, &tree->root);
+		zswap_free_entry(entry);
+	}
+	spin_unlock(&tree->lock);
+}
+
+#ifdef CONFIG_SYSFS
+#define ZSWAP_ATTR_RO(_name) \
+	static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+#define ZSWAP_ATTR(_name) \
+	static struct kobj_attribute _name##_attr = \
+		__ATTR(_name, 0644, _name##_show, _name##_store)
+
+#define ZSWAP_STAT_ATTR(_name)						\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	return sprintf(buf, "%lu\n",					\
+		       (unsigned long)atomic_long_read(&zswap_##_name));\
+}									\
+ZSWAP_ATTR_RO(_name)
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", zswap_enabled);
+}
+static ssize_t enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long input;
+	int err;
+
+	err = strict_strtoul(buf, 10, &input);
+	if (err || input > 1)
+		return -EINVAL;
+	zswap_enabled = input;
+	return count;
+}
+ZSWAP_ATTR(enabled);
+
+static ssize_t max_pool_percent_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", zswap_max_pool_percent);
+}
+static ssize_t max_pool_percent_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned long input;
+	int err;
+
+	err = strict_strtoul(buf, 10, &input);
+	if (err || input > 100)
+		return -EINVAL;
+	zswap_max_pool_percent = input;
+	return count;
+}
+ZSWAP_ATTR(max_pool_percent);
+
+static ssize_t pool_kb_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n",
+		       (unsigned long)atomic_long_read(&zswap_pool_bytes) >> 10);
+}
+ZSWAP_ATTR_RO(pool_kb);
+
+/* Original size over compressed size, in hundredths */
+static ssize_t compr_ratio_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	unsigned long pool = atomic_long_read(&zswap_pool_bytes);
+	unsigned long stored = atomic_long_read(&zswap_stored_pages);
+	unsigned long ratio = 0;
+
+	if (pool)
+		ratio = div64_u64((u64)stored * PAGE_SIZE * 100, pool);
+	return sprintf(buf, "%lu.%02lu\n", ratio / 100, ratio % 100);
+}
+ZSWAP_ATTR_RO(compr_ratio);
+
+/* Swap-ins served from the pool, in percent */
+static ssize_t hit_percent_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	unsigned long hits = atomic_long_read(&zswap_loads);
+	unsigned long misses = atomic_long_read(&zswap_load_misses);
+
+	return sprintf(buf, "%lu\n",
+		       hits + misses ? hits * 100 / (hits + misses) : 0);
+}
+ZSWAP_ATTR_RO(hit_percent);
+
+ZSWAP_STAT_ATTR(stored_pages);
+ZSWAP_STAT_ATTR(stores);
+ZSWAP_STAT_ATTR(loads);
+ZSWAP_STAT_ATTR(load_misses);
+ZSWAP_STAT_ATTR(reject_pool_full);
+ZSWAP_STAT_ATTR(reject_compress_poor);
+ZSWAP_STAT_ATTR(reject_alloc_fail);
+
+static struct attribute *zswap_attrs[] = {
+	&enabled_attr.attr,
+	&max_pool_percent_attr.attr,
+	&pool_kb_attr.attr,
+	&compr_ratio_attr.attr,
+	&hit_percent_attr.attr,
+	&stored_pages_attr.attr,
+	&stores_attr.attr,
+	&loads_attr.attr,
+	&load_misses_attr.attr,
+	&reject_pool_full_attr.attr,
+	&reject_compress_poor_attr.attr,
+	&reject_alloc_fail_attr.attr,
+	NULL,
+};
+
+static struct attribute_group zswap_attr_group = {
+	.attrs = zswap_attrs,
+	.name = "zswap",
+};
+
+static void __init zswap_sysfs_init(void)
+{
+	if (sysfs_create_group(mm_kobj, &zswap_attr_group))
+		printk(KERN_ERR "zswap: failed to register sysfs attributes\n");
+}
+#else
+static inline void zswap_sysfs_init(void)
+{
+}
+#endif /* CONFIG_SYSFS */
+
+static int __init zswap_init(void)
+{
+	struct zswap_pcpu *pcpu;
+	int i, cpu;
+
+	for (i = 0; i < MAX_SWAPFILES; i++) {
+		zswap_trees[i].root = RB_ROOT;
+		spin_lock_init(&zswap_trees[i].lock);
+	}
+
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	if (!zswap_entry_cache)
+		goto fail;
+
+	for (i = 0; i < ZSWAP_NR_CLASSES; i++) {
+		snprintf(zswap_classes[i].name, sizeof(zswap_classes[i].name),
+			 "zswap-%u", zswap_class_size(i));
+		zswap_classes[i].cache = kmem_cache_create(
+				zswap_classes[i].name, zswap_class_size(i),
+				0, 0, NULL);
+		if (!zswap_classes[i].cache)
+			goto fail;
+	}
+
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(zswap_pcpu, cpu);
+		pcpu->workmem = kmalloc(LZO1X_1_MEM_COMPRESS, GFP_KERNEL);
+		pcpu->buf = kmalloc(lzo1x_worst_compress(PAGE_SIZE),
+				    GFP_KERNEL);
+		if (!pcpu->workmem || !pcpu->buf)
+			goto fail;
+	}
+
+	zswap_sysfs_init();
+	return 0;
+
+fail:
+	/* Leave the pool empty; every store falls back to disk */
+	printk(KERN_ERR "zswap: initialisation failed, disabled\n");
+	zswap_enabled = 0;
+	return -ENOMEM;
+}
+__initcall(zswap_init);